@@ -0,0 +1,124 @@
+/**
+ * @file bench_encode.cpp
+ * Measures encoding a PNG with lodepng on 1 thread, the original single
+ * deflate run, and with its threads setting on 2, 4 and 8 threads, which
+ * deflate the blocks of the filtered scanlines on their own and join them.
+ * Every encoded file is read back with libpng, which must give the same
+ * pixels, and its size is printed next to the time. Then the same thread
+ * counts are timed through PNG::writeToFile and PackedPNG::writeToFile,
+ * as a batch job saves images, writing to a scratch file.
+ *
+ * Usage: ./bench_encode [repeats] [file]   (default: 5 rosegarden.png)
+ */
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <vector>
+
+#include <png.h>
+
+#include "cs221util/PNG.h"
+#include "cs221util/PackedPNG.h"
+#include "cs221util/lodepng/lodepng.h"
+
+/**
+ * Decodes a PNG in memory to RGBA8 with libpng.
+ * @return Whether libpng decoded it to exactly the pixels given
+ */
+bool libpngDecodes(std::vector<unsigned char> const & file, std::vector<unsigned char> const & pixels) {
+  png_image image;
+  memset(&image, 0, sizeof(image));
+  image.version = PNG_IMAGE_VERSION;
+  if (!png_image_begin_read_from_memory(&image, file.data(), file.size())) {
+    std::cerr << "libpng: " << image.message << std::endl;
+    return false;
+  }
+  image.format = PNG_FORMAT_RGBA;
+  std::vector<unsigned char> decoded(PNG_IMAGE_SIZE(image));
+  if (!png_image_finish_read(&image, NULL, decoded.data(), 0, NULL)) {
+    std::cerr << "libpng: " << image.message << std::endl;
+    return false;
+  }
+  return decoded == pixels;
+}
+
+int main(int argc, char *argv[]) {
+  int repeats = argc > 1 ? atoi(argv[1]) : 5;
+  char const *fileName = argc > 2 ? argv[2] : "rosegarden.png";
+
+  std::vector<unsigned char> pixels;
+  unsigned width, height;
+  unsigned error = lodepng::decode(pixels, width, height, fileName);
+  if (error) {
+    std::cerr << "PNG decoder error " << error << ": " << lodepng_error_text(error) << std::endl;
+    return 1;
+  }
+
+  std::cout << std::fixed << std::setprecision(2);
+  std::cout << width << "x" << height << ", " << repeats << " runs" << std::endl;
+  std::cout << std::setw(8) << "threads" << std::setw(12) << "ms" << std::setw(10) << "speedup"
+            << std::setw(12) << "bytes" << std::setw(8) << "libpng" << std::endl;
+
+  bool passed = true;
+  double serial = 0;
+  unsigned counts[] = {1, 2, 4, 8};
+  for (unsigned threads : counts) {
+    lodepng::State state;
+    state.encoder.zlibsettings.threads = threads;
+    std::vector<unsigned char> file;
+
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < repeats; i++) {
+      file.clear();
+      error = lodepng::encode(file, pixels, width, height, state);
+    }
+    std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+    double ms = elapsed.count() / repeats;
+    if (threads == 1) { serial = ms; }
+
+    bool decodes = !error && libpngDecodes(file, pixels);
+    passed &= decodes;
+    std::cout << std::setw(8) << threads << std::setw(12) << ms << std::setw(10) << serial / ms
+              << std::setw(12) << file.size() << std::setw(8) << (decodes ? "ok" : "FAIL") << std::endl;
+  }
+
+  // through the image classes, which convert (PNG) and write the file too
+  char const *scratch = "bench-encode.png";
+  cs221util::PNG image;
+  cs221util::PackedPNG packed;
+  image.readFromFile(fileName);
+  packed.readFromFile(fileName);
+  std::cout << std::endl << std::setw(8) << "threads" << std::setw(12) << "PNG ms" << std::setw(10) << "speedup"
+            << std::setw(12) << "Packed ms" << std::setw(10) << "speedup" << std::setw(8) << "same" << std::endl;
+  double serialMs[2] = {0, 0};
+  for (unsigned threads : counts) {
+    double ms[2];
+    for (int which = 0; which < 2; which++) {
+      auto start = std::chrono::steady_clock::now();
+      for (int i = 0; i < repeats; i++) {
+        if (which == 0) {
+          image.writeToFile(scratch, threads);
+        } else {
+          packed.writeToFile(scratch, threads);
+        }
+      }
+      std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+      ms[which] = elapsed.count() / repeats;
+      if (threads == 1) { serialMs[which] = ms[which]; }
+    }
+
+    cs221util::PackedPNG saved;
+    bool same = saved.readFromFile(scratch) && saved == packed;
+    passed &= same;
+    std::cout << std::setw(8) << threads << std::setw(12) << ms[0] << std::setw(10) << serialMs[0] / ms[0]
+              << std::setw(12) << ms[1] << std::setw(10) << serialMs[1] / ms[1]
+              << std::setw(8) << (same ? "yes" : "NO") << std::endl;
+  }
+  std::remove(scratch);
+
+  return passed ? 0 : 1;
+}
@@ -0,0 +1,63 @@
+/**
+ * @file bench_hash.cpp
+ * Measures comparing and hashing two separately loaded copies of
+ * rosegarden.png: equality of equal images and of images differing in the
+ * last pixel (every byte compared, either way); hashing from scratch, again
+ * after a filter changed one row, and with every row hash cached.
+ *
+ * Usage: ./bench_hash [repeats]   (default: 200)
+ */
+
+#include <chrono>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+
+#include "cs221util/PNG.h"
+
+using namespace cs221util;
+
+/**
+ * Runs fn repeats times and prints the microseconds per run on a row.
+ */
+template <typename Func>
+void report(char const *name, int repeats, Func fn) {
+  bool result = true;
+  auto start = std::chrono::steady_clock::now();
+  for (int i = 0; i < repeats; i++) {
+    result = fn();
+  }
+  std::chrono::duration<double, std::micro> elapsed = std::chrono::steady_clock::now() - start;
+  std::cout << std::setw(24) << name << std::setw(12) << elapsed.count() / repeats
+            << std::setw(8) << (result ? "true" : "false") << std::endl;
+}
+
+int main(int argc, char *argv[]) {
+  int repeats = argc > 1 ? atoi(argv[1]) : 200;
+
+  PNG first, second;
+  first.readFromFile("rosegarden.png");
+  second.readFromFile("rosegarden.png");
+  PNG last(second);
+  last.getRow(last.height() - 1)[last.width() - 1].l /= 2;
+
+  std::cout << std::fixed << std::setprecision(2);
+  std::cout << first.width() << "x" << first.height() << ", " << repeats << " runs" << std::endl;
+  std::cout << std::setw(24) << "operation" << std::setw(12) << "us" << std::setw(8) << "result"
+            << std::endl;
+
+  report("== equal", repeats, [&] { return first == second; });
+  report("== last pixel differs", repeats, [&] { return first == last; });
+
+  unsigned y = 0;
+  report("hash, every row", repeats, [&] {
+    first.getData();
+    return first.hash() != 0;
+  });
+  report("hash, one row changed", repeats, [&] {
+    first.getRow(y++ % first.height())[0].s = 0;
+    return first.hash() != 0;
+  });
+  report("hash, cached", repeats, [&] { return first.hash() != 0; });
+  return 0;
+}
@@ -0,0 +1,126 @@
+/**
+ * @file bench_hsl.cpp
+ * Measures converting the pixels of rosegarden.png between RGBA bytes and
+ * HSLAPixels: one pixel at a time with rgb2hsl and hsl2rgb, as PNG used
+ * to, and a row at a time with the functions of HSLConvert.h. Reports the
+ * cost per megapixel and how far each row conversion strays from the one
+ * pixel at a time result (the largest difference in any of h, s, l and a,
+ * or the number of bytes that differ).
+ *
+ * Usage: ./bench_hsl [repeats]   (default: 20)
+ */
+
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <vector>
+
+#include "cs221util/HSLConvert.h"
+#include "cs221util/RGB_HSL.h"
+#include "cs221util/lodepng/lodepng.h"
+
+using namespace cs221util;
+
+/**
+ * Runs fn repeats times.
+ * @return The milliseconds per run
+ */
+template <typename Func>
+double timeMs(int repeats, Func fn) {
+  auto start = std::chrono::steady_clock::now();
+  for (int i = 0; i < repeats; i++) {
+    fn();
+  }
+  std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+  return elapsed.count() / repeats;
+}
+
+/**
+ * @return The largest difference between the channels of two pixel arrays
+ */
+double largestDifference(vector<HSLAPixel> const & first, vector<HSLAPixel> const & second) {
+  double largest = 0;
+  for (size_t i = 0; i < first.size(); i++) {
+    largest = std::max(largest, std::fabs(first[i].h - second[i].h));
+    largest = std::max(largest, std::fabs(first[i].s - second[i].s));
+    largest = std::max(largest, std::fabs(first[i].l - second[i].l));
+    largest = std::max(largest, std::fabs(first[i].a - second[i].a));
+  }
+  return largest;
+}
+
+/**
+ * Prints a row of the table.
+ */
+void report(char const *name, double ms, double megapixels, double error) {
+  std::cout << std::setw(16) << name << std::setw(10) << std::setprecision(2) << ms
+            << std::setw(12) << ms / megapixels << std::setw(12) << std::setprecision(0)
+            << std::scientific << error << std::fixed << std::endl;
+}
+
+int main(int argc, char *argv[]) {
+  int repeats = argc > 1 ? atoi(argv[1]) : 20;
+
+  vector<unsigned char> bytes;
+  unsigned width, height;
+  lodepng::decode(bytes, width, height, "rosegarden.png");
+  unsigned count = width * height;
+  double megapixels = count / 1e6;
+
+  vector<HSLAPixel> expected(count), pixels(count);
+  vector<unsigned char> expectedBytes(count * 4), rgba(count * 4);
+
+  std::cout << std::fixed;
+  std::cout << width << "x" << height << ", " << repeats << " runs" << std::endl;
+  std::cout << std::setw(16) << "conversion" << std::setw(10) << "ms" << std::setw(12) << "ms/MP"
+            << std::setw(12) << "error" << std::endl;
+
+  double ms = timeMs(repeats, [&] {
+    for (unsigned i = 0; i < count; i++) {
+      rgbaColor rgb = {bytes[i * 4], bytes[i * 4 + 1], bytes[i * 4 + 2], bytes[i * 4 + 3]};
+      hslaColor hsl = rgb2hsl(rgb);
+      expected[i] = HSLAPixel(hsl.h, hsl.s, hsl.l, hsl.a);
+    }
+  });
+  report("rgb2hsl", ms, megapixels, 0);
+
+  ms = timeMs(repeats, [&] {
+    for (unsigned y = 0; y < height; y++) {
+      rgbaToHSL(&bytes[y * width * 4], &pixels[y * width], width);
+    }
+  });
+  report("rgbaToHSL", ms, megapixels, largestDifference(expected, pixels));
+
+  ms = timeMs(repeats, [&] {
+    for (unsigned y = 0; y < height; y++) {
+      rgbaToHSLTable(&bytes[y * width * 4], &pixels[y * width], width);
+    }
+  });
+  report("rgbaToHSLTable", ms, megapixels, largestDifference(expected, pixels));
+
+  ms = timeMs(repeats, [&] {
+    for (unsigned i = 0; i < count; i++) {
+      hslaColor hsl = {expected[i].h, expected[i].s, expected[i].l, expected[i].a};
+      rgbaColor rgb = hsl2rgb(hsl);
+      expectedBytes[i * 4] = rgb.r;
+      expectedBytes[i * 4 + 1] = rgb.g;
+      expectedBytes[i * 4 + 2] = rgb.b;
+      expectedBytes[i * 4 + 3] = rgb.a;
+    }
+  });
+  report("hsl2rgb", ms, megapixels, 0);
+
+  ms = timeMs(repeats, [&] {
+    for (unsigned y = 0; y < height; y++) {
+      hslToRGBA(&expected[y * width], &rgba[y * width * 4], width);
+    }
+  });
+  size_t wrong = 0;
+  for (size_t i = 0; i < rgba.size(); i++) {
+    wrong += rgba[i] != expectedBytes[i];
+  }
+  report("hslToRGBA", ms, megapixels, wrong);
+  return 0;
+}
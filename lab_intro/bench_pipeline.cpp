@@ -0,0 +1,96 @@
+/**
+ * @file bench_pipeline.cpp
+ * Measures the four filters chained on rosegarden.png (grown to 1024x768,
+ * watermark's size): called one after another, each copying the image in
+ * and out, and as one FilterPipeline on 1, 2 and 4 threads, changing a
+ * copy made once. Every run must produce the same pixels.
+ *
+ * Usage: ./bench_pipeline [repeats]   (default: 20)
+ */
+
+#include <chrono>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+
+#include "cs221util/PNG.h"
+#include "lab_intro.h"
+#include "pipeline.h"
+
+/**
+ * @return Whether two images have the same size and pixels
+ */
+bool samePixels(PNG const & first, PNG const & second) {
+  if (first.width() != second.width() || first.height() != second.height()) {
+    return false;
+  }
+  HSLAPixel const *a = first.getData(), *b = second.getData();
+  for (unsigned i = 0; i < first.width() * first.height(); i++) {
+    if (a[i].h != b[i].h || a[i].s != b[i].s || a[i].l != b[i].l || a[i].a != b[i].a) {
+      return false;
+    }
+  }
+  return true;
+}
+
+/**
+ * Runs fn repeats times and prints its time and throughput on a row.
+ */
+template <typename Func>
+void report(char const *name, int repeats, double megapixels, bool same, Func fn) {
+  auto start = std::chrono::steady_clock::now();
+  for (int i = 0; i < repeats; i++) {
+    fn();
+  }
+  std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+  double ms = elapsed.count() / repeats;
+  std::cout << std::setw(14) << name << std::setw(10) << ms << std::setw(10)
+            << megapixels / (ms / 1000) << std::setw(8) << (same ? "yes" : "NO") << std::endl;
+}
+
+int main(int argc, char *argv[]) {
+  int repeats = argc > 1 ? atoi(argv[1]) : 20;
+
+  PNG png, overlay;
+  png.readFromFile("rosegarden.png");
+  overlay.readFromFile("overlay.png");
+  png.resize(1024, 768);
+  double megapixels = png.width() * png.height() / 1e6;
+
+  FilterPipeline pipeline;
+  pipeline.grayscale().spotlight(300, 300).ubcify().watermark(overlay);
+
+  PNG expected = watermark(ubcify(createSpotlight(grayscale(png), 300, 300)), overlay);
+
+  std::cout << std::fixed << std::setprecision(2);
+  std::cout << png.width() << "x" << png.height() << ", " << pipeline.size() << " stages, "
+            << repeats << " runs" << std::endl;
+  std::cout << std::setw(14) << "chain" << std::setw(10) << "ms" << std::setw(10) << "MP/s"
+            << std::setw(8) << "same" << std::endl;
+
+  PNG result;
+  report("by value", repeats, megapixels, true, [&] {
+    result = watermark(ubcify(createSpotlight(grayscale(png), 300, 300)), overlay);
+  });
+
+  unsigned threadCounts[3] = {1, 2, 4};
+  char const *names[3] = {"pipeline x1", "pipeline x2", "pipeline x4"};
+  for (int i = 0; i < 3; i++) {
+    PNG check = pipeline.run(png, threadCounts[i]);
+    report(names[i], repeats, megapixels, samePixels(check, expected), [&] {
+      result = pipeline.run(png, threadCounts[i]);
+    });
+  }
+
+  // the pipeline can also change the image in place, with no copy at all,
+  // as a batch job that is done with the original would
+  PNG work(png);
+  report("in place x1", repeats, megapixels, true, [&] {
+    pipeline.apply(work);
+  });
+  // its helper threads were started by the runs above and are reused here
+  report("in place x2", repeats, megapixels, true, [&] {
+    pipeline.apply(work, 2);
+  });
+  return 0;
+}
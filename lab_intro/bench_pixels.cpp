@@ -0,0 +1,92 @@
+/**
+ * @file bench_pixels.cpp
+ * Measures walking every pixel of rosegarden.png: through getPixel, in
+ * the column by column order the filters used and row by row, through
+ * getRow, once per row, and through getData, as one flat buffer. Each
+ * walk sums the luminance (reading) and sets the saturation to 0, as
+ * grayscale does (writing), and must agree with the others.
+ *
+ * Usage: ./bench_pixels [repeats]   (default: 50)
+ */
+
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+
+#include "cs221util/PNG.h"
+
+using namespace cs221util;
+
+/**
+ * Walks every pixel of image, reading then writing, the given way.
+ * @return The sum of the luminance
+ */
+double walk(PNG & image, int way) {
+  double sum = 0;
+  unsigned width = image.width(), height = image.height();
+  if (way == 0) {
+    for (unsigned x = 0; x < width; x++) {
+      for (unsigned y = 0; y < height; y++) {
+        HSLAPixel *pixel = image.getPixel(x, y);
+        sum += pixel->l;
+        pixel->s = 0;
+      }
+    }
+  }
+  else if (way == 1) {
+    for (unsigned y = 0; y < height; y++) {
+      for (unsigned x = 0; x < width; x++) {
+        HSLAPixel *pixel = image.getPixel(x, y);
+        sum += pixel->l;
+        pixel->s = 0;
+      }
+    }
+  }
+  else if (way == 2) {
+    for (unsigned y = 0; y < height; y++) {
+      HSLAPixel *row = image.getRow(y);
+      for (unsigned x = 0; x < width; x++) {
+        sum += row[x].l;
+        row[x].s = 0;
+      }
+    }
+  }
+  else {
+    HSLAPixel *pixel = image.getData();
+    HSLAPixel *end = pixel + width * height;
+    for (; pixel != end; pixel++) {
+      sum += pixel->l;
+      pixel->s = 0;
+    }
+  }
+  return sum;
+}
+
+int main(int argc, char *argv[]) {
+  int repeats = argc > 1 ? atoi(argv[1]) : 50;
+  char const *names[4] = {"getPixel x,y", "getPixel y,x", "getRow", "getData"};
+
+  PNG image;
+  image.readFromFile("rosegarden.png");
+  double expected = walk(image, 3);
+
+  std::cout << std::fixed << std::setprecision(2);
+  std::cout << image.width() << "x" << image.height() << ", " << repeats << " walks" << std::endl;
+  std::cout << std::setw(14) << "access" << std::setw(12) << "ms/walk"
+            << std::setw(8) << "same" << std::endl;
+  for (int way = 0; way < 4; way++) {
+    bool same = true;
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < repeats; i++) {
+      // the column by column walk adds in another order
+      double sum = walk(image, way);
+      same = same && std::fabs(sum - expected) <= 1e-9 * expected;
+    }
+    std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+    std::cout << std::setw(14) << names[way] << std::setw(12) << elapsed.count() / repeats
+              << std::setw(8) << (same ? "yes" : "NO") << std::endl;
+  }
+  return 0;
+}
@@ -0,0 +1,101 @@
+/**
+ * @file bench_roundtrip.cpp
+ * Measures loading and saving rosegarden.png as a PNG, which converts
+ * every pixel to HSL doubles and back, and as a PackedPNG, which keeps the
+ * RGBA bytes, and then graying the image through each: the PNG a row at a
+ * time, the PackedPNG a tile at a time. Both must produce the same bytes.
+ *
+ * Usage: ./bench_roundtrip [repeats] [tile size]   (default: 10 64)
+ */
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+
+#include "cs221util/PNG.h"
+#include "cs221util/PackedPNG.h"
+
+using namespace cs221util;
+
+typedef std::chrono::steady_clock::time_point Time;
+
+/**
+ * @return The milliseconds since start
+ */
+double since(Time start) {
+  std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+  return elapsed.count();
+}
+
+/**
+ * Sets the saturation of every pixel of image to 0, as grayscale does.
+ */
+void gray(PNG & image) {
+  for (unsigned y = 0; y < image.height(); y++) {
+    HSLAPixel *row = image.getRow(y);
+    for (unsigned x = 0; x < image.width(); x++) {
+      row[x].s = 0;
+    }
+  }
+}
+
+/**
+ * Prints a row of the table.
+ */
+void report(char const *name, double loadMs, double saveMs, double grayMs, size_t bytes) {
+  std::cout << std::setw(10) << name << std::setw(10) << loadMs << std::setw(10) << saveMs
+            << std::setw(10) << grayMs << std::setw(12) << bytes / 1024 << std::endl;
+}
+
+int main(int argc, char *argv[]) {
+  int repeats = argc > 1 ? atoi(argv[1]) : 10;
+  unsigned tileSize = argc > 2 ? atoi(argv[2]) : 64;
+  char const *scratch = "bench-roundtrip.png";
+
+  double loadMs[2] = {0, 0}, saveMs[2] = {0, 0}, grayMs[2] = {0, 0};
+  PNG image;
+  PackedPNG packed;
+  for (int i = 0; i < repeats; i++) {
+    Time start = std::chrono::steady_clock::now();
+    image.readFromFile("rosegarden.png");
+    loadMs[0] += since(start);
+    start = std::chrono::steady_clock::now();
+    image.writeToFile(scratch);
+    saveMs[0] += since(start);
+
+    start = std::chrono::steady_clock::now();
+    packed.readFromFile("rosegarden.png");
+    loadMs[1] += since(start);
+    start = std::chrono::steady_clock::now();
+    packed.writeToFile(scratch);
+    saveMs[1] += since(start);
+  }
+
+  // the round trip through HSL must give back the bytes of the file
+  bool same = PackedPNG(image) == packed;
+
+  for (int i = 0; i < repeats; i++) {
+    Time start = std::chrono::steady_clock::now();
+    gray(image);
+    grayMs[0] += since(start);
+    start = std::chrono::steady_clock::now();
+    packed.filterTiles(tileSize, [](PNG & tile, unsigned, unsigned) { gray(tile); });
+    grayMs[1] += since(start);
+  }
+  same = same && PackedPNG(image) == packed;
+  std::remove(scratch);
+
+  std::cout << std::fixed << std::setprecision(2);
+  std::cout << image.width() << "x" << image.height() << ", " << repeats << " repeats, "
+            << tileSize << "px tiles" << std::endl;
+  std::cout << std::setw(10) << "image" << std::setw(10) << "load ms" << std::setw(10) << "save ms"
+            << std::setw(10) << "gray ms" << std::setw(12) << "pixels KB" << std::endl;
+  report("PNG", loadMs[0] / repeats, saveMs[0] / repeats, grayMs[0] / repeats,
+         image.width() * image.height() * sizeof(HSLAPixel));
+  report("PackedPNG", loadMs[1] / repeats, saveMs[1] / repeats, grayMs[1] / repeats,
+         packed.width() * packed.height() * 4);
+  std::cout << "same bytes: " << (same ? "yes" : "NO") << std::endl;
+  return 0;
+}
@@ -0,0 +1,324 @@
+/**
+ * @file HSLConvert.cpp
+ * Implementation of the row conversions between RGBA bytes and HSLAPixels.
+ *
+ * Each block of pixels is unpacked into one array per channel, converted
+ * lane by lane with selects in place of branches, and packed again, which
+ * is the shape the compiler's vectorizer needs; both RGB-to-HSL
+ * conversions also have a hand-written SSE2 version, since the vectorizer
+ * leaves the selects, and the table lookups, alone at -O2. The formulas are those of
+ * RGB_HSL.h, rearranged to work on the bytes: in rgb2hsl every channel is
+ * divided by 255 first, which cancels out of the hue and the saturation,
+ * so both are one division of two small integers here, and rounded once.
+ *
+ * @author CS 221: Data Structures
+ */
+
+#include <cmath>
+#include "HSLConvert.h"
+#include "RGB_HSL.h"
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+namespace cs221util {
+  static const unsigned LANES = 8;    /*< pixels converted per block */
+
+  /**
+   * The bytes scaled to [0, 1], as rgb2hsl scales them, for rgbaToHSLTable.
+   */
+  struct HSLTable {
+    double unit[256];
+
+    HSLTable() {
+      for (int i = 0; i < 256; i++) {
+        unit[i] = i / 255.0;
+      }
+    }
+  };
+
+  /**
+   * Converts one block of pixels, each channel in its own array, in lanes
+   * of type T. In table mode the channels are scaled by table lookups and
+   * then go through rgb2hsl's own operations, in its order, so the result
+   * is rgb2hsl's to the last bit.
+   */
+  template <typename T, bool table>
+  static void _toHSLBlock(T const * R, T const * G, T const * B, T const * A,
+                          T * H, T * S, T * L, T * Alpha, unsigned n) {
+    static HSLTable const scale;
+    for (unsigned k = 0; k < n; k++) {
+      T r = R[k], g = G[k], b = B[k];
+      T max = r > g ? r : g;
+      max = max > b ? max : b;
+      T min = r < g ? r : g;
+      min = min < b ? min : b;
+      T chroma = max - min;
+
+      // rgb2hsl's gray test (chroma or max below 0.0001) only passes for
+      // chroma 0, since the bytes differ by at least 1/255 otherwise
+      bool gray = chroma == 0;
+
+      if (table) {
+        T ur = scale.unit[(int) r], ug = scale.unit[(int) g], ub = scale.unit[(int) b];
+        T umax = scale.unit[(int) max], umin = scale.unit[(int) min];
+        T uchroma = gray ? (T) 1 : umax - umin;
+        T l = 0.5 * (umax + umin);
+        // rgb2hsl takes the first of these mod 6, which changes nothing,
+        // since it lies in [-1, 1]
+        T h = max == r ? (ug - ub) / uchroma : (max == g ? ((ub - ur) / uchroma) + 2 : ((ur - ug) / uchroma) + 4);
+        h *= 60;
+        T below = gray ? (T) 1 : 1 - std::fabs((2 * l) - 1);
+        S[k] = gray ? (T) 0 : uchroma / below;
+        H[k] = gray ? (T) 0 : (h < 0 ? h + 360 : h);
+        L[k] = l;
+        Alpha[k] = scale.unit[(int) A[k]];
+      }
+      else {
+        T sum = max + min;
+        T sat = (T) 255 - std::fabs(sum - (T) 255);
+        T hue = max == r ? g - b : (max == g ? b - r : r - g);
+        T shift = max == r ? (hue < 0 ? (T) 6 : (T) 0) : (max == g ? (T) 2 : (T) 4);
+        T safeChroma = gray ? (T) 1 : chroma;
+        T safeSat = gray ? (T) 1 : sat;
+        S[k] = gray ? (T) 0 : chroma / safeSat;
+        H[k] = gray ? (T) 0 : (hue / safeChroma + shift) * (T) 60;
+        L[k] = sum / (T) 510;
+        Alpha[k] = A[k] / (T) 255;
+      }
+    }
+  }
+
+  /**
+   * Converts a row of RGBA bytes to HSLAPixels, a block of lanes of type T
+   * at a time.
+   */
+  template <typename T, bool table>
+  static void _toHSL(unsigned char const * rgba, HSLAPixel * pixels, unsigned count) {
+    unsigned blocked = count - count % LANES;
+    for (unsigned i = 0; i < blocked; i += LANES) {
+      T R[LANES], G[LANES], B[LANES], A[LANES];
+      T H[LANES], S[LANES], L[LANES], Alpha[LANES];
+      unsigned char const *bytes = rgba + i * 4;
+      for (unsigned k = 0; k < LANES; k++) {
+        R[k] = bytes[k * 4];
+        G[k] = bytes[k * 4 + 1];
+        B[k] = bytes[k * 4 + 2];
+        A[k] = bytes[k * 4 + 3];
+      }
+
+      _toHSLBlock<T, table>(R, G, B, A, H, S, L, Alpha, LANES);
+
+      for (unsigned k = 0; k < LANES; k++) {
+        HSLAPixel & pixel = pixels[i + k];
+        pixel.h = H[k];
+        pixel.s = S[k];
+        pixel.l = L[k];
+        pixel.a = Alpha[k];
+      }
+    }
+
+    for (unsigned i = blocked; i < count; i++) {
+      rgbaColor rgb;
+      rgb.r = rgba[i * 4];
+      rgb.g = rgba[i * 4 + 1];
+      rgb.b = rgba[i * 4 + 2];
+      rgb.a = rgba[i * 4 + 3];
+
+      hslaColor hsl = rgb2hsl(rgb);
+      pixels[i] = HSLAPixel(hsl.h, hsl.s, hsl.l, hsl.a);
+    }
+  }
+
+#ifdef __SSE2__
+  /**
+   * Picks from yes where mask is set and from no elsewhere.
+   */
+  static inline __m128 _select(__m128 mask, __m128 yes, __m128 no) {
+    return _mm_or_ps(_mm_and_ps(mask, yes), _mm_andnot_ps(mask, no));
+  }
+
+  /**
+   * Converts four pixels in SSE2 float lanes, as _toHSLBlock<float> does:
+   * a pixel's four bytes are one 32-bit lane, so the channels are split
+   * off with shifts and masks.
+   */
+  static void _toHSLQuad(unsigned char const * rgba, HSLAPixel * pixels) {
+    __m128i bytes = _mm_loadu_si128((__m128i const *) rgba);
+    __m128i low = _mm_set1_epi32(0xff);
+    __m128 r = _mm_cvtepi32_ps(_mm_and_si128(bytes, low));
+    __m128 g = _mm_cvtepi32_ps(_mm_and_si128(_mm_srli_epi32(bytes, 8), low));
+    __m128 b = _mm_cvtepi32_ps(_mm_and_si128(_mm_srli_epi32(bytes, 16), low));
+    __m128 a = _mm_cvtepi32_ps(_mm_srli_epi32(bytes, 24));
+
+    __m128 zero = _mm_setzero_ps();
+    __m128 one = _mm_set1_ps(1);
+    __m128 full = _mm_set1_ps(255);
+    __m128 max = _mm_max_ps(_mm_max_ps(r, g), b);
+    __m128 min = _mm_min_ps(_mm_min_ps(r, g), b);
+    __m128 chroma = _mm_sub_ps(max, min);
+    __m128 sum = _mm_add_ps(max, min);
+
+    __m128 gray = _mm_cmpeq_ps(chroma, zero);
+    __m128 distance = _mm_sub_ps(sum, full);
+    distance = _mm_max_ps(distance, _mm_sub_ps(zero, distance));
+    __m128 sat = _mm_sub_ps(full, distance);
+    __m128 isR = _mm_cmpeq_ps(max, r);
+    __m128 isG = _mm_cmpeq_ps(max, g);
+    __m128 hue = _select(isR, _mm_sub_ps(g, b), _select(isG, _mm_sub_ps(b, r), _mm_sub_ps(r, g)));
+    __m128 wrap = _mm_and_ps(_mm_cmplt_ps(hue, zero), _mm_set1_ps(6));
+    __m128 shift = _select(isR, wrap, _select(isG, _mm_set1_ps(2), _mm_set1_ps(4)));
+
+    __m128 h = _mm_div_ps(hue, _select(gray, one, chroma));
+    h = _mm_andnot_ps(gray, _mm_mul_ps(_mm_add_ps(h, shift), _mm_set1_ps(60)));
+    __m128 s = _mm_andnot_ps(gray, _mm_div_ps(chroma, _select(gray, one, sat)));
+    __m128 l = _mm_div_ps(sum, _mm_set1_ps(510));
+    a = _mm_div_ps(a, full);
+
+    // widen to doubles, two pixels at a time, and interleave into pixels
+    __m128d hd[2] = {_mm_cvtps_pd(h), _mm_cvtps_pd(_mm_movehl_ps(h, h))};
+    __m128d sd[2] = {_mm_cvtps_pd(s), _mm_cvtps_pd(_mm_movehl_ps(s, s))};
+    __m128d ld[2] = {_mm_cvtps_pd(l), _mm_cvtps_pd(_mm_movehl_ps(l, l))};
+    __m128d ad[2] = {_mm_cvtps_pd(a), _mm_cvtps_pd(_mm_movehl_ps(a, a))};
+    for (int half = 0; half < 2; half++) {
+      double *first = &pixels[half * 2].h;
+      double *second = &pixels[half * 2 + 1].h;
+      _mm_storeu_pd(first, _mm_unpacklo_pd(hd[half], sd[half]));
+      _mm_storeu_pd(first + 2, _mm_unpacklo_pd(ld[half], ad[half]));
+      _mm_storeu_pd(second, _mm_unpackhi_pd(hd[half], sd[half]));
+      _mm_storeu_pd(second + 2, _mm_unpackhi_pd(ld[half], ad[half]));
+    }
+  }
+
+  /**
+   * Converts two pixels in SSE2 double lanes, as _toHSLBlock<double, true>
+   * does: the scaled channels are looked up, and from there every lane
+   * goes through rgb2hsl's operations in its order, with the hue's
+   * numerator and offset selected before its one division.
+   */
+  static void _toHSLPair(unsigned char const * rgba, HSLAPixel * pixels) {
+    static HSLTable const scale;
+    __m128d r = _mm_set_pd(scale.unit[rgba[4]], scale.unit[rgba[0]]);
+    __m128d g = _mm_set_pd(scale.unit[rgba[5]], scale.unit[rgba[1]]);
+    __m128d b = _mm_set_pd(scale.unit[rgba[6]], scale.unit[rgba[2]]);
+    __m128d a = _mm_set_pd(scale.unit[rgba[7]], scale.unit[rgba[3]]);
+
+    __m128d zero = _mm_setzero_pd();
+    __m128d one = _mm_set1_pd(1);
+    __m128d sign = _mm_set1_pd(-0.0);
+    __m128d max = _mm_max_pd(_mm_max_pd(r, g), b);
+    __m128d min = _mm_min_pd(_mm_min_pd(r, g), b);
+    __m128d chroma = _mm_sub_pd(max, min);
+    __m128d l = _mm_mul_pd(_mm_set1_pd(0.5), _mm_add_pd(max, min));
+
+    __m128d gray = _mm_cmpeq_pd(chroma, zero);
+    __m128d safeChroma = _mm_or_pd(_mm_and_pd(gray, one), _mm_andnot_pd(gray, chroma));
+    __m128d below = _mm_sub_pd(one, _mm_andnot_pd(sign, _mm_sub_pd(_mm_add_pd(l, l), one)));
+    below = _mm_or_pd(_mm_and_pd(gray, one), _mm_andnot_pd(gray, below));
+    __m128d s = _mm_andnot_pd(gray, _mm_div_pd(chroma, below));
+
+    __m128d isR = _mm_cmpeq_pd(max, r);
+    __m128d isG = _mm_andnot_pd(isR, _mm_cmpeq_pd(max, g));
+    __m128d isB = _mm_andnot_pd(_mm_or_pd(isR, isG), _mm_castsi128_pd(_mm_set1_epi32(-1)));
+    __m128d hue = _mm_or_pd(_mm_or_pd(_mm_and_pd(isR, _mm_sub_pd(g, b)),
+                                      _mm_and_pd(isG, _mm_sub_pd(b, r))),
+                            _mm_and_pd(isB, _mm_sub_pd(r, g)));
+    __m128d shift = _mm_or_pd(_mm_and_pd(isG, _mm_set1_pd(2)), _mm_and_pd(isB, _mm_set1_pd(4)));
+    // adding 0 in the red lanes stands in for rgb2hsl's fmod, and changes
+    // nothing either: the quotient is in [-1, 1] and never -0
+    __m128d h = _mm_mul_pd(_mm_add_pd(_mm_div_pd(hue, safeChroma), shift), _mm_set1_pd(60));
+    h = _mm_add_pd(h, _mm_and_pd(_mm_cmplt_pd(h, zero), _mm_set1_pd(360)));
+    h = _mm_andnot_pd(gray, h);
+
+    _mm_storeu_pd(&pixels[0].h, _mm_unpacklo_pd(h, s));
+    _mm_storeu_pd(&pixels[0].l, _mm_unpacklo_pd(l, a));
+    _mm_storeu_pd(&pixels[1].h, _mm_unpackhi_pd(h, s));
+    _mm_storeu_pd(&pixels[1].l, _mm_unpackhi_pd(l, a));
+  }
+#endif
+
+  void rgbaToHSL(unsigned char const * rgba, HSLAPixel * pixels, unsigned int count) {
+    unsigned done = 0;
+#ifdef __SSE2__
+    static_assert(sizeof(HSLAPixel) == 4 * sizeof(double), "HSLAPixel must be h, s, l, a and nothing else");
+    for (; done + 4 <= count; done += 4) {
+      _toHSLQuad(rgba + done * 4, pixels + done);
+    }
+#endif
+    _toHSL<float, false>(rgba + done * 4, pixels + done, count - done);
+  }
+
+  void rgbaToHSLTable(unsigned char const * rgba, HSLAPixel * pixels, unsigned int count) {
+    unsigned done = 0;
+#ifdef __SSE2__
+    for (; done + 2 <= count; done += 2) {
+      _toHSLPair(rgba + done * 4, pixels + done);
+    }
+#endif
+    _toHSL<double, true>(rgba + done * 4, pixels + done, count - done);
+  }
+
+  /**
+   * Rounds half away from zero, as round() does, to an int. Unlike
+   * round(), this vectorizes: the truncation is a conversion, and the
+   * fraction it drops is exact.
+   */
+  static inline int _round(double value) {
+    int whole = (int) value;
+    double fraction = value - whole;
+    return whole + (fraction >= 0.5) - (fraction <= -0.5);
+  }
+
+  void hslToRGBA(HSLAPixel const * pixels, unsigned char * rgba, unsigned int count) {
+    unsigned blocked = count - count % LANES;
+    for (unsigned i = 0; i < blocked; i += LANES) {
+      int R[LANES], G[LANES], B[LANES], A[LANES];
+
+      for (unsigned k = 0; k < LANES; k++) {
+        HSLAPixel const & pixel = pixels[i + k];
+        double l = pixel.l, s = pixel.s;
+
+        double c = (1 - std::fabs((2 * l) - 1)) * s;
+        double hh = pixel.h / 60;
+        // fmod(hh, 2), exactly: the multiple of 2 taken off is exact, and
+        // so is the difference, since it is below 2
+        double wrapped = hh - 2 * std::trunc(hh * 0.5);
+        double x = c * (1 - std::fabs(wrapped - 1));
+
+        double r = hh <= 1 ? c : (hh <= 2 ? x : (hh <= 4 ? 0 : (hh <= 5 ? x : c)));
+        double g = hh <= 1 ? x : (hh <= 3 ? c : (hh <= 4 ? x : 0));
+        double b = hh <= 2 ? 0 : (hh <= 3 ? x : (hh <= 5 ? c : x));
+        double m = l - (0.5 * c);
+
+        bool gray = s <= 0.001;
+        R[k] = _round(gray ? l * 255 : (r + m) * 255);
+        G[k] = _round(gray ? l * 255 : (g + m) * 255);
+        B[k] = _round(gray ? l * 255 : (b + m) * 255);
+        A[k] = _round(pixel.a * 255);
+      }
+
+      unsigned char *bytes = rgba + i * 4;
+      for (unsigned k = 0; k < LANES; k++) {
+        bytes[k * 4] = R[k];
+        bytes[k * 4 + 1] = G[k];
+        bytes[k * 4 + 2] = B[k];
+        bytes[k * 4 + 3] = A[k];
+      }
+    }
+
+    for (unsigned i = blocked; i < count; i++) {
+      hslaColor hsl;
+      hsl.h = pixels[i].h;
+      hsl.s = pixels[i].s;
+      hsl.l = pixels[i].l;
+      hsl.a = pixels[i].a;
+
+      rgbaColor rgb = hsl2rgb(hsl);
+      rgba[i * 4] = rgb.r;
+      rgba[i * 4 + 1] = rgb.g;
+      rgba[i * 4 + 2] = rgb.b;
+      rgba[i * 4 + 3] = rgb.a;
+    }
+  }
+}
@@ -0,0 +1,70 @@
+/**
+ * @file HSLConvert.h
+ * Conversion of whole rows of pixels between RGBA bytes and HSLAPixels.
+ *
+ * rgb2hsl and hsl2rgb (RGB_HSL.h) convert one pixel at a time in double
+ * precision, branching on which channel is largest. The functions here
+ * convert a row at a time: pixels are taken in blocks of a few lanes, and
+ * each lane goes through the same branch-free arithmetic, with selects in
+ * place of the branches. rgbaToHSL runs four pixels at a time in SSE2
+ * float lanes where the compiler targets SSE2 (any x86-64), and leaves the
+ * rest to the compiler's vectorizer. Rows need not be a multiple of the
+ * block; the last few pixels are converted one at a time.
+ *
+ * Tolerance, against rgb2hsl and hsl2rgb:
+ *  - rgbaToHSL works in float lanes. Over every 8-bit RGB colour, h is
+ *    within 1e-4 degrees and s, l and a within 1e-7 of rgb2hsl; whether a
+ *    colour counts as gray (h = s = 0) is decided exactly as rgb2hsl does.
+ *    Filters that compare against thresholds, or that gray a pixel so its
+ *    l * 255 lands on a rounding tie, can come out differently than with
+ *    rgb2hsl, so this is for code that does not need PNG's exact pixels.
+ *  - rgbaToHSLTable works in double lanes, two pixels at a time in SSE2,
+ *    looking the scaled channels up in a table and then doing rgb2hsl's
+ *    own operations in its order; it gives exactly rgb2hsl's values, at
+ *    about a third of its cost. PNG and PackedPNG convert with it, so
+ *    filters see the same pixels they always did.
+ *  - hslToRGBA works in double lanes and gives the same bytes as hsl2rgb,
+ *    for any pixel whose h, s, l and a are finite and within int range
+ *    once scaled.
+ * Either RGB-to-HSL conversion followed by hslToRGBA gives back the
+ * original bytes for every 8-bit colour.
+ *
+ * @author CS 221: Data Structures
+ */
+
+#ifndef CS221UTIL_HSLCONVERT_H
+#define CS221UTIL_HSLCONVERT_H
+
+#include "HSLAPixel.h"
+
+namespace cs221util {
+  /**
+    * Converts a row of RGBA bytes to HSLAPixels, in float lanes. This is
+    * the fastest of the conversions.
+    * @param rgba The red, green, blue and alpha bytes of each pixel in turn.
+    * @param pixels Where to write the converted pixels.
+    * @param count The number of pixels.
+    */
+  void rgbaToHSL(unsigned char const * rgba, HSLAPixel * pixels, unsigned int count);
+
+  /**
+    * Converts a row of RGBA bytes to HSLAPixels, in double lanes, scaling
+    * the channels by lookups in a table built on first use (2 KB). A little
+    * slower than rgbaToHSL, but exact.
+    * @param rgba The red, green, blue and alpha bytes of each pixel in turn.
+    * @param pixels Where to write the converted pixels.
+    * @param count The number of pixels.
+    */
+  void rgbaToHSLTable(unsigned char const * rgba, HSLAPixel * pixels, unsigned int count);
+
+  /**
+    * Converts a row of HSLAPixels to RGBA bytes, in double lanes.
+    * @param pixels The pixels to convert.
+    * @param rgba Where to write the red, green, blue and alpha bytes of
+    *  each pixel in turn.
+    * @param count The number of pixels.
+    */
+  void hslToRGBA(HSLAPixel const * pixels, unsigned char * rgba, unsigned int count);
+}
+
+#endif
@@ -5,24 +5,78 @@
  * @author CS 221: Data Structures
  */
 
+#include <cassert>
+#include <cstring>
 #include <iostream>
 #include <string>
 #include <algorithm>
 #include "lodepng/lodepng.h"
 #include "PNG.h"
-#include "RGB_HSL.h"
+#include "HSLConvert.h"
 
 namespace cs221util {
+  static const uint64_t PRIME1 = 0x9e3779b185ebca87ULL;
+  static const uint64_t PRIME2 = 0xc2b2ae3d27d4eb4fULL;
+
+  /**
+   * Scrambles the bits of a 64-bit value (the splitmix64 finalizer).
+   */
+  static inline uint64_t _mix(uint64_t value) {
+    value ^= value >> 30;
+    value *= 0xbf58476d1ce4e5b9ULL;
+    value ^= value >> 27;
+    value *= 0x94d049bb133111ebULL;
+    return value ^ (value >> 31);
+  }
+
+  static inline uint64_t _rotate(uint64_t value, int bits) {
+    return (value << bits) | (value >> (64 - bits));
+  }
+
+  /**
+   * Hashes the bits of a row of pixels. Each channel has its own
+   * accumulator, as the lanes of xxHash64 do, so the four multiplies of a
+   * pixel do not wait on each other.
+   */
+  static uint64_t _hashRow(HSLAPixel const * row, unsigned width) {
+    uint64_t lanes[4] = {PRIME1 + PRIME2, PRIME2, 0, 0 - PRIME1};
+    for (unsigned x = 0; x < width; x++) {
+      uint64_t words[4];
+      memcpy(words, row + x, sizeof(words));
+      for (int c = 0; c < 4; c++) {
+        lanes[c] = _rotate(lanes[c] + words[c] * PRIME2, 31) * PRIME1;
+      }
+    }
+    return _mix(_rotate(lanes[0], 1) + _rotate(lanes[1], 7) + _rotate(lanes[2], 12)
+                + _rotate(lanes[3], 18) + width);
+  }
+
+  void PNG::_changed(unsigned int y) {
+    if (y < rowHashes_.size()) { rowChanged_[y].store(1, std::memory_order_relaxed); }
+  }
+
+  void PNG::_changedAll() {
+    rowHashes_.clear();
+    rowChanged_.reset();
+  }
+
   void PNG::_copy(PNG const & other) {
-    // Clear self
-    delete[] imageData_;
+    // Reuse our own pixels if they are the right size; otherwise clear self
+    if (imageData_ == NULL || width_ * height_ != other.width_ * other.height_) {
+      delete[] imageData_;
+      imageData_ = new HSLAPixel[other.width_ * other.height_];
+    }
     
     // Copy `other` to self
     width_ = other.width_;
     height_ = other.height_;
-    imageData_ = new HSLAPixel[width_ * height_];
-    for (unsigned i = 0; i < width_ * height_; i++) {
-      imageData_[i] = other.imageData_[i];
+    std::copy(other.imageData_, other.imageData_ + width_ * height_, imageData_);
+
+    // The pixels are the same, so the hashes are too
+    rowHashes_ = other.rowHashes_;
+    rowChanged_.reset(rowHashes_.empty() ? NULL : new atomic<unsigned char>[height_]);
+    for (unsigned y = 0; y < rowHashes_.size(); y++) {
+      rowChanged_[y].store(other.rowChanged_[y].load(std::memory_order_relaxed), std::memory_order_relaxed);
     }
   }
 
@@ -43,6 +97,13 @@ namespace cs221util {
     _copy(other);
   }
 
+  PNG::PNG(PNG && other) noexcept {
+    width_ = 0;
+    height_ = 0;
+    imageData_ = NULL;
+    swap(other);
+  }
+
   PNG::~PNG() {
     delete[] imageData_;
   }
@@ -52,14 +113,57 @@ namespace cs221util {
     return *this;
   }
 
+  PNG const & PNG::operator=(PNG && other) noexcept {
+    if (this != &other) {
+      PNG empty;
+      swap(empty);
+      swap(other);
+    }
+    return *this;
+  }
+
+  void PNG::swap(PNG & other) noexcept {
+    std::swap(width_, other.width_);
+    std::swap(height_, other.height_);
+    std::swap(imageData_, other.imageData_);
+    rowHashes_.swap(other.rowHashes_);
+    rowChanged_.swap(other.rowChanged_);
+  }
+
+  void swap(PNG & first, PNG & second) noexcept {
+    first.swap(second);
+  }
+
   bool PNG::operator== (PNG const & other) const {
-    return (imageData_ == other.imageData_);
+    if (width_ != other.width_ || height_ != other.height_) { return false; }
+    if (imageData_ == other.imageData_ || width_ * height_ == 0) { return true; }
+    return memcmp(imageData_, other.imageData_, width_ * height_ * sizeof(HSLAPixel)) == 0;
   }
 
   bool PNG::operator!= (PNG const & other) const {
     return !(*this == other);
   }
 
+  uint64_t PNG::hash() const {
+    if (rowHashes_.size() != height_) {
+      rowHashes_.assign(height_, 0);
+      rowChanged_.reset(new atomic<unsigned char>[height_]);
+      for (unsigned y = 0; y < height_; y++) {
+        rowChanged_[y].store(1, std::memory_order_relaxed);
+      }
+    }
+
+    uint64_t hash = _mix(((uint64_t) width_ << 32) + height_);
+    for (unsigned y = 0; y < height_; y++) {
+      if (rowChanged_[y].load(std::memory_order_relaxed)) {
+        rowHashes_[y] = _hashRow(getRow(y), width_);
+        rowChanged_[y].store(0, std::memory_order_relaxed);
+      }
+      hash = _mix(hash ^ rowHashes_[y]);
+    }
+    return hash;
+  }
+
   HSLAPixel * PNG::getPixel(unsigned int x, unsigned int y) {
     if (width_ == 0 || height_ == 0) {
       cerr << "ERROR: Call to cs221util::PNG::getPixel() made on an image with no pixels." << endl;
@@ -81,10 +185,31 @@ namespace cs221util {
       y = height_ - 1;
     }
     
+    _changed(y);
     unsigned index = x + (y * width_);
     return imageData_ + index;
   }
 
+  HSLAPixel * PNG::getRow(unsigned int y) {
+    assert(y < height_);
+    _changed(y);
+    return imageData_ + y * width_;
+  }
+
+  HSLAPixel const * PNG::getRow(unsigned int y) const {
+    assert(y < height_);
+    return imageData_ + y * width_;
+  }
+
+  HSLAPixel * PNG::getData() {
+    _changedAll();
+    return imageData_;
+  }
+
+  HSLAPixel const * PNG::getData() const {
+    return imageData_;
+  }
+
   bool PNG::readFromFile(string const & fileName) {
     vector<unsigned char> byteData;
     unsigned error = lodepng::decode(byteData, width_, height_, fileName);
@@ -97,43 +222,24 @@ namespace cs221util {
     delete[] imageData_;
     imageData_ = new HSLAPixel[width_ * height_];
 
-    for (unsigned i = 0; i < byteData.size(); i += 4) {
-      rgbaColor rgb;
-      rgb.r = byteData[i];
-      rgb.g = byteData[i + 1];
-      rgb.b = byteData[i + 2];
-      rgb.a = byteData[i + 3];
-
-      hslaColor hsl = rgb2hsl(rgb);
-      HSLAPixel & pixel = imageData_[i/4];
-      pixel.h = hsl.h;
-      pixel.s = hsl.s;
-      pixel.l = hsl.l;
-      pixel.a = hsl.a;
-    }
+    rgbaToHSLTable(byteData.data(), imageData_, width_ * height_);
+    _changedAll();
 
     return true;
   }
 
-  bool PNG::writeToFile(string const & fileName) {
+  bool PNG::writeToFile(string const & fileName, unsigned int threads) {
     unsigned char *byteData = new unsigned char[width_ * height_ * 4];
 
-    for (unsigned i = 0; i < width_ * height_; i++) {
-      hslaColor hsl;
-      hsl.h = imageData_[i].h;
-      hsl.s = imageData_[i].s;
-      hsl.l = imageData_[i].l;
-      hsl.a = imageData_[i].a;
-
-      rgbaColor rgb = hsl2rgb(hsl);
+    hslToRGBA(imageData_, byteData, width_ * height_);
 
-      byteData[(i * 4)]     = rgb.r;
-      byteData[(i * 4) + 1] = rgb.g;
-      byteData[(i * 4) + 2] = rgb.b;
-      byteData[(i * 4) + 3] = rgb.a;
+    lodepng::State state;
+    state.encoder.zlibsettings.threads = threads;
+    std::vector<unsigned char> file;
+    unsigned error = lodepng::encode(file, byteData, width_, height_, state);
+    if (!error) {
+      error = lodepng::save_file(file, fileName);
     }
-
-    unsigned error = lodepng::encode(fileName, byteData, width_, height_);
     if (error) {
       cerr << "PNG encoding error " << error << ": " << lodepng_error_text(error) << endl;
     }
@@ -151,19 +257,21 @@ namespace cs221util {
   } 
 
   void PNG::resize(unsigned int newWidth, unsigned int newHeight) {
+    // Nothing moves if the size does not change
+    if (newWidth == width_ && newHeight == height_) {
+      return;
+    }
+
     // Create a new vector to store the image data for the new (resized) image
     HSLAPixel * newImageData = new HSLAPixel[newWidth * newHeight];
 
     // Copy the current data to the new image data, using the existing pixel
-    // for coordinates within the bounds of the old image size
-    for (unsigned x = 0; x < newWidth; x++) {
-      for (unsigned y = 0; y < newHeight; y++) {
-        if (x < width_ && y < height_) {
-          HSLAPixel *oldPixel = this->getPixel(x, y);
-          HSLAPixel & newPixel = newImageData[ (x + (y * newWidth)) ];
-          newPixel = *oldPixel;
-        }
-      }
+    // for coordinates within the bounds of the old image size, a row at a time
+    unsigned copyWidth = std::min(width_, newWidth);
+    unsigned copyHeight = std::min(height_, newHeight);
+    for (unsigned y = 0; y < copyHeight; y++) {
+      HSLAPixel const *oldRow = getRow(y);
+      std::copy(oldRow, oldRow + copyWidth, newImageData + y * newWidth);
     }
 
     // Clear the existing image
@@ -173,5 +281,6 @@ namespace cs221util {
     width_ = newWidth;
     height_ = newHeight;
     imageData_ = newImageData;
+    _changedAll();
   }
 }
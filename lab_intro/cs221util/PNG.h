@@ -7,6 +7,11 @@
 #ifndef CS221UTIL_PNG_H
 #define CS221UTIL_PNG_H
 
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
 #include <string>
 #include <vector>
 #include "HSLAPixel.h"
@@ -35,6 +40,14 @@ namespace cs221util {
       */
     PNG(PNG const & other);
 
+    /**
+      * Move constructor: creates a new PNG image that takes over the
+      * pixels of another, without copying them. The other image is left
+      * empty.
+      * @param other PNG to be moved from.
+      */
+    PNG(PNG && other) noexcept;
+
     /**
       * Destructor: frees all memory associated with a given PNG object.
       * Invoked by the system.
@@ -49,7 +62,26 @@ namespace cs221util {
     PNG const & operator= (PNG const & other);
 
     /**
-      * Equality operator: checks if two images are the same.
+      * Move assignment operator: frees the current image's pixels and takes
+      * over those of another, without copying them. The other image is
+      * left empty.
+      * @param other Image to move into the current image.
+      * @return The current image for assignment chaining.
+      */
+    PNG const & operator= (PNG && other) noexcept;
+
+    /**
+      * Exchanges the contents of two images, without copying any pixels.
+      * @param other Image to swap with.
+      */
+    void swap(PNG & other) noexcept;
+
+    /**
+      * Equality operator: checks if two images are the same: the same size,
+      * and the same bits in every pixel (so a channel of 0.0 differs from
+      * one of -0.0). The pixels are compared as bytes, stopping at the
+      * first difference. Cached hashes are not used, since a change made
+      * through an old pointer can leave them stale.
       * @param other Image to be checked.
       * @return Whether the current image is equal to the other image.
       */
@@ -62,6 +94,21 @@ namespace cs221util {
       */
     bool operator!= (PNG const & other) const;
 
+    /**
+      * Gets a 64-bit hash of the image's size and pixels; equal images have
+      * equal hashes. The hash of each row is cached until the row may have
+      * changed: getPixel and getRow hand out pointers that can change their
+      * row, and getData, resize, readFromFile and assignment can change any
+      * row. Only those rows are hashed again, so after a filter changes a
+      * few rows, the next call costs little more than those rows. Changes
+      * made through a pointer obtained before the hash was last computed
+      * are not seen; get the pointer again before changing the image.
+      * Calling hash on the same image from several threads at once, or
+      * while other threads change it, is not safe.
+      * @return The hash of the image.
+      */
+    uint64_t hash() const;
+
 
     /**
       * Reads in a PNG image from a file.
@@ -74,9 +121,12 @@ namespace cs221util {
     /**
       * Writes a PNG image to a file.
       * @param fileName Name of the file to be written.
+      * @param threads Number of threads to deflate the image data on; see
+      *  threads in the lodepng manual. With more than 1 the file is a few
+      *  bytes larger, and holds the same pixels.
       * @return true, if the image was successfully written.
       */
-    bool writeToFile(string const & fileName);
+    bool writeToFile(string const & fileName, unsigned int threads = 1);
 
     /**
       * Pixel access operator. Gets a pointer to the pixel at the given
@@ -88,6 +138,41 @@ namespace cs221util {
       */
     HSLAPixel * getPixel(unsigned int x, unsigned int y);
 
+    /**
+      * Unchecked row access. Gets a pointer to the first pixel of row y;
+      * the row's width() pixels follow it in memory, and each row directly
+      * follows the one above, so filters can walk the image with plain
+      * pointer arithmetic. Unlike getPixel, y is not truncated and no
+      * warning is printed: y must be below height(). In builds without
+      * NDEBUG, a y out of range fails an assertion. Like getPixel, this
+      * marks the row's cached hash stale; threads may call it on the same
+      * image at once.
+      * @param y Y-coordinate of the row.
+      * @return A pointer to pixel (0, y).
+      */
+    HSLAPixel * getRow(unsigned int y);
+
+    /**
+      * Const version of getRow. Does not allow the image to be changed
+      * through the pointer.
+      * @param y Y-coordinate of the row.
+      * @return A pointer to pixel (0, y).
+      */
+    HSLAPixel const * getRow(unsigned int y) const;
+
+    /**
+      * Gets the whole pixel buffer: width() * height() pixels, row by row
+      * from the top, as getRow(0) would.
+      * @return A pointer to pixel (0, 0), or NULL for an empty image.
+      */
+    HSLAPixel * getData();
+
+    /**
+      * Const version of getData.
+      * @return A pointer to pixel (0, 0), or NULL for an empty image.
+      */
+    HSLAPixel const * getData() const;
+
     /**
       * Gets the width of this image.
       * @return Width of the image.
@@ -113,12 +198,47 @@ namespace cs221util {
     unsigned int width_;            /*< Width of the image */
     unsigned int height_;           /*< Height of the image */
     HSLAPixel *imageData_;          /*< Array of pixels */
+    mutable vector<uint64_t> rowHashes_;    /*< Cached hash of each row, or empty */
+    mutable unique_ptr<atomic<unsigned char>[]> rowChanged_;  /*< Whether each row's hash is stale */
+
+    /**
+     * Marks the hash of row y as stale. Each row has its own byte, so
+     * threads marking different rows do not touch the same memory, as
+     * they would in the words of a vector<bool>.
+     */
+    void _changed(unsigned int y);
+
+    /**
+     * Marks the hash of every row as stale.
+     */
+    void _changedAll();
 
     /**
      * Copeies the contents of `other` to self
      */
      void _copy(PNG const & other);
   };
+
+  /**
+    * Exchanges the contents of two images, without copying any pixels, so
+    * that std::swap and unqualified swap calls find PNG::swap.
+    * @param first One image.
+    * @param second The other image.
+    */
+  void swap(PNG & first, PNG & second) noexcept;
+}
+
+namespace std {
+  /**
+    * Hashes PNGs with PNG::hash, so they can be keys of unordered
+    * containers.
+    */
+  template <>
+  struct hash<cs221util::PNG> {
+    size_t operator()(cs221util::PNG const & image) const {
+      return image.hash();
+    }
+  };
 }
 
 #endif
@@ -0,0 +1,187 @@
+/**
+ * @file PackedPNG.cpp
+ * Implementation of a PNG class that keeps pixels as RGBA bytes, using the
+ * lodepng PNG library.
+ *
+ * @author CS 221: Data Structures
+ */
+
+#include <algorithm>
+#include <cassert>
+#include <iostream>
+#include <string>
+#include "lodepng/lodepng.h"
+#include "HSLConvert.h"
+#include "PackedPNG.h"
+
+namespace cs221util {
+  PackedPNG::PackedPNG() {
+    width_ = 0;
+    height_ = 0;
+  }
+
+  PackedPNG::PackedPNG(unsigned int width, unsigned int height) {
+    width_ = width;
+    height_ = height;
+    bytes_.assign(width * height * 4, 255);
+  }
+
+  PackedPNG::PackedPNG(PNG const & image) {
+    width_ = image.width();
+    height_ = image.height();
+    bytes_.resize(width_ * height_ * 4);
+
+    hslToRGBA(image.getData(), bytes_.data(), width_ * height_);
+  }
+
+  bool PackedPNG::operator== (PackedPNG const & other) const {
+    return width_ == other.width_ && height_ == other.height_ && bytes_ == other.bytes_;
+  }
+
+  bool PackedPNG::operator!= (PackedPNG const & other) const {
+    return !(*this == other);
+  }
+
+  bool PackedPNG::readFromFile(string const & fileName) {
+    vector<unsigned char> byteData;
+    unsigned width, height;
+    unsigned error = lodepng::decode(byteData, width, height, fileName);
+
+    if (error) {
+      cerr << "PNG decoder error " << error << ": " << lodepng_error_text(error) << endl;
+      return false;
+    }
+
+    // lodepng decodes to exactly our layout, so the buffer is kept as is
+    width_ = width;
+    height_ = height;
+    bytes_.swap(byteData);
+    return true;
+  }
+
+  bool PackedPNG::writeToFile(string const & fileName, unsigned int threads) const {
+    lodepng::State state;
+    state.encoder.zlibsettings.threads = threads;
+    std::vector<unsigned char> file;
+    unsigned error = lodepng::encode(file, bytes_, width_, height_, state);
+    if (!error) {
+      error = lodepng::save_file(file, fileName);
+    }
+    if (error) {
+      cerr << "PNG encoding error " << error << ": " << lodepng_error_text(error) << endl;
+    }
+    return (error == 0);
+  }
+
+  PNG PackedPNG::toPNG() const {
+    PNG image(width_, height_);
+    rgbaToHSLTable(bytes_.data(), image.getData(), width_ * height_);
+    return image;
+  }
+
+  long PackedPNG::_index(unsigned int x, unsigned int y, char const * caller) const {
+    if (width_ == 0 || height_ == 0) {
+      cerr << "ERROR: Call to cs221util::PackedPNG::" << caller << "() made on an image with no pixels." << endl;
+      return -1;
+    }
+
+    if (x >= width_) {
+      cerr << "WARNING: Call to cs221util::PackedPNG::" << caller << "(" << x << "," << y << ") tries to access x=" << x
+          << ", which is outside of the image (image width: " << width_ << ")." << endl;
+      cerr << "       : Truncating x to " << (width_ - 1) << endl;
+      x = width_ - 1;
+    }
+
+    if (y >= height_) {
+      cerr << "WARNING: Call to cs221util::PackedPNG::" << caller << "(" << x << "," << y << ") tries to access y=" << y
+          << ", which is outside of the image (image height: " << height_ << ")." << endl;
+      cerr << "       : Truncating y to " << (height_ - 1) << endl;
+      y = height_ - 1;
+    }
+
+    return (x + (long) y * width_) * 4;
+  }
+
+  HSLAPixel PackedPNG::getPixel(unsigned int x, unsigned int y) const {
+    HSLAPixel pixel;
+    long index = _index(x, y, "getPixel");
+    if (index < 0) {
+      cerr << "     : Returning a default pixel." << endl;
+      return pixel;
+    }
+    rgbaToHSLTable(&bytes_[index], &pixel, 1);
+    return pixel;
+  }
+
+  void PackedPNG::setPixel(unsigned int x, unsigned int y, HSLAPixel const & pixel) {
+    long index = _index(x, y, "setPixel");
+    if (index < 0) {
+      cerr << "     : Ignoring the pixel." << endl;
+      return;
+    }
+    hslToRGBA(&pixel, &bytes_[index], 1);
+  }
+
+  PNG PackedPNG::getTile(unsigned int x, unsigned int y, unsigned int width, unsigned int height) const {
+    if (x >= width_ || y >= height_) { return PNG(); }
+    width = std::min(width, width_ - x);
+    height = std::min(height, height_ - y);
+
+    PNG tile(width, height);
+    for (unsigned j = 0; j < height; j++) {
+      rgbaToHSLTable(getRow(y + j) + x * 4, tile.getRow(j), width);
+    }
+    return tile;
+  }
+
+  void PackedPNG::setTile(unsigned int x, unsigned int y, PNG const & tile) {
+    if (x >= width_ || y >= height_) { return; }
+    unsigned width = std::min(tile.width(), width_ - x);
+    unsigned height = std::min(tile.height(), height_ - y);
+
+    for (unsigned j = 0; j < height; j++) {
+      hslToRGBA(tile.getRow(j), getRow(y + j) + x * 4, width);
+    }
+  }
+
+  void PackedPNG::filterTiles(unsigned int tileSize,
+                              function<void(PNG & tile, unsigned int x, unsigned int y)> const & filter) {
+    if (tileSize == 0) { return; }
+    // one buffer for each size of tile, reused from tile to tile: full
+    // tiles, and those cut short by the right edge, the bottom edge or both
+    PNG tiles[2][2];
+    for (unsigned y = 0; y < height_; y += tileSize) {
+      unsigned height = std::min(tileSize, height_ - y);
+      for (unsigned x = 0; x < width_; x += tileSize) {
+        unsigned width = std::min(tileSize, width_ - x);
+        PNG & tile = tiles[width < tileSize][height < tileSize];
+        if (tile.width() != width || tile.height() != height) {
+          tile.resize(width, height);
+        }
+        for (unsigned j = 0; j < height; j++) {
+          rgbaToHSLTable(getRow(y + j) + x * 4, tile.getRow(j), width);
+        }
+        filter(tile, x, y);
+        setTile(x, y, tile);
+      }
+    }
+  }
+
+  unsigned char * PackedPNG::getRow(unsigned int y) {
+    assert(y < height_);
+    return bytes_.data() + (size_t) y * width_ * 4;
+  }
+
+  unsigned char const * PackedPNG::getRow(unsigned int y) const {
+    assert(y < height_);
+    return bytes_.data() + (size_t) y * width_ * 4;
+  }
+
+  unsigned int PackedPNG::width() const {
+    return width_;
+  }
+
+  unsigned int PackedPNG::height() const {
+    return height_;
+  }
+}
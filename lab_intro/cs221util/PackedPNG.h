@@ -0,0 +1,186 @@
+/**
+ * @file PackedPNG.h
+ *
+ * @author CS 221: Data Structures
+ */
+
+#ifndef CS221UTIL_PACKEDPNG_H
+#define CS221UTIL_PACKEDPNG_H
+
+#include <functional>
+#include <string>
+#include <vector>
+#include "HSLAPixel.h"
+#include "PNG.h"
+
+using namespace std;
+
+namespace cs221util {
+  /**
+    * A PNG image kept as the file stores it: four bytes per pixel, red,
+    * green, blue and alpha, row by row from the top. Where PNG holds four
+    * doubles per pixel (32 bytes) and converts every pixel to HSL on load
+    * and back on save, a PackedPNG holds 4 bytes per pixel and loads and
+    * saves without converting anything. Pixels are converted to HSL only
+    * when asked for: one at a time through getPixel/setPixel, or a tile at
+    * a time through getTile/setTile and filterTiles.
+    */
+  class PackedPNG {
+  public:
+    /**
+      * Creates an empty image.
+      */
+    PackedPNG();
+
+    /**
+      * Creates an image of the specified dimensions, every pixel opaque
+      * white, as in a new PNG.
+      * @param width Width of the new image.
+      * @param height Height of the new image.
+      */
+    PackedPNG(unsigned int width, unsigned int height);
+
+    /**
+      * Creates an image with the pixels of a PNG, converted to RGBA.
+      * @param image PNG to be converted.
+      */
+    explicit PackedPNG(PNG const & image);
+
+    /**
+      * Equality operator: checks if two images have the same size and
+      * the same bytes.
+      * @param other Image to be checked.
+      * @return Whether the current image is equal to the other image.
+      */
+    bool operator== (PackedPNG const & other) const;
+
+    /**
+      * Inequality operator: checks if two images are different.
+      * @param other Image to be checked.
+      * @return Whether the current image differs from the other image.
+      */
+    bool operator!= (PackedPNG const & other) const;
+
+    /**
+      * Reads in a PNG image from a file.
+      * Overwrites any current image content.
+      * @param fileName Name of the file to be read from.
+      * @return true, if the image was successfully read and loaded.
+      */
+    bool readFromFile(string const & fileName);
+
+    /**
+      * Writes the image to a file.
+      * @param fileName Name of the file to be written.
+      * @param threads Number of threads to deflate the image data on, as
+      *  for PNG::writeToFile.
+      * @return true, if the image was successfully written.
+      */
+    bool writeToFile(string const & fileName, unsigned int threads = 1) const;
+
+    /**
+      * Converts the whole image to a PNG of HSLAPixels.
+      * @return A PNG with the same pixels.
+      */
+    PNG toPNG() const;
+
+    /**
+      * Gets the pixel at the given coordinates, converted to HSL. (0,0) is
+      * the upper left corner. Coordinates outside the image are truncated
+      * to its edge, with a warning, as in PNG::getPixel.
+      * @param x X-coordinate of the pixel.
+      * @param y Y-coordinate of the pixel.
+      * @return A copy of the pixel; changing it does not change the image.
+      */
+    HSLAPixel getPixel(unsigned int x, unsigned int y) const;
+
+    /**
+      * Sets the pixel at the given coordinates, converted back to RGBA.
+      * Coordinates outside the image are truncated to its edge, with a
+      * warning, as in getPixel.
+      * @param x X-coordinate of the pixel.
+      * @param y Y-coordinate of the pixel.
+      * @param pixel The new colour of the pixel.
+      */
+    void setPixel(unsigned int x, unsigned int y, HSLAPixel const & pixel);
+
+    /**
+      * Gets a block of the image, converted to HSL. The block is cut to
+      * fit in the image, so the tile may be smaller than asked for.
+      * @param x X-coordinate of the block's upper left corner.
+      * @param y Y-coordinate of the block's upper left corner.
+      * @param width Width of the block.
+      * @param height Height of the block.
+      * @return A PNG with the block's pixels; empty if the corner is
+      *  outside the image.
+      */
+    PNG getTile(unsigned int x, unsigned int y, unsigned int width, unsigned int height) const;
+
+    /**
+      * Writes a tile back into the image, converted to RGBA, with its upper
+      * left corner at the given coordinates. The part of the tile that
+      * falls outside the image is ignored.
+      * @param x X-coordinate of the tile's upper left corner.
+      * @param y Y-coordinate of the tile's upper left corner.
+      * @param tile The pixels to write.
+      */
+    void setTile(unsigned int x, unsigned int y, PNG const & tile);
+
+    /**
+      * Runs an HSL filter over the image a tile at a time: each tile is
+      * converted to HSL, handed to the filter, and converted back. The
+      * tiles are converted into buffers that are reused from tile to tile,
+      * one for each size of tile (at most four, with those cut short by
+      * the edges), so no more than four tiles of HSLAPixels exist at once.
+      * The filter is handed one of these buffers, and must not keep it.
+      * @param tileSize Side length of the tiles; those along the right and
+      *  bottom edges may be smaller. If 0, the image is left as it is.
+      * @param filter Called with each tile and the coordinates of its
+      *  upper left corner in the image; changes it in place.
+      */
+    void filterTiles(unsigned int tileSize,
+                     function<void(PNG & tile, unsigned int x, unsigned int y)> const & filter);
+
+    /**
+      * Unchecked row access. Gets a pointer to the first byte of row y:
+      * 4 * width() bytes, the red, green, blue and alpha of each pixel in
+      * turn. y must be below height(); in builds without NDEBUG, a y out
+      * of range fails an assertion.
+      * @param y Y-coordinate of the row.
+      * @return A pointer to the red byte of pixel (0, y).
+      */
+    unsigned char * getRow(unsigned int y);
+
+    /**
+      * Const version of getRow.
+      * @param y Y-coordinate of the row.
+      * @return A pointer to the red byte of pixel (0, y).
+      */
+    unsigned char const * getRow(unsigned int y) const;
+
+    /**
+      * Gets the width of this image.
+      * @return Width of the image.
+      */
+    unsigned int width() const;
+
+    /**
+      * Gets the height of this image.
+      * @return Height of the image.
+      */
+    unsigned int height() const;
+
+  private:
+    unsigned int width_;            /*< Width of the image */
+    unsigned int height_;           /*< Height of the image */
+    vector<unsigned char> bytes_;   /*< RGBA bytes of each pixel, row by row */
+
+    /**
+     * Truncates coordinates to the image, warning if they were outside it.
+     * @return The index of the pixel's red byte, or -1 if the image is empty.
+     */
+    long _index(unsigned int x, unsigned int y, char const * caller) const;
+  };
+}
+
+#endif
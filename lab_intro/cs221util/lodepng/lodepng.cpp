@@ -28,6 +28,11 @@ Rename this file to lodepng.cpp to use it for C++, or to lodepng.c to use it for
 #include <stdio.h>
 #include <stdlib.h>
 
+#if defined(LODEPNG_COMPILE_ENCODER) && defined(LODEPNG_COMPILE_CPP)
+#include <atomic> /*for the threads setting of the encoder*/
+#include <thread>
+#endif /*LODEPNG_COMPILE_ENCODER && LODEPNG_COMPILE_CPP*/
+
 #if defined(_MSC_VER) && (_MSC_VER >= 1310) /*Visual Studio: A few warning types are not desired here.*/
 #pragma warning( disable : 4244 ) /*implicit conversions: not warned by gcc -Wall -Wextra and requires too much casts*/
 #pragma warning( disable : 4996 ) /*VS does not like fopen, but fopen_s is not standard C so unusable here*/
@@ -2006,14 +2011,131 @@ static unsigned deflateFixed(ucvector* out, size_t* bp, Hash* hash,
   return error;
 }
 
-static unsigned lodepng_deflatev(ucvector* out, const unsigned char* in, size_t insize,
-                                 const LodePNGCompressSettings* settings)
+/*Insert the bytes in[start..inpos-1] into the hash chains without encoding them, so
+that encodeLZ77 can refer back to them from inpos on, like a preset dictionary. This is
+the same hash chain update encodeLZ77 does for every byte it encodes.*/
+static void hash_prime(Hash* hash, const unsigned char* in, size_t start, size_t inpos, size_t insize,
+                       unsigned windowsize)
+{
+  size_t pos;
+  unsigned numzeros = 0;
+  for(pos = start; pos < inpos; ++pos)
+  {
+    unsigned hashval = getHash(in, insize, pos);
+    if(hashval == 0)
+    {
+      if(numzeros == 0) numzeros = countZeros(in, insize, pos);
+      else if(pos + numzeros > insize || in[pos + numzeros - 1] != 0) --numzeros;
+    }
+    else
+    {
+      numzeros = 0;
+    }
+    updateHashChain(hash, pos & (windowsize - 1), hashval, numzeros);
+  }
+}
+
+/*Deflate blocks first..last-1 of the input (of numdeflateblocks blocks of blocksize
+bytes) into out, starting at a byte boundary. Unless the blocks start the data, the
+window of bytes before them is primed into the hash, so they compress as if the blocks
+before them had been encoded in the same run. Unless they end the data, they are
+closed with an empty stored block, which leaves out at a byte boundary again: runs of
+blocks can so be deflated on their own and their outputs concatenated, as pigz does.*/
+static unsigned deflateBlocks(ucvector* out, const unsigned char* in, size_t insize, size_t blocksize,
+                              size_t first, size_t last, size_t numdeflateblocks,
+                              const LodePNGCompressSettings* settings)
 {
   unsigned error = 0;
-  size_t i, blocksize, numdeflateblocks;
+  size_t i;
   size_t bp = 0; /*the bit pointer*/
   Hash hash;
 
+  error = hash_init(&hash, settings->windowsize);
+  if(error) return error;
+
+  if(first > 0 && settings->use_lz77)
+  {
+    size_t start = first * blocksize;
+    size_t window = start < settings->windowsize ? start : settings->windowsize;
+    size_t end = start + blocksize;
+    if(end > insize) end = insize;
+    hash_prime(&hash, in, start - window, start, end, settings->windowsize);
+  }
+
+  for(i = first; i != last && !error; ++i)
+  {
+    unsigned final = (i == numdeflateblocks - 1);
+    size_t start = i * blocksize;
+    size_t end = start + blocksize;
+    if(end > insize) end = insize;
+
+    if(settings->btype == 1) error = deflateFixed(out, &bp, &hash, in, start, end, settings, final);
+    else if(settings->btype == 2) error = deflateDynamic(out, &bp, &hash, in, start, end, settings, final);
+  }
+
+  if(!error && last != numdeflateblocks)
+  {
+    /*empty stored block: BFINAL 0, BTYPE 00, padding to the byte boundary, LEN 0, NLEN 65535*/
+    addBitsToStream(&bp, out, 0, 3);
+    if(!ucvector_push_back(out, 0) || !ucvector_push_back(out, 0)
+       || !ucvector_push_back(out, 255) || !ucvector_push_back(out, 255)) error = 83; /*alloc fail*/
+  }
+
+  hash_cleanup(&hash);
+
+  return error;
+}
+
+#ifdef LODEPNG_COMPILE_CPP
+/*Deflate every block on its own (see deflateBlocks), with threads threads taking the
+next block until none are left, and append the outputs to out in order.*/
+static unsigned deflateBlocksThreaded(ucvector* out, const unsigned char* in, size_t insize,
+                                      size_t blocksize, size_t numdeflateblocks, unsigned threads,
+                                      const LodePNGCompressSettings* settings)
+{
+  unsigned error = 0;
+  size_t i;
+  std::vector<ucvector> parts(numdeflateblocks);
+  std::vector<unsigned> errors(numdeflateblocks, 0);
+  std::vector<std::thread> helpers;
+  std::atomic<size_t> next(0);
+
+  for(i = 0; i != numdeflateblocks; ++i) ucvector_init(&parts[i]);
+
+  auto work = [&]()
+  {
+    for(size_t block = next++; block < numdeflateblocks; block = next++)
+    {
+      errors[block] = deflateBlocks(&parts[block], in, insize, blocksize, block, block + 1,
+                                    numdeflateblocks, settings);
+    }
+  };
+
+  if(threads > numdeflateblocks) threads = (unsigned)numdeflateblocks;
+  for(i = 1; i < threads; ++i) helpers.push_back(std::thread(work));
+  work();
+  for(i = 0; i != helpers.size(); ++i) helpers[i].join();
+
+  for(i = 0; i != numdeflateblocks; ++i)
+  {
+    size_t j;
+    if(!error) error = errors[i];
+    for(j = 0; j != parts[i].size && !error; ++j)
+    {
+      if(!ucvector_push_back(out, parts[i].data[j])) error = 83; /*alloc fail*/
+    }
+    ucvector_cleanup(&parts[i]);
+  }
+
+  return error;
+}
+#endif /*LODEPNG_COMPILE_CPP*/
+
+static unsigned lodepng_deflatev(ucvector* out, const unsigned char* in, size_t insize,
+                                 const LodePNGCompressSettings* settings)
+{
+  size_t blocksize, numdeflateblocks;
+
   if(settings->btype > 2) return 61;
   else if(settings->btype == 0) return deflateNoCompression(out, in, insize);
   else if(settings->btype == 1) blocksize = insize;
@@ -2028,23 +2150,14 @@ static unsigned lodepng_deflatev(ucvector* out, const unsigned char* in, size_t
   numdeflateblocks = (insize + blocksize - 1) / blocksize;
   if(numdeflateblocks == 0) numdeflateblocks = 1;
 
-  error = hash_init(&hash, settings->windowsize);
-  if(error) return error;
-
-  for(i = 0; i != numdeflateblocks && !error; ++i)
+#ifdef LODEPNG_COMPILE_CPP
+  if(settings->threads > 1 && numdeflateblocks > 1)
   {
-    unsigned final = (i == numdeflateblocks - 1);
-    size_t start = i * blocksize;
-    size_t end = start + blocksize;
-    if(end > insize) end = insize;
-
-    if(settings->btype == 1) error = deflateFixed(out, &bp, &hash, in, start, end, settings, final);
-    else if(settings->btype == 2) error = deflateDynamic(out, &bp, &hash, in, start, end, settings, final);
+    return deflateBlocksThreaded(out, in, insize, blocksize, numdeflateblocks, settings->threads, settings);
   }
+#endif /*LODEPNG_COMPILE_CPP*/
 
-  hash_cleanup(&hash);
-
-  return error;
+  return deflateBlocks(out, in, insize, blocksize, 0, numdeflateblocks, numdeflateblocks, settings);
 }
 
 unsigned lodepng_deflate(unsigned char** out, size_t* outsize,
@@ -2271,13 +2384,14 @@ void lodepng_compress_settings_init(LodePNGCompressSettings* settings)
   settings->minmatch = 3;
   settings->nicematch = 128;
   settings->lazymatching = 1;
+  settings->threads = 1;
 
   settings->custom_zlib = 0;
   settings->custom_deflate = 0;
   settings->custom_context = 0;
 }
 
-const LodePNGCompressSettings lodepng_default_compress_settings = {2, 1, DEFAULT_WINDOWSIZE, 3, 128, 1, 0, 0, 0};
+const LodePNGCompressSettings lodepng_default_compress_settings = {2, 1, DEFAULT_WINDOWSIZE, 3, 128, 1, 1, 0, 0, 0};
 
 
 #endif /*LODEPNG_COMPILE_ENCODER*/
@@ -285,6 +285,9 @@ struct LodePNGCompressSettings /*deflate = compress*/
   unsigned nicematch; /*stop searching if >= this length found. Set to 258 for best compression. Default: 128*/
   unsigned lazymatching; /*use lazy matching: better compression but a bit slower. Default: true*/
 
+  /*parallel compression, only when compiled as C++ (see threads in the manual)*/
+  unsigned threads; /*number of threads that deflate blocks at the same time. Default: 1*/
+
   /*use custom zlib encoder instead of built in one (default: null)*/
   unsigned (*custom_zlib)(unsigned char**, size_t*,
                           const unsigned char*, size_t,
@@ -1094,6 +1097,12 @@ can encode the colors of all pixels without information loss.
    true for proper compression.
 *) windowsize: the window size used by the LZ77 encoder (1 - 32768). Has value
    2048 by default, but can be set to 32768 for better, but slow, compression.
+*) threads: the number of threads that compress at the same time (C++ only).
+   Has value 1 by default. With more, the deflate blocks are compressed on their
+   own, each with the window of data before it as dictionary, and joined with
+   empty stored blocks in between, as pigz does. The result is a few bytes per
+   block larger and not byte for byte the same as with 1 thread, but it is still
+   one valid zlib stream.
 *) force_palette: if colortype is 2 or 6, you can make the encoder write a PLTE
    chunk if force_palette is true. This can used as suggested palette to convert
    to by viewers that don't support more than 256 colors (if those still exist)
@@ -1401,6 +1410,7 @@ state.encoder.zlibsettings.windowsize: tweak LZ77 windowsize
 state.encoder.zlibsettings.minmatch: tweak min LZ77 length to match
 state.encoder.zlibsettings.nicematch: tweak LZ77 match where to stop searching
 state.encoder.zlibsettings.lazymatching: try one more LZ77 matching
+state.encoder.zlibsettings.threads: compress deflate blocks on several threads
 state.encoder.zlibsettings.custom_...: use custom deflate function
 state.encoder.auto_convert: choose optimal PNG color type, if 0 uses info_png
 state.encoder.filter_palette_zero: PNG filter strategy for palette
@@ -16,20 +16,39 @@ using namespace cs221util;
  * @return The grayscale image.
  */
 PNG grayscale(PNG image) {
+  grayscaleInPlace(image);
+  return image;
+}
+
+/**
+ * Transforms an image to grayscale in place, as grayscale does.
+ *
+ * @param image The image to change.
+ */
+void grayscaleInPlace(PNG & image) {
   /// This function is already written for you so you can see how to
   /// interact with our PNG class.
-  for (unsigned x = 0; x < image.width(); x++) {
-    for (unsigned y = 0; y < image.height(); y++) {
-      HSLAPixel *pixel = image.getPixel(x, y);
-
-      // `pixel` is a pointer to the memory stored inside of the PNG `image`,
-      // which means you're changing the image directly.  No need to `set`
-      // the pixel since you're directly changing the memory of the image.
-      pixel->s = 0;
-    }
+  for (unsigned y = 0; y < image.height(); y++) {
+    // `row` points at the memory stored inside of the PNG `image`, one
+    // pixel after another, which means you're changing the image directly.
+    // No need to `set` the pixel since you're directly changing the memory
+    // of the image.
+    HSLAPixel *row = image.getRow(y);
+    grayscaleRow(row, y, image.width());
   }
+}
 
-  return image;
+/**
+ * Sets the saturation of every pixel of a row to 0.
+ *
+ * @param row The first pixel of the row.
+ * @param y The row's y-coordinate.
+ * @param width The number of pixels in the row.
+ */
+void grayscaleRow(HSLAPixel * row, unsigned /* y */, unsigned width) {
+  for (unsigned x = 0; x < width; x++) {
+    row[x].s = 0;
+  }
 }
 
 
@@ -55,17 +74,44 @@ PNG grayscale(PNG image) {
  * @return The image with a spotlight.
  */
 PNG createSpotlight(PNG image, int centerX, int centerY) {
-  for (unsigned x = centerX; x < image.width(); x++) {
-    for (unsigned y = centerY; y < image.height(); y++) {
-      HSLAPixel *pixel = image.getPixel(x, y);
-      unsigned dist = sqrt(x * x + y * y);
-      unsigned decrease = dist * 0.5;
-      pixel->l = pixel->l - decrease;
-      }
-  }
+  createSpotlightInPlace(image, centerX, centerY);
   return image;
 }
 
+/**
+ * Adds a spotlight to an image in place, as createSpotlight does.
+ *
+ * @param image The image to change.
+ * @param centerX The center x coordinate of the spotlight.
+ * @param centerY The center y coordinate of the spotlight.
+ */
+void createSpotlightInPlace(PNG & image, int centerX, int centerY) {
+  for (unsigned y = 0; y < image.height(); y++) {
+    spotlightRow(image.getRow(y), y, image.width(), centerX, centerY);
+  }
+}
+
+/**
+ * Applies the spotlight of createSpotlight to a row.
+ *
+ * @param row The first pixel of the row.
+ * @param y The row's y-coordinate.
+ * @param width The number of pixels in the row.
+ * @param centerX The center x coordinate of the spotlight.
+ * @param centerY The center y coordinate of the spotlight.
+ */
+void spotlightRow(HSLAPixel * row, unsigned y, unsigned width, int centerX, int centerY) {
+  if (y < (unsigned) centerY) {
+    return;
+  }
+  for (unsigned x = centerX; x < width; x++) {
+    HSLAPixel *pixel = row + x;
+    unsigned dist = sqrt(x * x + y * y);
+    unsigned decrease = dist * 0.5;
+    pixel->l = pixel->l - decrease;
+  }
+}
+
 
 /**
  * Returns a image transformed to UBC colors.
@@ -78,19 +124,38 @@ PNG createSpotlight(PNG image, int centerX, int centerY) {
  * @return The UBCify'd image.
 **/
 PNG ubcify(PNG image) {
-    for (unsigned x = 0; x < image.width(); x++) {
-        for (unsigned y = 0; y < image.height(); y++) {
-            HSLAPixel *pixel = image.getPixel(x, y);
-            if (pixel->h <= 40)
-                pixel->h = 40;
-            else
-                pixel->h = 210;
-        }
-    }
-  
+  ubcifyInPlace(image);
   return image;
 }
 
+/**
+ * Transforms an image to UBC colors in place, as ubcify does.
+ *
+ * @param image The image to change.
+ */
+void ubcifyInPlace(PNG & image) {
+    for (unsigned y = 0; y < image.height(); y++) {
+        ubcifyRow(image.getRow(y), y, image.width());
+    }
+}
+
+/**
+ * Sets the hue of every pixel of a row to yellow or blue, as ubcify does.
+ *
+ * @param row The first pixel of the row.
+ * @param y The row's y-coordinate.
+ * @param width The number of pixels in the row.
+ */
+void ubcifyRow(HSLAPixel * row, unsigned /* y */, unsigned width) {
+    for (unsigned x = 0; x < width; x++) {
+        HSLAPixel *pixel = row + x;
+        if (pixel->h <= 40)
+            pixel->h = 40;
+        else
+            pixel->h = 210;
+    }
+}
+
 
 /**
 * Returns an immge that has been watermarked by another image.
@@ -104,17 +169,42 @@ PNG ubcify(PNG image) {
 *
 * @return The watermarked image.
 */
-PNG watermark(PNG firstImage, PNG secondImage) {
+PNG watermark(PNG firstImage, PNG const & secondImage) {
+  watermarkInPlace(firstImage, secondImage);
+  return firstImage;
+}
+
+/**
+* Watermarks an image in place, as watermark does. The first image is
+* resized to 1024x768, which only allocates if it is not that size already;
+* the second image is read where it is, with no copy, and pixels outside of
+* it count as white, as they would once resize padded it.
+*
+* @param firstImage  The image to change.
+* @param secondImage The image to watermark with.
+*/
+void watermarkInPlace(PNG & firstImage, PNG const & secondImage) {
     firstImage.resize(1024, 768);
-    secondImage.resize(1024, 768);
-    for (unsigned x = 0; x < secondImage.width(); x++) {
-        for (unsigned y = 0; y < secondImage.height(); y++) {
-            HSLAPixel *firstPixel = firstImage.getPixel(x, y);
-            HSLAPixel *secondPixel = secondImage.getPixel(x, y);
-            if (secondPixel->l == 1)
-                firstPixel->l += 0.2;
-        }
+    for (unsigned y = 0; y < firstImage.height(); y++) {
+        watermarkRow(firstImage.getRow(y), y, firstImage.width(), secondImage);
     }
-  return firstImage;
 }
 
+/**
+* Watermarks a row as watermark does. Pixels outside of the second image
+* count as white, as they would once resize padded it.
+*
+* @param row The first pixel of the row.
+* @param y The row's y-coordinate.
+* @param width The number of pixels in the row.
+* @param secondImage The image to watermark with.
+*/
+void watermarkRow(HSLAPixel * row, unsigned y, unsigned width, PNG const & secondImage) {
+    HSLAPixel const *secondRow = y < secondImage.height() ? secondImage.getRow(y) : NULL;
+    unsigned secondWidth = secondRow != NULL ? secondImage.width() : 0;
+    for (unsigned x = 0; x < width; x++) {
+        HSLAPixel *firstPixel = row + x;
+        if (x >= secondWidth || secondRow[x].l == 1)
+            firstPixel->l += 0.2;
+    }
+}
@@ -7,6 +7,16 @@ using namespace cs221util;
 PNG grayscale(PNG image);  
 PNG createSpotlight(PNG image, int centerX, int centerY);
 PNG ubcify(PNG image);
-PNG watermark(PNG firstImage, PNG secondImage);
+PNG watermark(PNG firstImage, PNG const & secondImage);
+
+void grayscaleInPlace(PNG & image);
+void createSpotlightInPlace(PNG & image, int centerX, int centerY);
+void ubcifyInPlace(PNG & image);
+void watermarkInPlace(PNG & firstImage, PNG const & secondImage);
+
+void grayscaleRow(HSLAPixel * row, unsigned y, unsigned width);
+void spotlightRow(HSLAPixel * row, unsigned y, unsigned width, int centerX, int centerY);
+void ubcifyRow(HSLAPixel * row, unsigned y, unsigned width);
+void watermarkRow(HSLAPixel * row, unsigned y, unsigned width, PNG const & secondImage);
 
 #endif
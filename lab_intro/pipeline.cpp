@@ -0,0 +1,171 @@
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+#include "lab_intro.h"
+#include "pipeline.h"
+
+/**
+ * The helper threads of a pipeline. They wait between jobs instead of
+ * exiting, and each job is run by as many of them as it asks for.
+ */
+class FilterPipeline::Workers {
+public:
+  Workers() : job_(NULL), wanted_(0), running_(0), generation_(0), stopping_(false) { }
+
+  ~Workers() {
+    {
+      std::lock_guard<std::mutex> guard(lock_);
+      stopping_ = true;
+    }
+    wake_.notify_all();
+    for (std::thread & thread : threads_) {
+      thread.join();
+    }
+  }
+
+  /**
+   * Runs a job on a number of helpers and on the calling thread, and
+   * returns once every one of them has finished it. One job runs at a time.
+   */
+  void run(unsigned helpers, std::function<void()> const & job) {
+    std::lock_guard<std::mutex> turn(busy_);
+    {
+      std::lock_guard<std::mutex> guard(lock_);
+      while (threads_.size() < helpers) {
+        unsigned index = threads_.size();
+        threads_.push_back(std::thread([this, index] { _wait(index); }));
+      }
+      job_ = &job;
+      wanted_ = helpers;
+      running_ = helpers;
+      generation_++;
+    }
+    wake_.notify_all();
+    job();
+
+    std::unique_lock<std::mutex> guard(lock_);
+    done_.wait(guard, [this] { return running_ == 0; });
+    job_ = NULL;
+  }
+
+private:
+  std::mutex busy_;               /*< held by the job that is running */
+  std::mutex lock_;               /*< guards everything below */
+  std::condition_variable wake_;  /*< signalled when a job starts or on stopping */
+  std::condition_variable done_;  /*< signalled when the last helper finishes */
+  std::vector<std::thread> threads_;
+  std::function<void()> const *job_;
+  unsigned wanted_;               /*< the helpers the job runs on: the first wanted_ */
+  unsigned running_;              /*< the helpers still running the job */
+  unsigned long generation_;      /*< counts the jobs, so each is run once */
+  bool stopping_;
+
+  /**
+   * The loop of helper index: runs each job that wants it, until stopped.
+   */
+  void _wait(unsigned index) {
+    unsigned long seen = 0;
+    std::unique_lock<std::mutex> guard(lock_);
+    while (true) {
+      wake_.wait(guard, [&] { return stopping_ || (generation_ != seen && index < wanted_); });
+      if (stopping_) { return; }
+      seen = generation_;
+      std::function<void()> const *job = job_;
+      guard.unlock();
+      (*job)();
+      guard.lock();
+      if (--running_ == 0) {
+        done_.notify_all();
+      }
+    }
+  }
+};
+
+FilterPipeline::FilterPipeline() : workers_(new Workers()) { }
+
+FilterPipeline::FilterPipeline(FilterPipeline const & other)
+  : stages_(other.stages_), workers_(new Workers()) { }
+
+FilterPipeline & FilterPipeline::operator=(FilterPipeline const & other) {
+  stages_ = other.stages_;
+  return *this;
+}
+
+FilterPipeline::~FilterPipeline() { }
+
+FilterPipeline & FilterPipeline::then(Stage const & stage) {
+  stages_.push_back(stage);
+  return *this;
+}
+
+FilterPipeline & FilterPipeline::grayscale() {
+  return then(grayscaleRow);
+}
+
+FilterPipeline & FilterPipeline::spotlight(int centerX, int centerY) {
+  return then([centerX, centerY](HSLAPixel * row, unsigned y, unsigned width) {
+    spotlightRow(row, y, width, centerX, centerY);
+  });
+}
+
+FilterPipeline & FilterPipeline::ubcify() {
+  return then(ubcifyRow);
+}
+
+FilterPipeline & FilterPipeline::watermark(PNG const & secondImage) {
+  PNG const *overlay = &secondImage;
+  return then([overlay](HSLAPixel * row, unsigned y, unsigned width) {
+    watermarkRow(row, y, width, *overlay);
+  });
+}
+
+void FilterPipeline::_applyBand(HSLAPixel * pixels, unsigned width, unsigned top, unsigned bottom) const {
+  for (unsigned y = top; y < bottom; y++) {
+    HSLAPixel *row = pixels + y * width;
+    for (Stage const & stage : stages_) {
+      stage(row, y, width);
+    }
+  }
+}
+
+void FilterPipeline::apply(PNG & image, unsigned threads, unsigned bandHeight) const {
+  unsigned height = image.height();
+  bandHeight = std::max(bandHeight, 1u);
+  unsigned bands = (height + bandHeight - 1) / bandHeight;
+  threads = std::max(1u, std::min(threads, bands));
+
+  // the bands are taken from the whole buffer, which marks every row's hash
+  // stale once, instead of once per row
+  HSLAPixel *pixels = image.getData();
+  unsigned width = image.width();
+
+  if (threads == 1) {
+    _applyBand(pixels, width, 0, height);
+    return;
+  }
+
+  // each thread takes the next band until there are none left, so a thread
+  // held up on its band does not hold the others up
+  std::atomic<unsigned> next(0);
+  std::function<void()> work = [&]() {
+    for (unsigned band = next++; band < bands; band = next++) {
+      unsigned top = band * bandHeight;
+      _applyBand(pixels, width, top, std::min(top + bandHeight, height));
+    }
+  };
+
+  workers_->run(threads - 1, work);
+}
+
+PNG FilterPipeline::run(PNG const & image, unsigned threads) const {
+  PNG result(image);
+  apply(result, threads);
+  return result;
+}
+
+unsigned FilterPipeline::size() const {
+  return stages_.size();
+}
@@ -0,0 +1,135 @@
+/**
+ * @file pipeline.h
+ * A chain of the lab's filters, run in one pass over an image.
+ *
+ * Chaining the filters directly, as in watermark(ubcify(grayscale(png)),
+ * overlay), copies the image into and out of every call and walks all of
+ * its pixels once per filter, on one thread. A FilterPipeline instead
+ * changes the image it is given in place: it takes the image a row at a
+ * time, runs every stage over that row while it is still in the cache,
+ * and splits the rows into bands shared among several threads. The
+ * helper threads are started by the first apply that needs them and kept
+ * by the pipeline, so a batch that runs it over many images does not
+ * start new threads for each one.
+ */
+
+#ifndef PIPELINE_H
+#define PIPELINE_H
+
+#include <functional>
+#include <memory>
+#include <vector>
+#include "cs221util/PNG.h"
+
+using namespace cs221util;
+
+class FilterPipeline {
+public:
+  /**
+    * A stage changes one row of an image in place. Stages must only
+    * depend on the pixels of the row they are given, since the other rows
+    * may be being changed at the same time.
+    * @param row The first pixel of the row.
+    * @param y The row's y-coordinate.
+    * @param width The number of pixels in the row.
+    */
+  typedef std::function<void(HSLAPixel * row, unsigned y, unsigned width)> Stage;
+
+  /**
+    * Creates a pipeline with no stages and no helper threads.
+    */
+  FilterPipeline();
+
+  /**
+    * Copies another pipeline's stages. The copy starts its own helper
+    * threads when it first needs them.
+    * @param other The pipeline to copy.
+    */
+  FilterPipeline(FilterPipeline const & other);
+
+  /**
+    * Copies another pipeline's stages, keeping this pipeline's threads.
+    * @param other The pipeline to copy.
+    * @return The pipeline.
+    */
+  FilterPipeline & operator=(FilterPipeline const & other);
+
+  /**
+    * Stops and joins the helper threads.
+    */
+  ~FilterPipeline();
+
+  /**
+    * Adds a stage to the end of the pipeline.
+    * @param stage The stage to add.
+    * @return The pipeline, for chaining.
+    */
+  FilterPipeline & then(Stage const & stage);
+
+  /**
+    * Adds the pixel changes of grayscale.
+    * @return The pipeline, for chaining.
+    */
+  FilterPipeline & grayscale();
+
+  /**
+    * Adds the pixel changes of createSpotlight.
+    * @param centerX The center x coordinate of the spotlight.
+    * @param centerY The center y coordinate of the spotlight.
+    * @return The pipeline, for chaining.
+    */
+  FilterPipeline & spotlight(int centerX, int centerY);
+
+  /**
+    * Adds the pixel changes of ubcify.
+    * @return The pipeline, for chaining.
+    */
+  FilterPipeline & ubcify();
+
+  /**
+    * Adds the pixel changes of watermark. Unlike watermark, the image is
+    * not resized to 1024x768; pixels outside the second image count as
+    * white, so on an image of that size the result is the same.
+    * @param secondImage The image to watermark with. It is not copied, and
+    *  must outlive the pipeline.
+    * @return The pipeline, for chaining.
+    */
+  FilterPipeline & watermark(PNG const & secondImage);
+
+  /**
+    * Runs every stage, in order, over an image, changing it in place.
+    * The pipeline's helper threads are reused from earlier calls, and
+    * more are started if this call asks for more than it has. Calls that
+    * use threads from several threads at once take turns.
+    * @param image The image to change.
+    * @param threads The number of threads to share the rows among.
+    * @param bandHeight The number of rows a thread takes at a time.
+    */
+  void apply(PNG & image, unsigned threads = 1, unsigned bandHeight = 16) const;
+
+  /**
+    * Runs every stage, in order, over a copy of an image.
+    * @param image The image to copy.
+    * @param threads The number of threads to share the rows among.
+    * @return The changed copy.
+    */
+  PNG run(PNG const & image, unsigned threads = 1) const;
+
+  /**
+    * @return The number of stages.
+    */
+  unsigned size() const;
+
+private:
+  class Workers;
+
+  std::vector<Stage> stages_;     /*< the stages, in the order they run */
+  std::unique_ptr<Workers> workers_;  /*< the helper threads apply shares bands with */
+
+  /**
+   * Runs every stage over the rows of a band of an image's pixels.
+   */
+  void _applyBand(HSLAPixel * pixels, unsigned width, unsigned top, unsigned bottom) const;
+};
+
+#endif
@@ -0,0 +1,109 @@
+/**
+ * @file test_alloc.cpp
+ * Counts the full-frame pixel buffers allocated by chains of the four
+ * filters on a 1024x768 image (watermark's size), by replacing the global
+ * array new. A chain called on an image the caller keeps must copy it
+ * once; a chain handed the image with std::move, a chain of the in-place
+ * filters and a FilterPipeline applied in place must not allocate a frame
+ * at all. Prints each chain's count and fails if any is over its limit.
+ *
+ * Usage: ./test_alloc
+ */
+
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <new>
+#include <utility>
+
+#include "cs221util/PNG.h"
+#include "lab_intro.h"
+#include "pipeline.h"
+
+static size_t frameBytes = 0;   /*< size of one image's pixels, once known */
+static long frames = 0;         /*< array allocations of at least frameBytes */
+
+// the replacements are kept out of line so that the compiler does not pair
+// the malloc and free inside them with new and delete expressions
+__attribute__((noinline)) void * operator new[](size_t size) {
+  if (frameBytes > 0 && size >= frameBytes) {
+    frames++;
+  }
+  void *memory = malloc(size == 0 ? 1 : size);
+  if (memory == NULL) {
+    throw std::bad_alloc();
+  }
+  return memory;
+}
+
+__attribute__((noinline)) void operator delete[](void * memory) noexcept {
+  free(memory);
+}
+
+__attribute__((noinline)) void operator delete[](void * memory, size_t) noexcept {
+  free(memory);
+}
+
+/**
+ * Runs a chain, prints how many frames it allocated, and checks it
+ * against the limit.
+ * @return Whether the chain stayed within the limit
+ */
+template <typename Func>
+bool check(char const *name, long limit, Func chain) {
+  long before = frames;
+  chain();
+  long used = frames - before;
+  std::cout << std::setw(22) << name << std::setw(8) << used << std::setw(8) << limit
+            << std::setw(6) << (used <= limit ? "ok" : "FAIL") << std::endl;
+  return used <= limit;
+}
+
+int main() {
+  PNG png, overlay;
+  png.readFromFile("rosegarden.png");
+  overlay.readFromFile("overlay.png");
+  png.resize(1024, 768);
+  frameBytes = png.width() * png.height() * sizeof(HSLAPixel);
+
+  FilterPipeline pipeline;
+  pipeline.grayscale().spotlight(300, 300).ubcify().watermark(overlay);
+
+  std::cout << std::setw(22) << "chain" << std::setw(8) << "frames" << std::setw(8) << "limit"
+            << std::setw(6) << "" << std::endl;
+  bool passed = true;
+  PNG result;
+
+  passed &= check("by value, kept", 1, [&] {
+    result = watermark(ubcify(createSpotlight(grayscale(png), 300, 300)), overlay);
+  });
+
+  PNG work(png);
+  passed &= check("by value, moved", 0, [&] {
+    result = watermark(ubcify(createSpotlight(grayscale(std::move(work)), 300, 300)), overlay);
+  });
+
+  work = png;
+  passed &= check("in place", 0, [&] {
+    grayscaleInPlace(work);
+    createSpotlightInPlace(work, 300, 300);
+    ubcifyInPlace(work);
+    watermarkInPlace(work, overlay);
+  });
+
+  work = png;
+  passed &= check("pipeline, in place", 0, [&] {
+    pipeline.apply(work, 2);
+  });
+
+  passed &= check("swap", 0, [&] {
+    std::swap(work, result);
+    swap(work, result);
+  });
+
+  passed &= check("copy into same size", 0, [&] {
+    work = png;
+  });
+
+  return passed ? 0 : 1;
+}
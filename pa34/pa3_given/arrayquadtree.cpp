@@ -0,0 +1,531 @@
+/**
+ * @file arrayquadtree.cpp
+ * ArrayQuadtree class implementation.
+ */
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdlib>
+#include <iostream>
+
+using namespace std;
+
+#include "arrayquadtree.h"
+#include "pixelkernels.h"
+#include "png.h"
+#include "quadtreefile.h"
+
+// ArrayQuadtree
+//   - parameters: none
+//   - constructor for the ArrayQuadtree class; makes an empty tree
+ArrayQuadtree::ArrayQuadtree()
+{
+	res = 0;
+	depth = 0;
+}
+
+// ArrayQuadtree
+//   - parameters: PNG const & source - reference to a const PNG
+//                    object, from which the tree will be built
+//                 int resolution - resolution of the portion of source
+//                    from which this tree will be built
+//   - constructor for the ArrayQuadtree class
+ArrayQuadtree::ArrayQuadtree(PNG const& source, int resolution)
+{
+	res = 0;
+	depth = 0;
+	buildTree(source, resolution);
+}
+
+/**
+ * Returns the index of the first node of the given level.
+ * Level l holds 4^l nodes, so it starts after (4^l - 1) / 3 others.
+ * @param level A level of the tree; the root is level 0
+ */
+size_t ArrayQuadtree::levelStart(int level)
+{
+	return (((size_t) 1 << (2 * level)) - 1) / 3;
+}
+
+/**
+ * Interleaves the bits of x and y so that x lands on the even bits.
+ * @param x The x coordinate within a level
+ * @param y The y coordinate within a level
+ */
+size_t ArrayQuadtree::morton(size_t x, size_t y)
+{
+	size_t code = 0;
+	for (int bit = 0; (x | y) >> bit != 0; bit++) {
+		code |= ((x >> bit) & 1) << (2 * bit);
+		code |= ((y >> bit) & 1) << (2 * bit + 1);
+	}
+	return code;
+}
+
+// buildTree (public interface)
+//   - parameters: PNG const & source - reference to a const PNG
+//                    object, from which the tree will be built
+//                 int resolution - resolution of the portion of source
+//                    from which this tree will be built
+//   - fills the bottom level straight from the image, then averages the
+//        levels bottom up so every parent is averaged after its children;
+//        a resolution that is not a power of two leaves the tree empty
+void ArrayQuadtree::buildTree(PNG const& source, int resolution)
+{
+	elements.clear();
+	leaf.clear();
+	res = 0;
+	depth = 0;
+	if (resolution < 1 || (resolution & (resolution - 1)) != 0) {
+		cerr << "[ArrayQuadtree]: a resolution of " << resolution << " is not a power of two;"
+			<< " only square power of two trees fit the array layout" << endl;
+		return;
+	}
+
+	res = resolution;
+	while ((1 << depth) < res)
+		depth++;
+
+	size_t size = levelStart(depth + 1);
+	elements.assign(size, RGBAPixel());
+	leaf.assign(size, false);
+
+	// bottom level: one leaf per pixel, stored in Morton order
+	size_t bottom = levelStart(depth);
+	for (int y = 0; y < res; y++) {
+		for (int x = 0; x < res; x++) {
+			size_t index = bottom + morton(x, y);
+			elements[index] = *source(x, y);
+			leaf[index] = true;
+		}
+	}
+
+	// the four children of each node of a level are consecutive slots of
+	// the next, so each level is averaged from the one below in one batch
+	for (int level = depth; level-- > 0; ) {
+		size_t first = levelStart(level);
+		size_t next = levelStart(level + 1);
+		PixelKernels::averageGroups(&elements[next], &elements[first], next - first);
+	}
+}
+
+/**
+ * Sets the internal node at index to the component-wise average of its
+ * four children.
+ * @param index The node to update
+ */
+void ArrayQuadtree::average(size_t index)
+{
+	// component wise averages for RGBA
+	RGBAPixel const* child = &elements[4 * index + 1];
+	int red = (child[0].red + child[1].red + child[2].red + child[3].red) / 4;
+	int green = (child[0].green + child[1].green + child[2].green + child[3].green) / 4;
+	int blue = (child[0].blue + child[1].blue + child[2].blue + child[3].blue) / 4;
+	int alpha = (child[0].alpha + child[1].alpha + child[2].alpha + child[3].alpha) / 4;
+	elements[index] = RGBAPixel(red, green, blue, alpha);
+}
+
+// getPixel (public interface)
+//   - parameters: int x, int y - coordinates of the pixel to be retrieved
+//   - return value: the colour of the deepest node covering (x, y)
+RGBAPixel ArrayQuadtree::getPixel(int x, int y) const
+{
+	if (x < 0 || y < 0 || x >= res || y >= res || elements.empty())
+		return RGBAPixel();
+
+	size_t index = 0;
+	int size = res;
+	while (!leaf[index]) {
+		size /= 2;
+		int quadrant = 0;
+		if (x >= size) {
+			quadrant += 1;
+			x -= size;
+		}
+		if (y >= size) {
+			quadrant += 2;
+			y -= size;
+		}
+		index = 4 * index + 1 + quadrant;
+	}
+	return elements[index];
+}
+
+// decompress (public interface)
+//   - parameters: none
+//   - return value: a PNG object representing this tree's underlying
+//        bitmap; each leaf fills its whole block at once
+PNG ArrayQuadtree::decompress() const
+{
+	if (elements.empty())
+		return PNG();
+
+	PNG ret((size_t) res, (size_t) res);
+	fill(ret, 0, res, 0, 0);
+	return ret;
+}
+
+/**
+ * Private helper for decompress that paints the block covered by the
+ * subtree at index.
+ * @param ret The image being filled
+ * @param index The current node in the recursion
+ * @param size The side length of the block the node covers
+ * @param x The x coordinate of the block's upper-left corner
+ * @param y The y coordinate of the block's upper-left corner
+ */
+void ArrayQuadtree::fill(PNG& ret, size_t index, int size, int x, int y) const
+{
+	if (leaf[index]) {
+		RGBAPixel const& color = elements[index];
+		for (int j = y; j < y + size; j++) {
+			RGBAPixel* row = ret.row(j) + x;
+			std::fill(row, row + size, color);
+		}
+		return;
+	}
+
+	int half = size / 2;
+	fill(ret, 4 * index + 1, half, x, y);
+	fill(ret, 4 * index + 2, half, x + half, y);
+	fill(ret, 4 * index + 3, half, x, y + half);
+	fill(ret, 4 * index + 4, half, x + half, y + half);
+}
+
+// writeToFile (public interface)
+//   - parameters: string const & fileName - file to write to
+//   - return value: whether the file was written
+//   - saves the live part of the tree, see quadtreefile.h
+bool ArrayQuadtree::writeToFile(string const& fileName) const
+{
+	QuadtreeWriter out(res, res, res, 0, 0);
+	if (!elements.empty())
+		save(0, out);
+	return out.writeToFile(fileName);
+}
+
+/**
+ * Appends the subtree at index to out in preorder.
+ * @param index The current node in the recursion
+ * @param out The file being assembled
+ */
+void ArrayQuadtree::save(size_t index, QuadtreeWriter& out) const
+{
+	if (leaf[index]) {
+		out.addLeaf(elements[index]);
+		return;
+	}
+	out.addInternal();
+	for (size_t q = 1; q <= 4; q++)
+		save(4 * index + q, out);
+}
+
+// readFromFile (public interface)
+//   - parameters: string const & fileName - file to read
+//   - return value: whether the file was read
+//   - replaces this tree with the one saved in fileName; the slots below
+//        saved leaves are allocated but never written
+bool ArrayQuadtree::readFromFile(string const& fileName)
+{
+	elements.clear();
+	leaf.clear();
+	res = 0;
+	depth = 0;
+
+	QuadtreeReader in;
+	if (!in.open(fileName))
+		return false;
+	if (in.resolution() == 0)
+		return true;
+	if (in.width() != in.resolution() || in.height() != in.resolution()) {
+		cerr << "[ArrayQuadtree]: " << fileName << " holds a partial grid;"
+			<< " only square power of two trees fit the array layout" << endl;
+		return false;
+	}
+
+	res = in.resolution();
+	while ((1 << depth) < res)
+		depth++;
+	size_t size = levelStart(depth + 1);
+	elements.assign(size, RGBAPixel());
+	leaf.assign(size, false);
+
+	if (!load(in, 0, 0) || !in.finished()) {
+		cerr << "[ArrayQuadtree]: " << fileName << " does not hold a valid tree" << endl;
+		elements.clear();
+		leaf.clear();
+		res = 0;
+		depth = 0;
+		return false;
+	}
+	return true;
+}
+
+/**
+ * Decodes the next subtree in preorder into the subtree at index, then
+ * averages index from its children as buildTree does.
+ * @param in The mapped file
+ * @param index The current node in the recursion
+ * @param level The level index sits on
+ * @return False if the file does not describe a valid subtree
+ */
+bool ArrayQuadtree::load(QuadtreeReader& in, size_t index, int level)
+{
+	bool isLeaf;
+	if (!in.readNode(isLeaf, elements[index]))
+		return false;
+	if (isLeaf) {
+		leaf[index] = true;
+		return true;
+	}
+	// the bottom level holds single pixels, which cannot be split
+	if (level == depth)
+		return false;
+
+	for (size_t q = 1; q <= 4; q++)
+		if (!load(in, 4 * index + q, level + 1))
+			return false;
+	average(index);
+	return true;
+}
+
+// clockwiseRotate (public interface)
+//   - parameters: none
+//   - rotates every level in place of the array: the node at (x, y) in a
+//        side by side level moves to (side - 1 - y, x)
+void ArrayQuadtree::clockwiseRotate()
+{
+	if (elements.empty())
+		return;
+
+	vector<RGBAPixel> rotated(elements.size());
+	vector<bool> rotatedLeaf(leaf.size());
+	for (int level = 0; level <= depth; level++) {
+		size_t start = levelStart(level);
+		int side = 1 << level;
+		for (int y = 0; y < side; y++) {
+			for (int x = 0; x < side; x++) {
+				size_t from = start + morton(x, y);
+				size_t to = start + morton(side - 1 - y, x);
+				rotated[to] = elements[from];
+				rotatedLeaf[to] = leaf[from];
+			}
+		}
+	}
+	elements.swap(rotated);
+	leaf.swap(rotatedLeaf);
+}
+
+/**
+ * Private helper function to calculate the squared RGB distance between
+ * two colours.
+ * @param first The first colour of comparison
+ * @param second The second colour of comparison
+ * @return the difference between the two colours
+ */
+int ArrayQuadtree::diff(RGBAPixel const& first, RGBAPixel const& second)
+{
+	int red = second.red - first.red;
+	int green = second.green - first.green;
+	int blue = second.blue - first.blue;
+	return red * red + green * green + blue * blue;
+}
+
+/**
+ * Computes the largest leaf difference for every reachable node. A first
+ * sweep finds the live nodes (those not hidden below a leaf), then each
+ * live leaf pushes its difference up its chain of ancestors.
+ * @return The per-slot maximum leaf difference, -1 for dead slots
+ */
+vector<int> ArrayQuadtree::leafDistances() const
+{
+	vector<int> distances(elements.size(), -1);
+	if (elements.empty())
+		return distances;
+
+	distances[0] = 0;
+	for (size_t i = 0; i < elements.size(); i++) {
+		if (distances[i] < 0 || leaf[i])
+			continue;
+		for (size_t c = 4 * i + 1; c <= 4 * i + 4; c++)
+			distances[c] = 0;
+	}
+
+	for (size_t i = 1; i < elements.size(); i++) {
+		if (distances[i] < 0 || !leaf[i])
+			continue;
+		for (size_t a = i; a != 0; ) {
+			a = (a - 1) / 4;
+			distances[a] = max(distances[a], diff(elements[i], elements[a]));
+		}
+	}
+	return distances;
+}
+
+/**
+ * Marks, top down, the nodes that would be leaves after pruning.
+ * @param distances The output of leafDistances()
+ * @param tolerance The tolerance range to determine if prune
+ * @param collapse Set to true at each resulting leaf
+ * @return The number of leaves after pruning
+ */
+int ArrayQuadtree::markPrunes(vector<int> const& distances, int tolerance,
+                              vector<bool>& collapse) const
+{
+	collapse.assign(elements.size(), false);
+	vector<bool> open(elements.size(), false);
+	open[0] = true;
+
+	int leaves = 0;
+	for (size_t i = 0; i < elements.size(); i++) {
+		if (!open[i])
+			continue;
+		if (leaf[i] || distances[i] <= tolerance) {
+			collapse[i] = true;
+			leaves++;
+		}
+		else {
+			for (size_t c = 4 * i + 1; c <= 4 * i + 4; c++)
+				open[c] = true;
+		}
+	}
+	return leaves;
+}
+
+// prune (public interface)
+//   - parameters: int tolerance - see Quadtree::prune
+//   - turns every prunable node into a leaf by setting its bit; the slots
+//        beneath it simply become unreachable
+void ArrayQuadtree::prune(int tolerance)
+{
+	if (elements.empty())
+		return;
+
+	vector<bool> collapse;
+	markPrunes(leafDistances(), tolerance, collapse);
+	for (size_t i = 0; i < elements.size(); i++)
+		if (collapse[i])
+			leaf[i] = true;
+}
+
+// pruneSize (public interface)
+//   - parameters: int tolerance - see Quadtree::pruneSize
+//   - returns the number of leaves this tree would contain if it was
+//        pruned using the given tolerance
+int ArrayQuadtree::pruneSize(int tolerance) const
+{
+	if (elements.empty())
+		return 0;
+
+	vector<bool> collapse;
+	return markPrunes(leafDistances(), tolerance, collapse);
+}
+
+// idealPrune (public interface)
+//   - parameters: int numLeaves - the number of leaves we wish the tree
+//                    to have, after pruning
+//   - returns the minimum tolerance such that pruning with that tolerance
+//        would yield a tree with at most numLeaves leaves
+int ArrayQuadtree::idealPrune(int numLeaves) const
+{
+	if (elements.empty())
+		return 0;
+	// the distances do not depend on the tolerance, so compute them once
+	return minTolerance(leafDistances(), numLeaves, 0, 255*255*3);
+}
+
+/**
+ * Private helper function that does a binary search over all possible
+ * tolerances for the smallest one leaving at most numLeaves leaves.
+ * @param distances The output of leafDistances()
+ * @param numLeaves The number of leaves you want to remain in the tree
+ * @param min The minimum tolerance range
+ * @param max The maximum tolerance range
+ * @return The minimum tolerance needed
+ */
+int ArrayQuadtree::minTolerance(vector<int> const& distances, int numLeaves,
+                                int min, int max) const
+{
+	vector<bool> collapse;
+	while (min < max) {
+		int mid = (min + max) / 2;
+		if (markPrunes(distances, mid, collapse) > numLeaves)
+			min = mid + 1;
+		else
+			max = mid;
+	}
+	return min;
+}
+
+// printTree (public interface)
+//   - parameters: none
+//   - prints the leaves of the tree using a preorder traversal
+void ArrayQuadtree::printTree(ostream& out /* = cout */) const
+{
+	if (elements.empty())
+		out << "Empty tree.\n";
+	else
+		printTree(out, 0, 1);
+}
+
+/**
+ * Prints the leaves below index in the same order as Quadtree::printTree.
+ * @param out The stream to print to
+ * @param index The current node in the recursion
+ * @param level The current recursion depth
+ */
+void ArrayQuadtree::printTree(ostream& out, size_t index, int level) const
+{
+	if (leaf[index]) {
+		out << elements[index] << " at depth " << level << "\n";
+		return;
+	}
+	printTree(out, 4 * index + 2, level + 1);
+	printTree(out, 4 * index + 4, level + 1);
+	printTree(out, 4 * index + 3, level + 1);
+	printTree(out, 4 * index + 1, level + 1);
+}
+
+// operator==
+//   - parameters: ArrayQuadtree const & other - tree to compare with
+//   - return value: true if both trees have the same leaves
+bool ArrayQuadtree::operator==(ArrayQuadtree const& other) const
+{
+	if (elements.empty() || other.elements.empty())
+		return elements.empty() && other.elements.empty();
+	return compareTrees(other, 0, 0);
+}
+
+/**
+ * Compares the subtree at index with the subtree at otherIndex in other,
+ * looking only at the leaves, like Quadtree::compareTrees.
+ * @param other The other tree
+ * @param index The current node in this tree
+ * @param otherIndex The current node in other
+ * @return True if the two subtrees are deemed equal
+ */
+bool ArrayQuadtree::compareTrees(ArrayQuadtree const& other, size_t index,
+                                 size_t otherIndex) const
+{
+	if (leaf[index] != other.leaf[otherIndex])
+		return false;
+
+	if (leaf[index]) {
+		RGBAPixel const& first = elements[index];
+		RGBAPixel const& second = other.elements[otherIndex];
+		return first.red == second.red && first.green == second.green
+			&& first.blue == second.blue;
+	}
+
+	for (size_t q = 1; q <= 4; q++)
+		if (!compareTrees(other, 4 * index + q, 4 * otherIndex + q))
+			return false;
+	return true;
+}
+
+// capacity
+//   - return value: the number of node slots held by the array
+size_t ArrayQuadtree::capacity() const
+{
+	return elements.size();
+}
@@ -0,0 +1,252 @@
+/**
+ * @file arrayquadtree.h
+ * ArrayQuadtree class definition.
+ */
+
+#ifndef ARRAYQUADTREE_H
+#define ARRAYQUADTREE_H
+
+#include "png.h"
+#include <cstddef>
+#include <iostream>
+#include <string>
+#include <vector>
+
+class QuadtreeReader;
+class QuadtreeWriter;
+
+/**
+ * A pointer-free Quadtree. The whole tree lives in one contiguous,
+ * level-ordered array: the root is at index 0 and the children of the
+ * node at index i are at 4i+1 (nw), 4i+2 (ne), 4i+3 (sw) and 4i+4 (se).
+ * Within a level, nodes are therefore stored in Morton (z-) order.
+ *
+ * A node is a leaf when its bit in the leaf bitmap is set; the slots
+ * beneath a leaf are kept allocated but are never read. This lets build,
+ * copy, decompress and destruction run as linear sweeps over two arrays
+ * instead of walking millions of individually allocated nodes.
+ *
+ * The public interface follows Quadtree's for the operations it has, but
+ * the array layout only fits a square grid whose side is a power of two:
+ * unlike Quadtree, an ArrayQuadtree cannot represent an image of any
+ * other size.
+ */
+class ArrayQuadtree
+{
+  public:
+    /**
+     * Produces an empty ArrayQuadtree, which holds no nodes.
+     */
+    ArrayQuadtree();
+
+    /**
+     * Builds an ArrayQuadtree representing the upper-left resolution by
+     * resolution block of the source image.
+     *
+     * @param source The source image to base this tree on
+     * @param resolution The width and height of the sides of the image to
+     *  be represented; must be a power of two, or the tree is left empty
+     */
+    ArrayQuadtree(PNG const& source, int resolution);
+
+    /**
+     * Deletes the current contents of this tree, then turns it into a
+     * tree representing the upper-left resolution by resolution block of
+     * source.
+     *
+     * @param source The source image to base this tree on
+     * @param resolution The width and height of the sides of the image to
+     *  be represented; must be a power of two, or the tree is left empty
+     *  and an error is printed
+     */
+    void buildTree(PNG const& source, int resolution);
+
+    /**
+     * Gets the pixel at coordinates (x, y) of the represented image, or a
+     * default RGBAPixel if the coordinates are out of range or the tree
+     * is empty. See Quadtree::getPixel.
+     *
+     * @param x The x coordinate of the pixel to be retrieved
+     * @param y The y coordinate of the pixel to be retrieved
+     * @return The pixel at the given (x, y) location
+     */
+    RGBAPixel getPixel(int x, int y) const;
+
+    /**
+     * Returns the underlying PNG object represented by the tree, or a
+     * default PNG if the tree is empty.
+     *
+     * @return The decompressed PNG image this tree represents
+     */
+    PNG decompress() const;
+
+    /**
+     * Saves the tree in the format of quadtreefile.h, which is the same
+     * file Quadtree::writeToFile writes for the same tree.
+     *
+     * @param fileName Name of the file to write to
+     * @return Whether the file was written successfully
+     */
+    bool writeToFile(std::string const& fileName) const;
+
+    /**
+     * Replaces this tree with the one saved in a file by writeToFile (of
+     * either Quadtree or ArrayQuadtree). The file is mapped into memory
+     * and its preorder stream is decoded straight into the node array.
+     * Trees of images that do not fill their whole power of two grid
+     * (see Quadtree::buildTree(source, width, height, numThreads)) do not
+     * fit this layout and are rejected.
+     *
+     * @param fileName Name of the file to read
+     * @return Whether the file was read successfully; if not, the tree is
+     *  left empty
+     */
+    bool readFromFile(std::string const& fileName);
+
+    /**
+     * Rotates the represented image clockwise by 90 degrees. Each level is
+     * permuted in one sweep.
+     */
+    void clockwiseRotate();
+
+    /**
+     * Compresses the image this tree represents. Same semantics as
+     * Quadtree::prune.
+     *
+     * @param tolerance The integer tolerance between two nodes that
+     *  determines whether the subtree can be pruned.
+     */
+    void prune(int tolerance);
+
+    /**
+     * Returns how many leaves this tree would have if it were pruned with
+     * the given tolerance. Same semantics as Quadtree::pruneSize.
+     *
+     * @param tolerance The integer tolerance between two nodes that
+     *  determines whether the subtree can be pruned.
+     * @return How many leaves this tree would have after pruning
+     */
+    int pruneSize(int tolerance) const;
+
+    /**
+     * Returns the minimum tolerance needed to guarantee that no more than
+     * numLeaves leaves remain after pruning. Same semantics as
+     * Quadtree::idealPrune.
+     *
+     * @param numLeaves The number of leaves you want to remain in the tree
+     *  after prune is called.
+     * @return The minimum tolerance needed
+     */
+    int idealPrune(int numLeaves) const;
+
+    /**
+     * Prints the leaves of the tree using a preorder traversal, in the
+     * same format as Quadtree::printTree.
+     */
+    void printTree(std::ostream& out = std::cout) const;
+
+    /**
+     * Compares the leaves of this tree with the leaves of other.
+     *
+     * @param other The tree to compare against
+     * @return True if both trees have the same shape and leaf colours
+     */
+    bool operator==(ArrayQuadtree const& other) const;
+
+    /**
+     * @return The number of slots in the node array (live or not)
+     */
+    size_t capacity() const;
+
+  private:
+    std::vector<RGBAPixel> elements; /**< colour of every node slot */
+    std::vector<bool> leaf; /**< bitmap: true if the slot is a leaf */
+    int res; /**< side length of the represented image */
+    int depth; /**< number of levels below the root, log2(res) */
+
+    /**
+     * @param level A level of the tree; the root is level 0
+     * @return The index of the first node in that level
+     */
+    static size_t levelStart(int level);
+
+    /**
+     * Interleaves the bits of x (even bits) and y (odd bits).
+     * @param x The x coordinate within a level
+     * @param y The y coordinate within a level
+     * @return The Morton code of (x, y)
+     */
+    static size_t morton(size_t x, size_t y);
+
+    /**
+     * Private helper function to calculate the squared RGB distance
+     * between two colours.
+     * @param first The first colour of comparison
+     * @param second The second colour of comparison
+     * @return the difference between the two colours
+     */
+    static int diff(RGBAPixel const& first, RGBAPixel const& second);
+
+    /**
+     * Computes, for every node that is reachable from the root, the
+     * largest difference between its colour and the colour of any of its
+     * live descendant leaves. Unreachable slots are left at -1.
+     * @return The per-slot maximum leaf difference
+     */
+    std::vector<int> leafDistances() const;
+
+    /**
+     * Marks the nodes that would be leaves after pruning with tolerance.
+     * @param distances The output of leafDistances()
+     * @param tolerance The tolerance range to determine if prune
+     * @param collapse Output bitmap; true at each node that would
+     *  become (or already is) a leaf
+     * @return The number of leaves after pruning
+     */
+    int markPrunes(std::vector<int> const& distances, int tolerance,
+                   std::vector<bool>& collapse) const;
+
+    /**
+     * Private helper function that binary searches over all possible
+     * tolerances for the smallest one leaving at most numLeaves leaves.
+     */
+    int minTolerance(std::vector<int> const& distances, int numLeaves,
+                     int min, int max) const;
+
+    /**
+     * Sets the internal node at index to the component-wise average of
+     * its four children.
+     */
+    void average(size_t index);
+
+    /**
+     * Appends the subtree at index to out in preorder.
+     */
+    void save(size_t index, QuadtreeWriter& out) const;
+
+    /**
+     * Decodes the next subtree in preorder from in into the slots of the
+     * subtree at index, which sits on the given level.
+     * @return False if the file does not describe a valid subtree
+     */
+    bool load(QuadtreeReader& in, size_t index, int level);
+
+    /**
+     * Fills the block of ret covered by the subtree at index.
+     */
+    void fill(PNG& ret, size_t index, int size, int x, int y) const;
+
+    /**
+     * Preorder leaf printer for printTree.
+     */
+    void printTree(std::ostream& out, size_t index, int level) const;
+
+    /**
+     * Compares the subtree at index with the subtree at otherIndex in
+     * other.
+     */
+    bool compareTrees(ArrayQuadtree const& other, size_t index,
+                      size_t otherIndex) const;
+};
+
+#endif
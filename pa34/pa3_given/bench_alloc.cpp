@@ -0,0 +1,109 @@
+/**
+ * @file bench_alloc.cpp
+ * Measures the node pool. Each phase of a tree's life - a serial and a
+ * four-thread build, pruning a copy (which clones the paths it changes),
+ * pruning a tree in place (which frees nodes) and destroying the tree -
+ * is run with nodes taken from a NodePool and with each node allocated
+ * with new, counting the calls made to the global allocator and timing
+ * the phase.
+ *
+ * Usage: ./bench_alloc [resolution ...]   (default: 512 1024 2048)
+ */
+
+#include <atomic>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <new>
+#include <vector>
+
+#include "bench_util.h"
+#include "png.h"
+#include "quadtree.h"
+
+using std::cout;
+using std::endl;
+using std::setw;
+
+static std::atomic<long> allocatorCalls(0); /**< calls to new and delete so far */
+
+// the replacements are kept out of line so that the compiler does not
+// pair the malloc and free inside them with new and delete expressions
+__attribute__((noinline)) void* operator new(size_t size)
+{
+    allocatorCalls++;
+    void* memory = malloc(size == 0 ? 1 : size);
+    if (memory == NULL)
+        throw std::bad_alloc();
+    return memory;
+}
+
+__attribute__((noinline)) void operator delete(void* memory) noexcept
+{
+    allocatorCalls++;
+    free(memory);
+}
+
+__attribute__((noinline)) void operator delete(void* memory, size_t) noexcept
+{
+    allocatorCalls++;
+    free(memory);
+}
+
+/**
+ * Runs one phase and prints its allocator calls and time on a row.
+ */
+template <typename Func>
+void phase(int resolution, bool pooled, char const* name, Func fn)
+{
+    long calls = allocatorCalls;
+    BenchTime start = benchNow();
+    fn();
+    double ms = elapsedMs(start);
+    cout << setw(6) << resolution << setw(8) << (pooled ? "pool" : "new")
+         << setw(14) << name << setw(12) << allocatorCalls - calls << setw(10) << ms << endl;
+}
+
+/**
+ * Runs every phase on one resolution, pooled or not.
+ */
+void run(PNG const& source, int resolution, bool pooled)
+{
+    Quadtree::setNodePooling(pooled);
+
+    Quadtree* tree = NULL;
+    phase(resolution, pooled, "build", [&] { tree = new Quadtree(source, resolution); });
+    phase(resolution, pooled, "destroy", [&] { delete tree; });
+    phase(resolution, pooled, "build x4", [&] { tree = new Quadtree(source, resolution, 4); });
+
+    Quadtree* copy = NULL;
+    phase(resolution, pooled, "copy+prune", [&] {
+        copy = new Quadtree(*tree);
+        copy->prune(1000);
+    });
+    delete copy;
+    phase(resolution, pooled, "prune", [&] { tree->prune(1000); });
+    delete tree;
+}
+
+int main(int argc, char* argv[])
+{
+    std::vector<int> resolutions;
+    for (int i = 1; i < argc; i++)
+        resolutions.push_back(atoi(argv[i]));
+    if (resolutions.empty())
+        resolutions = {512, 1024, 2048};
+
+    PNG in;
+    in.readFromFile("in.png");
+
+    cout << std::fixed << std::setprecision(1);
+    cout << setw(6) << "res" << setw(8) << "nodes"
+         << setw(14) << "phase" << setw(12) << "calls" << setw(10) << "ms" << endl;
+    for (int resolution : resolutions) {
+        PNG source = scaledSource(in, resolution);
+        isolated([&] { run(source, resolution, false); });
+        isolated([&] { run(source, resolution, true); });
+    }
+    return 0;
+}
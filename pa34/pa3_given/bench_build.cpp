@@ -0,0 +1,69 @@
+/**
+ * @file bench_build.cpp
+ * Measures how Quadtree::buildTree scales with the number of threads,
+ * and checks that every multi-threaded tree matches the serial one.
+ *
+ * Usage: ./bench_build [resolution [maxThreads]]   (default: 2048, all cores)
+ */
+
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+#include "bench_util.h"
+#include "png.h"
+#include "quadtree.h"
+
+using std::cout;
+using std::endl;
+using std::setw;
+
+int main(int argc, char* argv[])
+{
+    int resolution = argc > 1 ? atoi(argv[1]) : 2048;
+    int maxThreads = argc > 2 ? atoi(argv[2])
+                              : (int) std::thread::hardware_concurrency();
+    if (maxThreads < 1)
+        maxThreads = 1;
+
+    PNG in;
+    in.readFromFile("in.png");
+    PNG source = scaledSource(in, resolution);
+
+    BenchTime start = benchNow();
+    Quadtree serial(source, resolution);
+    double serialMs = elapsedMs(start);
+    serial.prune(1000);
+    PNG expected = serial.decompress();
+    serial.buildTree(source, resolution);
+
+    cout << std::fixed << std::setprecision(2);
+    cout << "resolution " << resolution << ", serial build " << serialMs
+         << " ms" << endl;
+    cout << setw(8) << "threads" << setw(12) << "build(ms)"
+         << setw(10) << "speedup" << setw(8) << "same" << endl;
+
+    // 1, 2, 4, ... and finally maxThreads itself
+    std::vector<int> counts;
+    for (int threads = 1; threads < maxThreads; threads *= 2)
+        counts.push_back(threads);
+    counts.push_back(maxThreads);
+
+    for (int threads : counts) {
+        start = benchNow();
+        Quadtree tree(source, resolution, threads);
+        double ms = elapsedMs(start);
+
+        // same leaves, and same internal averages (exposed by pruning)
+        bool same = tree == serial;
+        tree.prune(1000);
+        same = same && tree.decompress() == expected;
+
+        cout << setw(8) << threads << setw(12) << ms
+             << setw(10) << serialMs / ms << setw(8) << (same ? "yes" : "NO")
+             << endl;
+    }
+    return 0;
+}
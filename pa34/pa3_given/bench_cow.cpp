@@ -0,0 +1,88 @@
+/**
+ * @file bench_cow.cpp
+ * Memory use of keeping an original tree plus ten differently pruned
+ * variants of it. "shared" takes each variant as a copy of the original
+ * (which shares all of its nodes) and prunes the copy, cloning only the
+ * paths the prune touches. "separate" gives every variant its own full
+ * set of nodes, as the old deep copy did, and prunes that.
+ *
+ * Usage: ./bench_cow [resolution ...]   (default: 512 1024 2048)
+ */
+
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <vector>
+
+#include "bench_util.h"
+#include "png.h"
+#include "quadtree.h"
+
+using std::cout;
+using std::endl;
+using std::setw;
+
+static int const tolerances[10] = {100, 200, 500, 1000, 2000, 5000,
+                                   10000, 20000, 50000, 100000};
+
+/**
+ * Builds the original and its ten variants, either way, and prints
+ * time(ms) final(KB) peak(KB).
+ */
+void run(PNG const& source, int resolution, bool shared)
+{
+    long before = residentKB();
+    resetPeak();
+    BenchTime start = benchNow();
+
+    Quadtree original(source, resolution);
+    std::vector<Quadtree> variants(10);
+    for (int i = 0; i < 10; i++) {
+        if (shared)
+            variants[i] = original;
+        else
+            variants[i].buildTree(source, resolution);
+        variants[i].prune(tolerances[i]);
+    }
+    double ms = elapsedMs(start);
+    long final = residentKB() - before;
+    long peak = peakKB() - before;
+
+    // every variant must still match a tree pruned on its own
+    bool same = true;
+    for (int i = 0; i < 10; i += 3) {
+        Quadtree check(source, resolution);
+        check.prune(tolerances[i]);
+        same = same && check == variants[i];
+    }
+    cout << setw(11) << ms << setw(12) << final << setw(11) << peak
+         << setw(6) << (same ? "yes" : "NO") << endl;
+}
+
+int main(int argc, char* argv[])
+{
+    std::vector<int> resolutions;
+    for (int i = 1; i < argc; i++)
+        resolutions.push_back(atoi(argv[i]));
+    if (resolutions.empty())
+        resolutions = {512, 1024, 2048};
+
+    PNG in;
+    in.readFromFile("in.png");
+
+    cout << std::fixed << std::setprecision(1);
+    cout << "1 original + 10 copies pruned at tolerance 100 .. 100000" << endl;
+    cout << setw(6) << "res" << setw(10) << "copies" << setw(11) << "time(ms)"
+         << setw(12) << "final(KB)" << setw(11) << "peak(KB)" << setw(6) << "same" << endl;
+
+    for (int resolution : resolutions) {
+        PNG source = scaledSource(in, resolution);
+        cout << setw(6) << resolution << setw(10) << "shared";
+        cout.flush();
+        isolated([&] { run(source, resolution, true); });
+        cout << setw(6) << resolution << setw(10) << "separate";
+        cout.flush();
+        isolated([&] { run(source, resolution, false); });
+    }
+    return 0;
+}
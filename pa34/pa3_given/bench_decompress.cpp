@@ -0,0 +1,112 @@
+/**
+ * @file bench_decompress.cpp
+ * Compares the ways of turning a Quadtree back into an image: the
+ * original per-pixel getPixel loop, the block-filling decompress(), and
+ * decompressToFile(), which streams bands of rows to disk. Reports time
+ * and the peak memory each path needs on top of the tree itself.
+ *
+ * Usage: ./bench_decompress [resolution ...]   (default: 1024 4096 8192)
+ * An unpruned pointer tree needs about 64 bytes per node, so 8192 needs
+ * roughly 6GB of memory just to build the tree being decompressed.
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <vector>
+
+#include "bench_util.h"
+#include "png.h"
+#include "quadtree.h"
+
+using std::cout;
+using std::endl;
+using std::setw;
+
+/**
+ * What decompress() did before: look every pixel up from the root.
+ */
+PNG perPixel(Quadtree const& tree, int resolution)
+{
+    PNG ret((size_t) resolution, (size_t) resolution);
+    for (int i = 0; i < resolution; i++)
+        for (int j = 0; j < resolution; j++)
+            *ret(i, j) = tree.getPixel(i, j);
+    return ret;
+}
+
+/**
+ * Builds a lightly pruned tree and runs every path on it.
+ */
+void run(PNG const& in, int resolution)
+{
+    Quadtree tree;
+    {
+        PNG source = scaledSource(in, resolution);
+        tree.buildTree(source, resolution);
+    }
+    tree.prune(100);
+
+    bool same = perPixel(tree, resolution) == tree.decompress();
+
+    BenchTime start = benchNow();
+    { PNG out = perPixel(tree, resolution); }
+    double pixelMs = elapsedMs(start);
+
+    start = benchNow();
+    { PNG out = tree.decompress(); }
+    double blockMs = elapsedMs(start);
+
+    // streamed first, so it cannot reuse memory the full frame freed
+    long base = residentKB();
+    resetPeak();
+    start = benchNow();
+    tree.decompressToFile("outBenchStream.png");
+    double streamMs = elapsedMs(start);
+    long streamKB = peakKB() - base;
+
+    base = residentKB();
+    resetPeak();
+    start = benchNow();
+    {
+        PNG out = tree.decompress();
+        out.writeToFile("outBenchFrame.png");
+    }
+    double frameMs = elapsedMs(start);
+    long frameKB = peakKB() - base;
+
+    // the streamed file must be byte-for-byte the same as the other one
+    PNG frame("outBenchFrame.png"), streamed("outBenchStream.png");
+    same = same && frame == streamed;
+    remove("outBenchFrame.png");
+    remove("outBenchStream.png");
+
+    cout << setw(6) << resolution << setw(15) << pixelMs << setw(16) << blockMs
+         << setw(15) << frameMs << setw(14) << streamMs
+         << setw(11) << frameKB << setw(11) << streamKB
+         << setw(6) << (same ? "yes" : "NO") << endl;
+}
+
+int main(int argc, char* argv[])
+{
+    std::vector<int> resolutions;
+    for (int i = 1; i < argc; i++)
+        resolutions.push_back(atoi(argv[i]));
+    if (resolutions.empty())
+        resolutions = {1024, 4096, 8192};
+
+    PNG in;
+    in.readFromFile("in.png");
+
+    cout << std::fixed << std::setprecision(1);
+    cout << "columns: per-pixel getPixel loop, decompress(), decompress() +"
+         << " writeToFile, decompressToFile; peak extra KB of the last two" << endl;
+    cout << setw(6) << "res" << setw(15) << "per-pixel(ms)" << setw(16) << "decompress(ms)"
+         << setw(15) << "+write(ms)" << setw(14) << "streamed(ms)"
+         << setw(11) << "frame(KB)" << setw(11) << "band(KB)" << setw(6) << "same" << endl;
+
+    for (int resolution : resolutions)
+        isolated([&] { run(in, resolution); });
+    return 0;
+}
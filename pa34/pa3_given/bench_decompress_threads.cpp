@@ -0,0 +1,70 @@
+/**
+ * @file bench_decompress_threads.cpp
+ * Measures how Quadtree::decompress scales with the number of threads,
+ * and checks that every multi-threaded image matches the serial one.
+ *
+ * Usage: ./bench_decompress_threads [resolution [maxThreads]]
+ *        (default: 4096, all cores)
+ */
+
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+#include "bench_util.h"
+#include "png.h"
+#include "quadtree.h"
+
+using std::cout;
+using std::endl;
+using std::setw;
+
+int main(int argc, char* argv[])
+{
+    int resolution = argc > 1 ? atoi(argv[1]) : 4096;
+    int maxThreads = argc > 2 ? atoi(argv[2])
+                              : (int) std::thread::hardware_concurrency();
+    if (maxThreads < 1)
+        maxThreads = 1;
+
+    PNG in;
+    in.readFromFile("in.png");
+    Quadtree tree;
+    {
+        PNG source = scaledSource(in, resolution);
+        tree.buildTree(source, resolution);
+    }
+    tree.prune(100);
+
+    // timed on a second run, like the threaded runs that follow it
+    PNG expected = tree.decompress();
+    BenchTime start = benchNow();
+    { PNG image = tree.decompress(); }
+    double serialMs = elapsedMs(start);
+
+    cout << std::fixed << std::setprecision(2);
+    cout << "resolution " << resolution << ", serial decompress " << serialMs
+         << " ms" << endl;
+    cout << setw(8) << "threads" << setw(16) << "decompress(ms)"
+         << setw(10) << "speedup" << setw(8) << "same" << endl;
+
+    // 1, 2, 4, ... and finally maxThreads itself
+    std::vector<int> counts;
+    for (int threads = 1; threads < maxThreads; threads *= 2)
+        counts.push_back(threads);
+    counts.push_back(maxThreads);
+
+    for (int threads : counts) {
+        start = benchNow();
+        PNG image = tree.decompress(threads);
+        double ms = elapsedMs(start);
+        bool same = image == expected;
+
+        cout << setw(8) << threads << setw(16) << ms
+             << setw(10) << serialMs / ms << setw(8) << (same ? "yes" : "NO")
+             << endl;
+    }
+    return 0;
+}
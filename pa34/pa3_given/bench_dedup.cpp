@@ -0,0 +1,135 @@
+/**
+ * @file bench_dedup.cpp
+ * Measures deduplicate on a screenshot-like image - flat desktop, windows
+ * with title bars and borders, lines of text drawn from a few glyphs on
+ * an 8 pixel grid - and on the scaled photo, each as built and pruned.
+ * Reported are the nodes in the tree, the distinct nodes left, the time
+ * deduplicate takes, the memory the tree holds before and after, and
+ * the time to decompress the shared tree against the plain one.
+ *
+ * Usage: ./bench_dedup [resolution ...]   (default: 512 1024 2048)
+ */
+
+#include <cstdlib>
+#include <iomanip>
+#include <malloc.h>
+#include <iostream>
+#include <vector>
+
+#include "bench_util.h"
+#include "png.h"
+#include "quadtree.h"
+
+using std::cout;
+using std::endl;
+using std::setw;
+
+/**
+ * Draws a desktop of the given size with a few overlapping windows full
+ * of text.
+ */
+PNG screenshot(int resolution)
+{
+    // 8x8 glyphs, one byte per row, most significant bit on the left
+    static const unsigned char glyphs[6][8] = {
+        {0x18, 0x24, 0x42, 0x7e, 0x42, 0x42, 0x42, 0x00},
+        {0x7c, 0x42, 0x7c, 0x42, 0x42, 0x42, 0x7c, 0x00},
+        {0x3c, 0x42, 0x40, 0x40, 0x40, 0x42, 0x3c, 0x00},
+        {0x7e, 0x40, 0x7c, 0x40, 0x40, 0x40, 0x7e, 0x00},
+        {0x42, 0x42, 0x42, 0x7e, 0x42, 0x42, 0x42, 0x00},
+        {0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00}};
+
+    PNG image(resolution, resolution);
+    for (int y = 0; y < resolution; y++)
+        for (int x = 0; x < resolution; x++)
+            *image(x, y) = RGBAPixel(58, 110, 165);
+
+    srand(221);
+    int side = resolution / 2;
+    for (int window = 0; window < 6; window++) {
+        int left = rand() % (resolution - side) / 8 * 8;
+        int top = rand() % (resolution - side) / 8 * 8;
+        for (int y = top; y < top + side; y++) {
+            for (int x = left; x < left + side; x++) {
+                RGBAPixel color(240, 240, 240);
+                if (x == left || y == top || x == left + side - 1 || y == top + side - 1)
+                    color = RGBAPixel(90, 90, 90);
+                else if (y < top + 24)
+                    color = RGBAPixel(0, 84, 227);
+                else if (y >= top + 32 && x >= left + 8 && x < left + side - 8) {
+                    // the glyph on this cell of the window's text grid
+                    int row = (y - top) / 8, column = (x - left) / 8;
+                    unsigned char const* glyph = glyphs[(row * 7 + column * column) % 6];
+                    if (glyph[(y - top) % 8] & (0x80 >> (x - left) % 8))
+                        color = RGBAPixel(20, 20, 20);
+                }
+                *image(x, y) = color;
+            }
+        }
+    }
+    return image;
+}
+
+/**
+ * Deduplicates one tree and prints its row.
+ */
+void run(PNG const& source, char const* name, int tolerance)
+{
+    int resolution = (int) source.width();
+    long before = residentKB();
+    Quadtree tree(source);
+    if (tolerance > 0)
+        tree.prune(tolerance);
+    malloc_trim(0);
+    long plainKB = residentKB() - before;
+
+    BenchTime start = benchNow();
+    PNG plainImage = tree.decompress();
+    double plainMs = elapsedMs(start);
+
+    // the decoded image stays, so measure what deduplicating changes
+    long beforeShared = residentKB();
+    start = benchNow();
+    Quadtree::SharingResult shared = tree.deduplicate();
+    double dedupMs = elapsedMs(start);
+    // the interning table is gone; hand its memory back before measuring
+    malloc_trim(0);
+    long sharedKB = plainKB + residentKB() - beforeShared;
+
+    start = benchNow();
+    PNG sharedImage = tree.decompress();
+    double sharedMs = elapsedMs(start);
+    if (!(sharedImage == plainImage))
+        cout << "the shared tree decompresses differently" << endl;
+
+    cout << setw(6) << resolution << setw(12) << name << setw(6) << tolerance
+         << setw(10) << shared.nodes << setw(10) << shared.distinct
+         << setw(8) << 100.0 * shared.distinct / shared.nodes << setw(9) << dedupMs
+         << setw(10) << plainKB << setw(10) << sharedKB
+         << setw(10) << plainMs << setw(11) << sharedMs << endl;
+}
+
+int main(int argc, char* argv[])
+{
+    std::vector<int> resolutions;
+    for (int i = 1; i < argc; i++)
+        resolutions.push_back(atoi(argv[i]));
+    if (resolutions.empty())
+        resolutions = {512, 1024, 2048};
+
+    PNG in;
+    in.readFromFile("in.png");
+
+    cout << std::fixed << std::setprecision(1);
+    cout << setw(6) << "res" << setw(12) << "input" << setw(6) << "prune"
+         << setw(10) << "nodes" << setw(10) << "distinct" << setw(8) << "kept%"
+         << setw(9) << "dedup ms" << setw(10) << "plain KB" << setw(10) << "shared KB"
+         << setw(10) << "plain ms" << setw(11) << "shared ms" << endl;
+    for (int resolution : resolutions) {
+        for (int tolerance : {0, 1000}) {
+            isolated([&] { run(screenshot(resolution), "screenshot", tolerance); });
+            isolated([&] { run(scaledSource(in, resolution), "photo", tolerance); });
+        }
+    }
+    return 0;
+}
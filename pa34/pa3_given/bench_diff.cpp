@@ -0,0 +1,92 @@
+/**
+ * @file bench_diff.cpp
+ * Measures diffing consecutive frames. The second frame is the first
+ * with a square of a given side inverted in the middle. Reported are
+ * comparing the two decoded frames with PNG::operator== (which must
+ * read every pixel when nothing changed), diffing the frames' trees,
+ * patching a copy of the first tree with the delta, and building the
+ * second tree from scratch, which is what patching replaces; also the
+ * delta's nodes and regions.
+ *
+ * Usage: ./bench_diff [resolution ...]   (default: 512 1024 2048)
+ */
+
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <vector>
+
+#include "bench_util.h"
+#include "png.h"
+#include "quadtree.h"
+
+using std::cout;
+using std::endl;
+using std::setw;
+
+/**
+ * Diffs a frame against itself with a square changed and prints its row.
+ */
+void run(PNG const& frame, Quadtree const& tree, int resolution, int side)
+{
+    PNG next(frame);
+    int start = (resolution - side) / 2;
+    for (int y = start; y < start + side; y++) {
+        for (int x = start; x < start + side; x++) {
+            RGBAPixel* pixel = next(x, y);
+            pixel->red = 255 - pixel->red;
+            pixel->green = 255 - pixel->green;
+            pixel->blue = 255 - pixel->blue;
+        }
+    }
+    Quadtree nextTree(next);
+
+    BenchTime begin = benchNow();
+    bool same = frame == next;
+    double compareMs = elapsedMs(begin);
+
+    begin = benchNow();
+    Quadtree::Delta delta = tree.diff(nextTree);
+    double diffMs = elapsedMs(begin);
+
+    Quadtree patched(tree);
+    begin = benchNow();
+    patched.patch(delta);
+    double patchMs = elapsedMs(begin);
+
+    begin = benchNow();
+    Quadtree rebuilt(next);
+    double buildMs = elapsedMs(begin);
+
+    if (same != delta.empty() || !patched.diff(nextTree).empty())
+        cout << "patched tree differs from the next frame's" << endl;
+    cout << setw(6) << resolution << setw(7) << side << setw(10) << compareMs
+         << setw(10) << diffMs << setw(10) << patchMs << setw(10) << buildMs
+         << setw(10) << delta.nodes() << setw(9) << delta.regions().size() << endl;
+}
+
+int main(int argc, char* argv[])
+{
+    std::vector<int> resolutions;
+    for (int i = 1; i < argc; i++)
+        resolutions.push_back(atoi(argv[i]));
+    if (resolutions.empty())
+        resolutions = {512, 1024, 2048};
+
+    PNG in;
+    in.readFromFile("in.png");
+
+    cout << std::fixed << std::setprecision(2);
+    cout << setw(6) << "res" << setw(7) << "side" << setw(10) << "png==ms"
+         << setw(10) << "diff ms" << setw(10) << "patch ms" << setw(10) << "build ms"
+         << setw(10) << "nodes" << setw(9) << "regions" << endl;
+    for (int resolution : resolutions) {
+        isolated([&] {
+            PNG frame = scaledSource(in, resolution);
+            Quadtree tree(frame);
+            for (int side : {0, 8, 64, resolution / 4})
+                run(frame, tree, resolution, side);
+        });
+    }
+    return 0;
+}
@@ -0,0 +1,78 @@
+/**
+ * @file bench_orient.cpp
+ * Measures the lazy orientation: how long a rotation or flip takes, how
+ * long materialize() takes to bake one into the nodes (what every
+ * clockwiseRotate used to cost), and what an orientation adds to
+ * decompress.
+ *
+ * Usage: ./bench_orient [resolution ...]   (default: 512 1024 2048)
+ */
+
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <vector>
+
+#include "bench_util.h"
+#include "png.h"
+#include "quadtree.h"
+
+using std::cout;
+using std::endl;
+using std::setw;
+
+/**
+ * Times the orientation operations on one tree and prints a row.
+ */
+void run(PNG const& source, int resolution)
+{
+    Quadtree tree(source, resolution);
+
+    BenchTime start = benchNow();
+    PNG upright = tree.decompress();
+    double plainMs = elapsedMs(start);
+
+    start = benchNow();
+    for (int i = 0; i < 1000; i++) {
+        tree.clockwiseRotate();
+        tree.flipHorizontal();
+    }
+    tree.clockwiseRotate();
+    tree.flipVertical();
+    double turnNs = elapsedMs(start) * 1e6 / 2002;
+
+    start = benchNow();
+    PNG oriented = tree.decompress();
+    double orientedMs = elapsedMs(start);
+
+    start = benchNow();
+    tree.materialize();
+    double materializeMs = elapsedMs(start);
+
+    bool same = tree.decompress() == oriented && !(oriented == upright);
+    cout << setw(6) << resolution << setw(10) << turnNs << setw(17) << materializeMs
+         << setw(16) << plainMs << setw(15) << orientedMs
+         << setw(6) << (same ? "yes" : "NO") << endl;
+}
+
+int main(int argc, char* argv[])
+{
+    std::vector<int> resolutions;
+    for (int i = 1; i < argc; i++)
+        resolutions.push_back(atoi(argv[i]));
+    if (resolutions.empty())
+        resolutions = {512, 1024, 2048};
+
+    PNG in;
+    in.readFromFile("in.png");
+
+    cout << std::fixed << std::setprecision(2);
+    cout << setw(6) << "res" << setw(10) << "turn(ns)" << setw(17) << "materialize(ms)"
+         << setw(16) << "decompress(ms)" << setw(15) << "oriented(ms)" << setw(6) << "same" << endl;
+
+    for (int resolution : resolutions) {
+        PNG source = scaledSource(in, resolution);
+        isolated([&] { run(source, resolution); });
+    }
+    return 0;
+}
@@ -0,0 +1,117 @@
+/**
+ * @file bench_progressive.cpp
+ * Measures progressive streaming. A tree's progressive stream is fed to a
+ * ProgressiveDecoder in network-sized chunks over a simulated link, and
+ * the time until a preview of a given depth can be shown (link time for
+ * the bytes it needs, plus decode and render) is compared with sending
+ * the quadtree file and waiting for readFromFile and decompress().
+ *
+ * Usage: ./bench_progressive [resolution ...]   (default: 512 1024 2048)
+ */
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <vector>
+
+#include "bench_util.h"
+#include "png.h"
+#include "quadtree.h"
+#include "quadtreestream.h"
+
+using std::cout;
+using std::endl;
+using std::setw;
+
+static const double linkBytesPerMs = 10e6 / 8 / 1000; // 10 Mbit/s
+static const size_t chunkBytes = 16 * 1024;
+
+/**
+ * Streams one tree and prints a row per preview depth, then the totals.
+ */
+void run(Quadtree const& tree, char const* label, int resolution)
+{
+    std::vector<uint8_t> stream = tree.encodeProgressive();
+
+    // a preview is shown as soon as the chunk completing its level arrives
+    int depths[4] = {4, 6, 8, -1};
+    ProgressiveDecoder decoder;
+    double cpuMs = 0;
+    size_t sent = 0;
+    int next = 0;
+    PNG last;
+    while (sent < stream.size()) {
+        size_t length = std::min(chunkBytes, stream.size() - sent);
+        BenchTime start = benchNow();
+        decoder.feed(stream.data() + sent, length);
+        cpuMs += elapsedMs(start);
+        sent += length;
+
+        while (next < 4 && (depths[next] < 0 ? decoder.finished()
+                                             : decoder.levels() > depths[next])) {
+            start = benchNow();
+            last = depths[next] < 0 ? decoder.render() : decoder.render(depths[next]);
+            cpuMs += elapsedMs(start);
+            double linkMs = sent / linkBytesPerMs;
+            cout << setw(6) << resolution << setw(8) << label << setw(8);
+            if (depths[next] < 0)
+                cout << "all";
+            else
+                cout << depths[next];
+            cout << setw(10) << sent / 1024 << "K" << setw(10) << linkMs
+                 << setw(10) << cpuMs << setw(10) << linkMs + cpuMs << endl;
+            next++;
+        }
+    }
+
+    // the whole tree the usual way: send the file, load it, decompress
+    char const* fileName = "/tmp/bench_progressive.qtree";
+    tree.writeToFile(fileName);
+    FILE* fp = fopen(fileName, "rb");
+    fseek(fp, 0, SEEK_END);
+    long fileBytes = ftell(fp);
+    fclose(fp);
+    BenchTime start = benchNow();
+    Quadtree loaded;
+    loaded.readFromFile(fileName);
+    PNG image = loaded.decompress();
+    double fileCpuMs = elapsedMs(start);
+    remove(fileName);
+    double fileLinkMs = fileBytes / linkBytesPerMs;
+    cout << setw(6) << resolution << setw(8) << label << setw(8) << "file"
+         << setw(10) << fileBytes / 1024 << "K" << setw(10) << fileLinkMs
+         << setw(10) << fileCpuMs << setw(10) << fileLinkMs + fileCpuMs
+         << (last == image ? "" : "   (progressive render DIFFERS)") << endl;
+}
+
+int main(int argc, char* argv[])
+{
+    std::vector<int> resolutions;
+    for (int i = 1; i < argc; i++)
+        resolutions.push_back(atoi(argv[i]));
+    if (resolutions.empty())
+        resolutions = {512, 1024, 2048};
+
+    PNG in;
+    in.readFromFile("in.png");
+
+    cout << std::fixed << std::setprecision(2);
+    cout << "link " << linkBytesPerMs * 8 / 1000 << " Mbit/s, chunks of "
+         << chunkBytes / 1024 << "K" << endl;
+    cout << setw(6) << "res" << setw(8) << "tree" << setw(8) << "depth"
+         << setw(11) << "bytes" << setw(10) << "link ms" << setw(10) << "cpu ms"
+         << setw(10) << "total ms" << endl;
+    for (int resolution : resolutions) {
+        PNG source = scaledSource(in, resolution);
+        isolated([&] {
+            Quadtree full(source, resolution);
+            run(full, "full", resolution);
+            Quadtree pruned(full);
+            pruned.prune(pruned.idealPrune(resolution * resolution / 64));
+            run(pruned, "pruned", resolution);
+        });
+    }
+    return 0;
+}
@@ -0,0 +1,90 @@
+/**
+ * @file bench_quadtree.cpp
+ * Compares the pointer-based Quadtree with the array-backed
+ * ArrayQuadtree: build, decompress and copy time, and resident memory.
+ *
+ * Usage: ./bench_quadtree [resolution ...]   (default: 512 1024 2048)
+ */
+
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <vector>
+
+#include "arrayquadtree.h"
+#include "bench_util.h"
+#include "png.h"
+#include "quadtree.h"
+
+using std::cout;
+using std::endl;
+using std::setw;
+
+/**
+ * Times one engine at one resolution and prints a row of the table.
+ */
+template <typename Tree>
+void run(char const* name, PNG const& source, int resolution)
+{
+    long before = residentKB();
+
+    BenchTime start = benchNow();
+    Tree tree(source, resolution);
+    double build = elapsedMs(start);
+    long rss = residentKB() - before;
+
+    start = benchNow();
+    PNG out = tree.decompress();
+    double decompress = elapsedMs(start);
+
+    start = benchNow();
+    Tree copy(tree);
+    double copied = elapsedMs(start);
+
+    cout << setw(8) << name << setw(7) << resolution
+         << setw(12) << build << setw(16) << decompress
+         << setw(11) << copied << setw(11) << rss << endl;
+}
+
+/**
+ * Checks that both engines agree on the image, pruned and rotated.
+ */
+void verify(PNG const& source, int resolution)
+{
+    Quadtree pointerTree(source, resolution);
+    ArrayQuadtree arrayTree(source, resolution);
+    pointerTree.prune(1000);
+    arrayTree.prune(1000);
+    pointerTree.clockwiseRotate();
+    arrayTree.clockwiseRotate();
+    if (!(pointerTree.decompress() == arrayTree.decompress())
+        || pointerTree.pruneSize(100) != arrayTree.pruneSize(100)
+        || pointerTree.idealPrune(500) != arrayTree.idealPrune(500))
+        cout << "MISMATCH at resolution " << resolution << endl;
+}
+
+int main(int argc, char* argv[])
+{
+    std::vector<int> resolutions;
+    for (int i = 1; i < argc; i++)
+        resolutions.push_back(atoi(argv[i]));
+    if (resolutions.empty())
+        resolutions = {512, 1024, 2048};
+
+    PNG in;
+    in.readFromFile("in.png");
+
+    cout << std::fixed << std::setprecision(1);
+    cout << setw(8) << "engine" << setw(7) << "res"
+         << setw(12) << "build(ms)" << setw(16) << "decompress(ms)"
+         << setw(11) << "copy(ms)" << setw(11) << "tree(KB)" << endl;
+
+    for (int resolution : resolutions) {
+        PNG source = scaledSource(in, resolution);
+        isolated([&] { run<Quadtree>("pointer", source, resolution); });
+        isolated([&] { run<ArrayQuadtree>("array", source, resolution); });
+
+        isolated([&] { verify(source, resolution); });
+    }
+    return 0;
+}
@@ -0,0 +1,165 @@
+/**
+ * @file bench_quadtree_kernels.cpp
+ * Measures the PixelKernels with each instruction set this machine
+ * supports: the raw kernels over a whole image, then the Quadtree and
+ * ArrayQuadtree builds that use them, and the integer colour distance
+ * against the pow() one Quadtree::diff used to compute. Speedups are
+ * against the scalar kernels.
+ *
+ * Usage: ./bench_quadtree_kernels [resolution ...]   (default: 1024 2048)
+ */
+
+#include <cmath>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <vector>
+
+#include "arrayquadtree.h"
+#include "bench_util.h"
+#include "pixelkernels.h"
+#include "png.h"
+#include "quadtree.h"
+
+using std::cout;
+using std::endl;
+using std::setw;
+
+static PixelKernels::Level const levels[3] = {PixelKernels::SCALAR, PixelKernels::SSE2,
+                                              PixelKernels::AVX2};
+
+/**
+ * The old Quadtree::diff, through doubles.
+ */
+static int powDistance(RGBAPixel const& first, RGBAPixel const& second)
+{
+    int red = pow(second.red - first.red, 2);
+    int green = pow(second.green - first.green, 2);
+    int blue = pow(second.blue - first.blue, 2);
+    return red + green + blue;
+}
+
+/**
+ * Runs every kernel over the whole image ten times and prints one row per
+ * kernel; results are checked against the scalar kernels.
+ */
+void kernels(PixelKernels::Level level, PNG const& image, double scalarMs[3])
+{
+    size_t width = image.width(), height = image.height();
+    size_t blocks = width / 2 * (height / 2);
+    std::vector<RGBAPixel> averages(blocks), groups(width * height / 4);
+    std::vector<int> distances(blocks);
+    RGBAPixel const* pixels = image(0, 0);
+
+    BenchTime start = benchNow();
+    for (int pass = 0; pass < 10; pass++)
+        for (size_t y = 0; y < height; y += 2)
+            PixelKernels::averageQuads(image(0, y), image(0, y + 1),
+                                       &averages[y / 2 * (width / 2)], width / 2);
+    double quadsMs = elapsedMs(start) / 10;
+
+    start = benchNow();
+    for (int pass = 0; pass < 10; pass++)
+        PixelKernels::averageGroups(pixels, groups.data(), groups.size());
+    double groupsMs = elapsedMs(start) / 10;
+
+    start = benchNow();
+    for (int pass = 0; pass < 10; pass++)
+        for (size_t y = 0; y < height; y += 2)
+            PixelKernels::quadDistances(image(0, y), image(0, y + 1),
+                                        &averages[y / 2 * (width / 2)],
+                                        &distances[y / 2 * (width / 2)], width / 2);
+    double distancesMs = elapsedMs(start) / 10;
+
+    // the scalar results, for checking the others
+    static std::vector<RGBAPixel> scalarAverages, scalarGroups;
+    static std::vector<int> scalarDistances;
+    if (level == PixelKernels::SCALAR) {
+        scalarAverages = averages;
+        scalarGroups = groups;
+        scalarDistances = distances;
+        scalarMs[0] = quadsMs;
+        scalarMs[1] = groupsMs;
+        scalarMs[2] = distancesMs;
+    }
+    char const* names[3] = {"averageQuads", "averageGroups", "quadDistances"};
+    double ms[3] = {quadsMs, groupsMs, distancesMs};
+    bool same[3] = {averages == scalarAverages, groups == scalarGroups,
+                    distances == scalarDistances};
+    double megapixels = width * height / 1e6;
+    for (int k = 0; k < 3; k++)
+        cout << setw(8) << PixelKernels::name(level) << setw(15) << names[k]
+             << setw(10) << ms[k] << setw(10) << megapixels / ms[k] * 1000
+             << setw(10) << scalarMs[k] / ms[k] << setw(6) << (same[k] ? "yes" : "NO") << endl;
+}
+
+/**
+ * Times both builds with the kernels at one level and prints a row.
+ */
+void builds(PixelKernels::Level level, PNG const& source, int resolution, double scalarMs[2])
+{
+    BenchTime start = benchNow();
+    Quadtree tree(source, resolution);
+    double pointerMs = elapsedMs(start);
+    start = benchNow();
+    ArrayQuadtree array(source, resolution);
+    double arrayMs = elapsedMs(start);
+    if (level == PixelKernels::SCALAR) {
+        scalarMs[0] = pointerMs;
+        scalarMs[1] = arrayMs;
+    }
+    cout << setw(6) << resolution << setw(8) << PixelKernels::name(level)
+         << setw(15) << pointerMs << setw(9) << scalarMs[0] / pointerMs
+         << setw(13) << arrayMs << setw(9) << scalarMs[1] / arrayMs << endl;
+}
+
+int main(int argc, char* argv[])
+{
+    std::vector<int> resolutions;
+    for (int i = 1; i < argc; i++)
+        resolutions.push_back(atoi(argv[i]));
+    if (resolutions.empty())
+        resolutions = {1024, 2048};
+
+    PNG in;
+    in.readFromFile("in.png");
+    PixelKernels::Level best = PixelKernels::level();
+
+    cout << std::fixed << std::setprecision(2);
+    cout << "kernels over a " << resolutions.back() << "x" << resolutions.back() << " image" << endl;
+    cout << setw(8) << "isa" << setw(15) << "kernel" << setw(10) << "ms"
+         << setw(10) << "MP/s" << setw(10) << "speedup" << setw(6) << "same" << endl;
+    PNG image = scaledSource(in, resolutions.back());
+    double scalarKernelMs[3] = {0, 0, 0};
+    for (PixelKernels::Level level : levels)
+        if (PixelKernels::select(level))
+            kernels(level, image, scalarKernelMs);
+
+    cout << endl << setw(6) << "res" << setw(8) << "isa" << setw(15) << "Quadtree(ms)"
+         << setw(9) << "speedup" << setw(13) << "Array(ms)" << setw(9) << "speedup" << endl;
+    for (int resolution : resolutions) {
+        PNG source = scaledSource(in, resolution);
+        double scalarBuildMs[2] = {0, 0};
+        for (PixelKernels::Level level : levels)
+            if (PixelKernels::select(level))
+                builds(level, source, resolution, scalarBuildMs);
+    }
+    PixelKernels::select(best);
+
+    // colour distance, pow against integer multiplies
+    RGBAPixel const* pixels = image(0, 0);
+    size_t count = image.width() * image.height() - 1;
+    long powSum = 0, intSum = 0;
+    BenchTime start = benchNow();
+    for (size_t i = 0; i < count; i++)
+        powSum += powDistance(pixels[i], pixels[i + 1]);
+    double powMs = elapsedMs(start);
+    start = benchNow();
+    for (size_t i = 0; i < count; i++)
+        intSum += PixelKernels::distance(pixels[i], pixels[i + 1]);
+    double intMs = elapsedMs(start);
+    cout << endl << "distance over " << count << " pixel pairs: pow " << powMs
+         << " ms, integer " << intMs << " ms, speedup " << powMs / intMs
+         << (powSum == intSum ? "" : " (MISMATCH)") << endl;
+    return 0;
+}
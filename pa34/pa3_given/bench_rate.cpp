@@ -0,0 +1,115 @@
+/**
+ * @file bench_rate.cpp
+ * Measures rate-controlled compression. For byte budgets that are a
+ * fraction of the lossless file, compressToSize is compared with a plain
+ * prune at the tolerance idealPrune picks for the same number of leaves:
+ * time, leaves, file size and PSNR. Then compressToQuality is run for a
+ * few PSNR floors.
+ *
+ * Usage: ./bench_rate [resolution ...]   (default: 512 1024 2048)
+ */
+
+#include <cmath>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <vector>
+
+#include "bench_util.h"
+#include "png.h"
+#include "quadtree.h"
+
+using std::cout;
+using std::endl;
+using std::setw;
+
+/**
+ * @return The PSNR of image against reference, over RGB, in dB
+ */
+static double measurePsnr(PNG const& reference, PNG const& image)
+{
+    double error = 0;
+    for (size_t y = 0; y < reference.height(); y++) {
+        for (size_t x = 0; x < reference.width(); x++) {
+            RGBAPixel const* a = reference(x, y);
+            RGBAPixel const* b = image(x, y);
+            error += (a->red - b->red) * (a->red - b->red)
+                   + (a->green - b->green) * (a->green - b->green)
+                   + (a->blue - b->blue) * (a->blue - b->blue);
+        }
+    }
+    double samples = 3.0 * reference.width() * reference.height();
+    return error == 0 ? INFINITY : 10 * log10(255.0 * 255.0 * samples / error);
+}
+
+/**
+ * Runs every budget and floor on one tree and prints the rows.
+ */
+void run(PNG const& source, int resolution)
+{
+    Quadtree full(source, resolution);
+    PNG reference = full.decompress();
+
+    // budgets are fractions of the lossless size: what is left after
+    // collapsing only blocks of one colour
+    Quadtree lossless(full);
+    size_t losslessBytes = lossless.compressToQuality(INFINITY).bytes;
+
+    double fractions[4] = {0.50, 0.20, 0.10, 0.05};
+    for (double fraction : fractions) {
+        size_t budget = (size_t) (losslessBytes * fraction);
+
+        Quadtree rated(full);
+        BenchTime start = benchNow();
+        Quadtree::CompressionResult result = rated.compressToSize(budget);
+        double ratedMs = elapsedMs(start);
+
+        // the smallest tolerance leaving no more leaves than that
+        Quadtree pruned(full);
+        start = benchNow();
+        pruned.prune(pruned.idealPrune(result.leaves));
+        double prunedMs = elapsedMs(start);
+        int prunedLeaves = pruned.pruneSize(-1);
+
+        cout << setw(6) << resolution << setw(9) << budget / 1024 << "K"
+             << setw(10) << "size" << setw(10) << ratedMs << setw(9) << result.leaves
+             << setw(8) << result.bytes / 1024 << "K" << setw(9) << result.psnr
+             << "   | prune" << setw(10) << prunedMs << setw(9) << prunedLeaves
+             << setw(9) << measurePsnr(reference, pruned.decompress()) << endl;
+    }
+
+    double floors[3] = {40, 35, 30};
+    for (double floor : floors) {
+        Quadtree rated(full);
+        BenchTime start = benchNow();
+        Quadtree::CompressionResult result = rated.compressToQuality(floor);
+        double ratedMs = elapsedMs(start);
+        bool exact = fabs(measurePsnr(reference, rated.decompress()) - result.psnr) < 1e-6;
+        cout << setw(6) << resolution << setw(7) << floor << "dB"
+             << setw(10) << "quality" << setw(10) << ratedMs << setw(9) << result.leaves
+             << setw(8) << result.bytes / 1024 << "K" << setw(9) << result.psnr
+             << (exact ? "" : "   (reported PSNR is WRONG)") << endl;
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    std::vector<int> resolutions;
+    for (int i = 1; i < argc; i++)
+        resolutions.push_back(atoi(argv[i]));
+    if (resolutions.empty())
+        resolutions = {512, 1024, 2048};
+
+    PNG in;
+    in.readFromFile("in.png");
+
+    cout << std::fixed << std::setprecision(2);
+    cout << setw(6) << "res" << setw(10) << "target" << setw(10) << "mode"
+         << setw(10) << "ms" << setw(9) << "leaves" << setw(9) << "bytes" << setw(9) << "PSNR"
+         << "   | prune(idealPrune(leaves)): ms, leaves, PSNR" << endl;
+    for (int resolution : resolutions) {
+        PNG source = scaledSource(in, resolution);
+        isolated([&] { run(source, resolution); });
+    }
+    return 0;
+}
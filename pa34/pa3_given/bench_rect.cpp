@@ -0,0 +1,97 @@
+/**
+ * @file bench_rect.cpp
+ * Compares building a Quadtree straight from a rectangular image, whose
+ * border quadrants are partial, with the old workaround of padding the
+ * image out to the next power of two square: build and decompress time,
+ * and the memory the tree takes.
+ *
+ * Usage: ./bench_rect [WxH ...]   (default: 1000x600 1920x1080 2500x1400)
+ */
+
+#include <cstdio>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "bench_util.h"
+#include "png.h"
+#include "quadtree.h"
+
+using std::cout;
+using std::endl;
+using std::setw;
+
+/**
+ * Builds and decompresses one tree, printing build(ms) decompress(ms)
+ * tree(KB). The padded variant builds on a white square of side grid and
+ * crops the decompressed result back down, as callers had to.
+ */
+void run(PNG const& source, int grid, bool padded)
+{
+    long before = residentKB();
+    BenchTime start = benchNow();
+    Quadtree tree;
+    if (padded) {
+        PNG square((size_t) grid, (size_t) grid);
+        for (size_t y = 0; y < source.height(); y++)
+            for (size_t x = 0; x < source.width(); x++)
+                *square(x, y) = *source(x, y);
+        tree.buildTree(square, grid);
+    }
+    else
+        tree.buildTree(source);
+    double build = elapsedMs(start);
+    long rss = residentKB() - before;
+
+    start = benchNow();
+    PNG out = tree.decompress();
+    if (padded) {
+        PNG cropped(source.width(), source.height());
+        for (size_t y = 0; y < source.height(); y++)
+            for (size_t x = 0; x < source.width(); x++)
+                *cropped(x, y) = *out(x, y);
+        out = cropped;
+    }
+    double decompress = elapsedMs(start);
+
+    cout << setw(12) << build << setw(16) << decompress << setw(11) << rss
+         << setw(6) << (out == source ? "yes" : "NO") << endl;
+}
+
+int main(int argc, char* argv[])
+{
+    std::vector<std::string> sizes;
+    for (int i = 1; i < argc; i++)
+        sizes.push_back(argv[i]);
+    if (sizes.empty())
+        sizes = {"1000x600", "1920x1080", "2500x1400"};
+
+    PNG in;
+    in.readFromFile("in.png");
+
+    cout << std::fixed << std::setprecision(1);
+    cout << setw(10) << "size" << setw(6) << "grid" << setw(8) << "layout"
+         << setw(12) << "build(ms)" << setw(16) << "decompress(ms)"
+         << setw(11) << "tree(KB)" << setw(6) << "same" << endl;
+
+    for (std::string const& size : sizes) {
+        int width = 0, height = 0;
+        if (sscanf(size.c_str(), "%dx%d", &width, &height) != 2 || width < 1 || height < 1) {
+            cout << "bad size " << size << endl;
+            continue;
+        }
+        int grid = 1;
+        while (grid < width || grid < height)
+            grid *= 2;
+
+        PNG source = scaledSource(in, width, height);
+        cout << setw(10) << size << setw(6) << grid << setw(8) << "native";
+        cout.flush();
+        isolated([&] { run(source, grid, false); });
+        cout << setw(10) << size << setw(6) << grid << setw(8) << "padded";
+        cout.flush();
+        isolated([&] { run(source, grid, true); });
+    }
+    return 0;
+}
@@ -0,0 +1,107 @@
+/**
+ * @file bench_region.cpp
+ * Measures the batch queries against a loop of getPixel calls, each of
+ * which descends from the root: getRegion on random 256 by 256 tiles, and
+ * getPixels on a million random points, on a full and a pruned tree.
+ *
+ * Usage: ./bench_region [resolution ...]   (default: 512 1024 2048)
+ */
+
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <utility>
+#include <vector>
+
+#include "bench_util.h"
+#include "png.h"
+#include "quadtree.h"
+
+using std::cout;
+using std::endl;
+using std::setw;
+
+static int const tileSide = 256;
+static int const tileCount = 64;
+static int const pointCount = 1000000;
+
+/**
+ * Runs both queries each way on one tree and prints two rows.
+ */
+void run(Quadtree const& tree, int resolution, char const* label)
+{
+    srand(221);
+    std::vector<std::pair<int, int> > corners, points;
+    for (int i = 0; i < tileCount; i++)
+        corners.push_back(std::make_pair(rand() % (resolution - tileSide + 1),
+                                         rand() % (resolution - tileSide + 1)));
+    for (int i = 0; i < pointCount; i++)
+        points.push_back(std::make_pair(rand() % resolution, rand() % resolution));
+
+    // tiles
+    bool same = true;
+    BenchTime start = benchNow();
+    std::vector<PNG> loops;
+    for (size_t t = 0; t < corners.size(); t++) {
+        PNG tile(tileSide, tileSide);
+        for (int j = 0; j < tileSide; j++)
+            for (int i = 0; i < tileSide; i++)
+                *tile(i, j) = tree.getPixel(corners[t].first + i, corners[t].second + j);
+        loops.push_back(tile);
+    }
+    double loopMs = elapsedMs(start);
+    start = benchNow();
+    std::vector<PNG> regions;
+    for (size_t t = 0; t < corners.size(); t++)
+        regions.push_back(tree.getRegion(corners[t].first, corners[t].second, tileSide, tileSide));
+    double batchMs = elapsedMs(start);
+    for (size_t t = 0; t < corners.size(); t++)
+        same = same && loops[t] == regions[t];
+    cout << setw(6) << resolution << setw(8) << label << setw(10) << "region"
+         << setw(14) << loopMs << setw(13) << batchMs << setw(10) << loopMs / batchMs
+         << setw(6) << (same ? "yes" : "NO") << endl;
+
+    // points
+    start = benchNow();
+    std::vector<RGBAPixel> loop(points.size());
+    for (size_t p = 0; p < points.size(); p++)
+        loop[p] = tree.getPixel(points[p].first, points[p].second);
+    loopMs = elapsedMs(start);
+    start = benchNow();
+    std::vector<RGBAPixel> batch = tree.getPixels(points);
+    batchMs = elapsedMs(start);
+    same = loop == batch;
+    cout << setw(6) << resolution << setw(8) << label << setw(10) << "points"
+         << setw(14) << loopMs << setw(13) << batchMs << setw(10) << loopMs / batchMs
+         << setw(6) << (same ? "yes" : "NO") << endl;
+}
+
+int main(int argc, char* argv[])
+{
+    std::vector<int> resolutions;
+    for (int i = 1; i < argc; i++)
+        resolutions.push_back(atoi(argv[i]));
+    if (resolutions.empty())
+        resolutions = {512, 1024, 2048};
+
+    PNG in;
+    in.readFromFile("in.png");
+
+    cout << std::fixed << std::setprecision(1);
+    cout << tileCount << " tiles of " << tileSide << "x" << tileSide << ", "
+         << pointCount << " random points" << endl;
+    cout << setw(6) << "res" << setw(8) << "tree" << setw(10) << "query"
+         << setw(14) << "getPixel(ms)" << setw(13) << "batch(ms)" << setw(10) << "speedup"
+         << setw(6) << "same" << endl;
+
+    for (int resolution : resolutions) {
+        PNG source = scaledSource(in, resolution);
+        isolated([&] {
+            Quadtree tree(source, resolution);
+            run(tree, resolution, "full");
+            tree.prune(1000);
+            run(tree, resolution, "pruned");
+        });
+    }
+    return 0;
+}
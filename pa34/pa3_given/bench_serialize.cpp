@@ -0,0 +1,121 @@
+/**
+ * @file bench_serialize.cpp
+ * Compares warm-starting a pruned tree from its saved quadtree file with
+ * the only option there used to be: decoding the decompressed PNG and
+ * building (and pruning) the tree again. Also checks that the loaded
+ * trees are the trees that were saved.
+ *
+ * Usage: ./bench_serialize [resolution ...]   (default: 512 1024 2048)
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <vector>
+
+#include "arrayquadtree.h"
+#include "bench_util.h"
+#include "png.h"
+#include "quadtree.h"
+
+using std::cout;
+using std::endl;
+using std::setw;
+
+/**
+ * @return The size of a file in kilobytes
+ */
+long fileKB(char const* fileName)
+{
+    FILE* fp = fopen(fileName, "rb");
+    if (fp == NULL)
+        return -1;
+    fseek(fp, 0, SEEK_END);
+    long size = ftell(fp);
+    fclose(fp);
+    return size / 1024;
+}
+
+/**
+ * Saves a pruned tree both ways and times loading it back.
+ */
+void run(PNG const& source, int resolution, int tolerance)
+{
+    Quadtree tree(source, resolution);
+    tree.prune(tolerance);
+
+    // the first sizeable allocation after a prune pays for malloc
+    // consolidating the millions of freed nodes; keep that out of save
+    tree.writeToFile("outBench.qtree");
+    BenchTime start = benchNow();
+    tree.writeToFile("outBench.qtree");
+    double saveMs = elapsedMs(start);
+    tree.decompress().writeToFile("outBench.png");
+
+    start = benchNow();
+    Quadtree loaded;
+    loaded.readFromFile("outBench.qtree");
+    double loadMs = elapsedMs(start);
+
+    start = benchNow();
+    ArrayQuadtree loadedArray;
+    loadedArray.readFromFile("outBench.qtree");
+    double arrayMs = elapsedMs(start);
+
+    start = benchNow();
+    Quadtree rebuilt;
+    {
+        PNG image("outBench.png");
+        rebuilt.buildTree(image, resolution);
+    }
+    rebuilt.prune(0);
+    double rebuildMs = elapsedMs(start);
+
+    bool same = loaded == tree && loaded.decompress() == tree.decompress()
+        && loadedArray.decompress() == tree.decompress()
+        && loaded.pruneSize(tolerance * 10) == tree.pruneSize(tolerance * 10)
+        && loaded.idealPrune(100) == tree.idealPrune(100);
+
+    // a truncated file must be rejected, leaving an empty tree
+    FILE* fp = fopen("outBench.qtree", "r+b");
+    fseek(fp, 0, SEEK_END);
+    long size = ftell(fp);
+    fclose(fp);
+    if (truncate("outBench.qtree", size - 1) == 0)
+        same = same && !loaded.readFromFile("outBench.qtree")
+            && loaded.decompress() == PNG();
+
+    cout << setw(6) << resolution << setw(9) << tree.pruneSize(tolerance)
+         << setw(11) << fileKB("outBench.png") << setw(11) << size / 1024
+         << setw(10) << saveMs << setw(10) << loadMs << setw(11) << arrayMs
+         << setw(13) << rebuildMs << setw(6) << (same ? "yes" : "NO") << endl;
+
+    remove("outBench.qtree");
+    remove("outBench.png");
+}
+
+int main(int argc, char* argv[])
+{
+    std::vector<int> resolutions;
+    for (int i = 1; i < argc; i++)
+        resolutions.push_back(atoi(argv[i]));
+    if (resolutions.empty())
+        resolutions = {512, 1024, 2048};
+
+    PNG in;
+    in.readFromFile("in.png");
+
+    cout << std::fixed << std::setprecision(1);
+    cout << "trees pruned at tolerance 1000; rebuild = decode the PNG, buildTree"
+         << " and prune away the duplicate leaves" << endl;
+    cout << setw(6) << "res" << setw(9) << "leaves" << setw(11) << "png(KB)"
+         << setw(11) << "qtree(KB)" << setw(10) << "save(ms)" << setw(10) << "load(ms)"
+         << setw(11) << "array(ms)" << setw(13) << "rebuild(ms)" << setw(6) << "same" << endl;
+
+    for (int resolution : resolutions) {
+        PNG source = scaledSource(in, resolution);
+        isolated([&] { run(source, resolution, 1000); });
+    }
+    return 0;
+}
@@ -0,0 +1,74 @@
+/**
+ * @file bench_stream.cpp
+ * Measures building a tree straight from a png file. "decode" reads the
+ * whole image into a PNG and builds from that; "stream" uses
+ * buildFromFile, which reads a row at a time. Reported are the time,
+ * the peak memory while building, the memory the finished tree holds,
+ * and the difference: what building needed on top of the tree.
+ *
+ * Usage: ./bench_stream [resolution ...]   (default: 1024 2048 4096)
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "bench_util.h"
+#include "png.h"
+#include "quadtree.h"
+
+using std::cout;
+using std::endl;
+using std::setw;
+
+/**
+ * Builds a tree from fileName one way and prints its row.
+ */
+void run(std::string const& fileName, int resolution, bool stream)
+{
+    long before = residentKB();
+    resetPeak();
+    BenchTime start = benchNow();
+
+    Quadtree tree;
+    if (stream)
+        tree.buildFromFile(fileName);
+    else {
+        PNG image(fileName);
+        tree.buildTree(image);
+    }
+    double ms = elapsedMs(start);
+    long peak = peakKB() - before;
+    long held = residentKB() - before;
+
+    cout << setw(6) << resolution << setw(8) << (stream ? "stream" : "decode")
+         << setw(10) << ms << setw(11) << peak << setw(11) << held
+         << setw(11) << peak - held << endl;
+}
+
+int main(int argc, char* argv[])
+{
+    std::vector<int> resolutions;
+    for (int i = 1; i < argc; i++)
+        resolutions.push_back(atoi(argv[i]));
+    if (resolutions.empty())
+        resolutions = {1024, 2048, 4096};
+
+    PNG in;
+    in.readFromFile("in.png");
+    std::string fileName = "/tmp/bench_stream.png";
+
+    cout << std::fixed << std::setprecision(1);
+    cout << setw(6) << "res" << setw(8) << "build" << setw(10) << "ms"
+         << setw(11) << "peak(KB)" << setw(11) << "tree(KB)" << setw(11) << "extra(KB)" << endl;
+    for (int resolution : resolutions) {
+        isolated([&] { scaledSource(in, resolution).writeToFile(fileName); });
+        isolated([&] { run(fileName, resolution, false); });
+        isolated([&] { run(fileName, resolution, true); });
+    }
+    remove(fileName.c_str());
+    return 0;
+}
@@ -0,0 +1,151 @@
+/**
+ * @file bench_traverse.cpp
+ * Measures walking every pixel of an image: through operator(), which
+ * clamps every coordinate, through row(), once per row, and through
+ * pixels(), as one flat buffer. Each walk sums the channels (reading)
+ * and then inverts them (writing), and must agree with the others.
+ *
+ * Usage: ./bench_traverse [resolution ...]   (default: 1024 4096)
+ */
+
+#include <cstdint>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <vector>
+
+#include "bench_util.h"
+#include "png.h"
+
+using std::cout;
+using std::endl;
+using std::setw;
+
+/**
+ * @return The sum of every channel of every pixel, read with operator()
+ */
+uint64_t sumChecked(PNG const& image)
+{
+    uint64_t sum = 0;
+    for (size_t y = 0; y < image.height(); y++) {
+        for (size_t x = 0; x < image.width(); x++) {
+            RGBAPixel const* pixel = image(x, y);
+            sum += pixel->red + pixel->green + pixel->blue + pixel->alpha;
+        }
+    }
+    return sum;
+}
+
+/**
+ * @return The same sum, read a row at a time
+ */
+uint64_t sumRows(PNG const& image)
+{
+    uint64_t sum = 0;
+    for (size_t y = 0; y < image.height(); y++) {
+        RGBAPixel const* row = image.row(y);
+        for (size_t x = 0; x < image.width(); x++)
+            sum += row[x].red + row[x].green + row[x].blue + row[x].alpha;
+    }
+    return sum;
+}
+
+/**
+ * @return The same sum, read as one buffer
+ */
+uint64_t sumFlat(PNG const& image)
+{
+    uint64_t sum = 0;
+    RGBAPixel const* pixel = image.pixels();
+    RGBAPixel const* end = pixel + image.width() * image.height();
+    for (; pixel != end; pixel++)
+        sum += pixel->red + pixel->green + pixel->blue + pixel->alpha;
+    return sum;
+}
+
+/**
+ * Inverts every colour channel with operator().
+ */
+void invertChecked(PNG& image)
+{
+    for (size_t y = 0; y < image.height(); y++) {
+        for (size_t x = 0; x < image.width(); x++) {
+            RGBAPixel* pixel = image(x, y);
+            pixel->red = 255 - pixel->red;
+            pixel->green = 255 - pixel->green;
+            pixel->blue = 255 - pixel->blue;
+        }
+    }
+}
+
+/**
+ * Inverts every colour channel a row at a time.
+ */
+void invertRows(PNG& image)
+{
+    for (size_t y = 0; y < image.height(); y++) {
+        RGBAPixel* row = image.row(y);
+        for (size_t x = 0; x < image.width(); x++) {
+            row[x].red = 255 - row[x].red;
+            row[x].green = 255 - row[x].green;
+            row[x].blue = 255 - row[x].blue;
+        }
+    }
+}
+
+/**
+ * Inverts every colour channel as one buffer.
+ */
+void invertFlat(PNG& image)
+{
+    RGBAPixel* pixel = image.pixels();
+    RGBAPixel* end = pixel + image.width() * image.height();
+    for (; pixel != end; pixel++) {
+        pixel->red = 255 - pixel->red;
+        pixel->green = 255 - pixel->green;
+        pixel->blue = 255 - pixel->blue;
+    }
+}
+
+/**
+ * Times one way of reading and one of writing, and prints their row.
+ */
+template <typename Sum, typename Invert>
+void run(PNG& image, char const* name, Sum sum, Invert invert, uint64_t expected)
+{
+    BenchTime start = benchNow();
+    uint64_t total = sum(image);
+    double readMs = elapsedMs(start);
+
+    start = benchNow();
+    invert(image);
+    invert(image);
+    double writeMs = elapsedMs(start) / 2;
+
+    cout << setw(6) << image.width() << setw(12) << name << setw(10) << readMs
+         << setw(10) << writeMs << setw(6) << (total == expected ? "yes" : "NO") << endl;
+}
+
+int main(int argc, char* argv[])
+{
+    std::vector<int> resolutions;
+    for (int i = 1; i < argc; i++)
+        resolutions.push_back(atoi(argv[i]));
+    if (resolutions.empty())
+        resolutions = {1024, 4096};
+
+    PNG in;
+    in.readFromFile("in.png");
+
+    cout << std::fixed << std::setprecision(2);
+    cout << setw(6) << "res" << setw(12) << "access" << setw(10) << "read ms"
+         << setw(10) << "write ms" << setw(6) << "same" << endl;
+    for (int resolution : resolutions) {
+        PNG image = scaledSource(in, resolution);
+        uint64_t expected = sumChecked(image);
+        run(image, "operator()", sumChecked, invertChecked, expected);
+        run(image, "row", sumRows, invertRows, expected);
+        run(image, "pixels", sumFlat, invertFlat, expected);
+    }
+    return 0;
+}
@@ -0,0 +1,143 @@
+/**
+ * @file bench_util.h
+ * Timing and memory helpers shared by the benchmark programs.
+ */
+
+#ifndef BENCH_UTIL_H
+#define BENCH_UTIL_H
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "png.h"
+
+typedef std::chrono::steady_clock::time_point BenchTime;
+
+/**
+ * @return The current time, for use with elapsedMs
+ */
+inline BenchTime benchNow()
+{
+    return std::chrono::steady_clock::now();
+}
+
+/**
+ * @param start A time returned by benchNow()
+ * @return Milliseconds elapsed since start
+ */
+inline double elapsedMs(BenchTime start)
+{
+    return std::chrono::duration<double, std::milli>(benchNow() - start).count();
+}
+
+/**
+ * Current resident set size of this process, in kilobytes. Reads
+ * /proc/self/statm where it exists and otherwise falls back to the peak
+ * reported by getrusage (kilobytes on Linux, bytes on macOS).
+ */
+inline long residentKB()
+{
+    FILE* statm = fopen("/proc/self/statm", "r");
+    if (statm != NULL) {
+        long pages = 0, resident = 0;
+        int read = fscanf(statm, "%ld %ld", &pages, &resident);
+        fclose(statm);
+        if (read == 2)
+            return resident * (sysconf(_SC_PAGESIZE) / 1024);
+    }
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+#ifdef __APPLE__
+    return usage.ru_maxrss / 1024;
+#else
+    return usage.ru_maxrss;
+#endif
+}
+
+/**
+ * Resets the peak resident set size that peakKB() reports to the current
+ * resident set size, where the system supports it (Linux).
+ */
+inline void resetPeak()
+{
+    FILE* refs = fopen("/proc/self/clear_refs", "w");
+    if (refs != NULL) {
+        fputs("5", refs);
+        fclose(refs);
+    }
+}
+
+/**
+ * Peak resident set size of this process since the last resetPeak(), in
+ * kilobytes. Falls back to the current resident set size where the peak
+ * is not available.
+ */
+inline long peakKB()
+{
+    FILE* status = fopen("/proc/self/status", "r");
+    if (status != NULL) {
+        char line[256];
+        long peak = -1;
+        while (fgets(line, sizeof(line), status) != NULL)
+            if (sscanf(line, "VmHWM: %ld kB", &peak) == 1)
+                break;
+        fclose(status);
+        if (peak >= 0)
+            return peak;
+    }
+    return residentKB();
+}
+
+/**
+ * Nearest-neighbour scales source up (or down) to a width by height
+ * image, so large benchmark inputs keep photo-like regions instead of
+ * being pure noise or pure colour.
+ * @param source The image to scale
+ * @param width The width of the result
+ * @param height The height of the result
+ */
+inline PNG scaledSource(PNG const& source, int width, int height)
+{
+    PNG ret((size_t) width, (size_t) height);
+    for (int y = 0; y < height; y++)
+        for (int x = 0; x < width; x++)
+            *ret(x, y) = *source(x * source.width() / width,
+                                 y * source.height() / height);
+    return ret;
+}
+
+/**
+ * Nearest-neighbour scales source to a resolution by resolution image.
+ * @param source The image to scale
+ * @param resolution The side length of the result
+ */
+inline PNG scaledSource(PNG const& source, int resolution)
+{
+    return scaledSource(source, resolution, resolution);
+}
+
+/**
+ * Runs fn in a forked child process and waits for it, so memory figures
+ * are not skewed by what earlier runs left in the allocator's caches.
+ * @param fn Callable taking no arguments
+ */
+template <typename Func>
+void isolated(Func fn)
+{
+    std::cout.flush();
+    pid_t pid = fork();
+    if (pid == 0) {
+        fn();
+        std::cout.flush();
+        _exit(0);
+    }
+    int status = 0;
+    waitpid(pid, &status, 0);
+}
+
+#endif
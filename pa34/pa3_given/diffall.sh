@@ -23,3 +23,10 @@ do
 	diff $image soln_$image
 done
 
+# images that must match another test's solution
+diff outParallel.png soln_outCopy.png
+
+diff outStreamed.png soln_outPruned.png
+diff outLoaded.png soln_outPruned.png
+diff outLoadedArray.png soln_outPruned.png
+diff outMaterialized.png soln_outRotated.png
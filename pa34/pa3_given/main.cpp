@@ -3,9 +3,14 @@
  * Contains code to test your Quadtree implementation.
  */
 
+#include <algorithm>
 #include <iostream>
+#include <utility>
+#include <vector>
+#include "arrayquadtree.h"
 #include "png.h"
 #include "quadtree.h"
+#include "quadtreestream.h"
 
 using std::cout;
 using std::endl;
@@ -43,17 +48,51 @@ int main()
     imgOut = fullTree2.decompress();
     imgOut.writeToFile("outCopy.png");
 
+    // test multi-threaded build; must match the serial tree exactly
+    Quadtree parallelTree(imgIn, 256, 4);
+    imgOut = parallelTree.decompress();
+    imgOut.writeToFile("outParallel.png");
+
     // test clockwiseRotate
     fullTree.clockwiseRotate();
     imgOut = fullTree.decompress();
     imgOut.writeToFile("outRotated.png");
 
+    // test baking the (lazy) rotation into the nodes
+    fullTree.materialize();
+    imgOut = fullTree.decompress();
+    imgOut.writeToFile("outMaterialized.png");
+
+    // test mirroring: flipping both ways is a half turn; this only prints
+    // if it goes wrong
+    Quadtree flipTree(fullTree2), halfTurnTree(fullTree2);
+    flipTree.flipHorizontal();
+    flipTree.flipVertical();
+    halfTurnTree.clockwiseRotate();
+    halfTurnTree.clockwiseRotate();
+    if (!(flipTree.decompress() == halfTurnTree.decompress()))
+        cout << "flipping both ways is not a half turn" << endl;
+
     // test prune
     fullTree = fullTree2;
     fullTree.prune(1000);
     imgOut = fullTree.decompress();
     imgOut.writeToFile("outPruned.png");
 
+    // test streaming decompression straight to disk
+    fullTree.decompressToFile("outStreamed.png", 16);
+
+    // test saving the pruned tree and loading it back, into both layouts
+    fullTree.writeToFile("outPruned.qtree");
+    Quadtree loadedTree;
+    loadedTree.readFromFile("outPruned.qtree");
+    imgOut = loadedTree.decompress();
+    imgOut.writeToFile("outLoaded.png");
+    ArrayQuadtree loadedArray;
+    loadedArray.readFromFile("outPruned.qtree");
+    imgOut = loadedArray.decompress();
+    imgOut.writeToFile("outLoadedArray.png");
+
     // test several functions in succession
     Quadtree fullTree3(fullTree2);
     fullTree3.clockwiseRotate();
@@ -64,6 +103,97 @@ int main()
     imgOut = fullTree3.decompress();
     imgOut.writeToFile("outEtc.png");
 
+    // test a rectangular image whose sides are not powers of two, rotated
+    // once and then all the way round; this only prints if it goes wrong
+    PNG rectIn(200, 120);
+    for (size_t y = 0; y < rectIn.height(); y++)
+        for (size_t x = 0; x < rectIn.width(); x++)
+            *rectIn(x, y) = *imgIn(x, y);
+    Quadtree rectTree(rectIn);
+    rectTree.clockwiseRotate();
+    int wrong = 0;
+    for (int y = 0; y < 120; y++)
+        for (int x = 0; x < 200; x++)
+            if (!(rectTree.getPixel(119 - y, x) == *rectIn(x, y)))
+                wrong++;
+    if (wrong > 0)
+        cout << wrong << " pixels of the rotated rectangular tree are wrong" << endl;
+    rectTree.clockwiseRotate();
+    rectTree.clockwiseRotate();
+    rectTree.clockwiseRotate();
+    if (!(rectTree.decompress() == rectIn))
+        cout << "rectangular tree does not decompress to its image" << endl;
+
+    // test the batch queries against getPixel on a rotated, pruned tree;
+    // this only prints if it goes wrong
+    Quadtree queryTree(rectIn);
+    queryTree.prune(1000);
+    queryTree.clockwiseRotate();
+    PNG region = queryTree.getRegion(-10, 30, 140, 100);
+    std::vector<std::pair<int, int> > points;
+    for (int y = 0; y < 100; y++)
+        for (int x = 0; x < 140; x++)
+            points.push_back(std::make_pair(x - 10, y + 30));
+    std::vector<RGBAPixel> batch = queryTree.getPixels(points);
+    wrong = 0;
+    for (size_t i = 0; i < points.size(); i++) {
+        RGBAPixel pixel = queryTree.getPixel(points[i].first, points[i].second);
+        if (!(pixel == batch[i] && pixel == *region(i % 140, i / 140)))
+            wrong++;
+    }
+    if (wrong > 0)
+        cout << wrong << " pixels of the batch queries are wrong" << endl;
+
+    // test rate-controlled compression against a byte budget and a PSNR
+    // floor; this only prints if it goes wrong
+    Quadtree sizedTree(fullTree2), qualityTree(fullTree2);
+    Quadtree::CompressionResult sized = sizedTree.compressToSize(20000);
+    Quadtree::CompressionResult quality = qualityTree.compressToQuality(30);
+    if (sized.bytes > 20000 || sized.leaves != sizedTree.pruneSize(-1)
+        || quality.psnr < 30 || quality.leaves != qualityTree.pruneSize(-1))
+        cout << "rate-controlled compression missed its target" << endl;
+
+    // test progressive streaming of the rotated, pruned rectangular tree,
+    // fed a few bytes at a time; this only prints if it goes wrong
+    std::vector<uint8_t> stream = queryTree.encodeProgressive();
+    ProgressiveDecoder decoder;
+    for (size_t sent = 0; sent < stream.size(); sent += 37)
+        decoder.feed(stream.data() + sent, std::min<size_t>(37, stream.size() - sent));
+    if (!decoder.finished() || !(decoder.render() == queryTree.decompress()))
+        cout << "progressive stream does not decode to the tree's image" << endl;
+
+    // test building straight from the file, a row at a time, against the
+    // tree built from the decoded image; this only prints if it goes wrong
+    Quadtree streamedTree;
+    if (!streamedTree.buildFromFile("in.png") || !(streamedTree == fullTree2)
+        || streamedTree.pruneSize(1000) != fullTree2.pruneSize(1000))
+        cout << "tree built from the file differs from the decoded one" << endl;
+
+    // test diffing against the tree built from the file, which is equal,
+    // and against a pruned copy, patching with the delta; this only prints
+    // if it goes wrong
+    Quadtree frameTree(fullTree2), nextFrame(fullTree2);
+    nextFrame.prune(2000);
+    Quadtree::Delta delta = frameTree.diff(nextFrame);
+    if (!frameTree.diff(streamedTree).empty() || !frameTree.patch(delta)
+        || !(frameTree == nextFrame) || !frameTree.diff(nextFrame).empty())
+        cout << "patching with the delta did not reproduce the pruned tree" << endl;
+
+    // test sharing identical subtrees: the shared tree must still decompress
+    // and prune like the plain one; this only prints if it goes wrong
+    Quadtree sharedTree(fullTree2);
+    Quadtree::SharingResult sharing = sharedTree.deduplicate();
+    bool sameImage = sharedTree.decompress() == fullTree2.decompress();
+    sharedTree.prune(1000);
+    if (sharing.distinct >= sharing.nodes || !sameImage || !(sharedTree == fullTree))
+        cout << "the deduplicated tree differs from the plain one" << endl;
+
+    // test multi-threaded decompress on the rotated, pruned rectangular
+    // tree and the shared one; this only prints if it goes wrong
+    if (!(queryTree.decompress(4) == queryTree.decompress())
+        || !(sharedTree.decompress(3) == sharedTree.decompress()))
+        cout << "multi-threaded decompress differs from the serial one" << endl;
+
     // ensure that printTree still works
     Quadtree tinyTree(imgIn, 32);
     cout << "Printing tinyTree:\n";
@@ -0,0 +1,373 @@
+/**
+ * @file nodepool.h
+ * Definition and implementation of a slab allocator for tree nodes.
+ */
+
+#ifndef NODEPOOL_H
+#define NODEPOOL_H
+
+#include <atomic>
+#include <cstddef>
+#include <mutex>
+#include <new>
+#include <type_traits>
+#include <vector>
+
+/**
+ * Numbers the threads that use NodePools, from 0; a thread's number is
+ * given to the next thread to start once it exits, so the numbers stay
+ * as small as the most threads running at once.
+ */
+class PoolThread
+{
+  public:
+    /**
+     * @return The calling thread's number
+     */
+    static size_t index()
+    {
+        thread_local PoolThread self;
+        return self.number;
+    }
+
+  private:
+    size_t number; /**< this thread's number */
+
+    PoolThread()
+    {
+        std::lock_guard<std::mutex> guard(lock());
+        std::vector<size_t>& free = freeNumbers();
+        if (free.empty()) {
+            number = nextNumber()++;
+        } else {
+            number = free.back();
+            free.pop_back();
+        }
+    }
+
+    ~PoolThread()
+    {
+        std::lock_guard<std::mutex> guard(lock());
+        freeNumbers().push_back(number);
+    }
+
+    /** @return The lock guarding the numbers */
+    static std::mutex& lock()
+    {
+        static std::mutex numbersLock;
+        return numbersLock;
+    }
+
+    /** @return The numbers of threads that have exited */
+    static std::vector<size_t>& freeNumbers()
+    {
+        static std::vector<size_t> numbers;
+        return numbers;
+    }
+
+    /** @return The lowest number never given out */
+    static size_t& nextNumber()
+    {
+        static size_t next = 0;
+        return next;
+    }
+};
+
+/**
+ * Hands out Nodes carved from large slabs instead of allocating each one
+ * with new. A destroyed node goes on a free list and is handed out again
+ * before the slabs grow; reset() forgets every node at once, and the
+ * slabs themselves are only freed with the pool. Building or tearing down
+ * a tree of millions of nodes therefore costs a few hundred allocator
+ * calls instead of millions.
+ *
+ * Since slabs are never freed one by one, a pool whose nodes have mostly
+ * been destroyed keeps its memory; owners should move what is left into
+ * a new pool when live() falls far below capacity().
+ *
+ * Each of the first few threads (numbered by PoolThread) has a cache in
+ * the pool: the slots it destroyed, and a run of slots it claimed from a
+ * slab. Creating and destroying nodes works on the calling thread's cache
+ * without locking; the pool's lock is only taken to move a batch of slots
+ * between a cache and the pool, or by threads past the last cache.
+ *
+ * Nodes must be trivially destructible, since reset() never runs their
+ * destructors. Every member function may be called from several threads,
+ * except reset(), which no other thread may overlap.
+ */
+template <class Node>
+class NodePool
+{
+  public:
+    /**
+     * Creates a pool with no slabs.
+     * @param pooled Whether to carve nodes from slabs at all; if not,
+     *  every node is allocated with new and freed with delete, as if
+     *  there were no pool (for comparison), and reset() may not be used
+     */
+    explicit NodePool(bool pooled = true)
+        : current(0), carved(0), freeList(NULL), alive(0), usePool(pooled)
+    {
+    }
+
+    /**
+     * Frees every slab, and with them every node still in the pool.
+     */
+    ~NodePool()
+    {
+        for (size_t i = 0; i < slabs.size(); i++)
+            delete[] slabs[i];
+    }
+
+    /**
+     * @return A node constructed with Node()
+     */
+    Node* create()
+    {
+        if (!usePool)
+            return new Node();
+        return new (take()) Node();
+    }
+
+    /**
+     * @param arg The argument to construct the node with
+     * @return A node constructed with Node(arg)
+     */
+    template <class Arg>
+    Node* create(Arg const& arg)
+    {
+        if (!usePool)
+            return new Node(arg);
+        return new (take()) Node(arg);
+    }
+
+    /**
+     * Returns a node to the pool, to be handed out again.
+     * @param node A node created by this pool
+     */
+    void destroy(Node* node)
+    {
+        if (!usePool) {
+            delete node;
+            return;
+        }
+        node->~Node();
+        Slot* slot = reinterpret_cast<Slot*>(node);
+        size_t thread = PoolThread::index();
+        if (thread >= cachedThreads) {
+            std::lock_guard<std::mutex> guard(lock);
+            slot->next = freeList;
+            freeList = slot;
+            alive--;
+            return;
+        }
+        Cache& cache = caches[thread];
+        cache.alive.store(cache.alive.load(std::memory_order_relaxed) - 1,
+                          std::memory_order_relaxed);
+        slot->next = cache.freeList;
+        cache.freeList = slot;
+        if (++cache.freeCount == 2 * batchSlots)
+            spill(cache);
+    }
+
+    /**
+     * Takes back every node the pool has handed out, without visiting
+     * them; they must no longer be used. The slabs are kept for the
+     * nodes created next.
+     */
+    void reset()
+    {
+        static_assert(std::is_trivially_destructible<Node>::value,
+                      "reset() does not destroy the nodes it takes back");
+        std::lock_guard<std::mutex> guard(lock);
+        current = carved = alive = 0;
+        freeList = NULL;
+        batches.clear();
+        for (size_t i = 0; i < cachedThreads; i++) {
+            caches[i].freeList = caches[i].claimed = caches[i].claimedEnd = NULL;
+            caches[i].freeCount = 0;
+            caches[i].alive.store(0, std::memory_order_relaxed);
+        }
+    }
+
+    /**
+     * @return The number of nodes handed out and not yet taken back (0
+     *  if the pool is not pooled)
+     */
+    size_t live()
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        long total = alive;
+        for (size_t i = 0; i < cachedThreads; i++)
+            total += caches[i].alive.load(std::memory_order_relaxed);
+        return (size_t) total;
+    }
+
+    /**
+     * @return The number of nodes the slabs allocated so far can hold
+     */
+    size_t capacity()
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        return slabs.size() * slabSlots;
+    }
+
+    /**
+     * @return Whether nodes come from slabs, as set at construction
+     */
+    bool pooled() const
+    {
+        return usePool;
+    }
+
+  private:
+    /**
+     * Room for one node, which links the free list while it is free.
+     */
+    union Slot
+    {
+        Slot* next;
+        typename std::aligned_storage<sizeof(Node), alignof(Node)>::type storage;
+    };
+
+    /**
+     * One thread's slots, which only that thread touches, but for reset().
+     * Caches are padded so that the fields of two never share a cache
+     * line, whatever the pool's alignment, and threads do not contend.
+     */
+    struct Cache
+    {
+        Slot* freeList = NULL; /**< slots destroyed by the thread */
+        size_t freeCount = 0; /**< the number of them */
+        Slot* claimed = NULL; /**< the next slot of the run claimed */
+        Slot* claimedEnd = NULL; /**< the end of that run */
+        /** nodes the thread created less those it destroyed (read by live()) */
+        std::atomic<long> alive{0};
+        char padding[128 - 3 * sizeof(Slot*) - sizeof(size_t) - sizeof(std::atomic<long>)];
+    };
+
+    static const size_t slabSlots = 4096; /**< nodes per slab */
+    static const size_t batchSlots = 64; /**< slots moved per lock */
+    static const size_t cachedThreads = 32; /**< threads with a cache */
+
+    std::vector<Slot*> slabs; /**< every slab allocated */
+    size_t current; /**< the slab being carved */
+    size_t carved; /**< slots of that slab handed out so far */
+    Slot* freeList; /**< slots destroyed by threads with no cache */
+    std::vector<Slot*> batches; /**< lists of batchSlots slots spilled by caches */
+    long alive; /**< nodes handed out and not yet taken back, but for the caches' */
+    bool usePool; /**< whether nodes come from slabs at all */
+    std::mutex lock; /**< guards everything above but usePool */
+    Cache caches[cachedThreads]; /**< the threads' caches, by PoolThread number */
+
+    NodePool(NodePool const& other) = delete;
+    NodePool& operator=(NodePool const& other) = delete;
+
+    /**
+     * @return Room for a node: a slot from the calling thread's cache,
+     *  refilled from the pool when it runs dry
+     */
+    void* take()
+    {
+        size_t thread = PoolThread::index();
+        if (thread >= cachedThreads)
+            return takeShared();
+        Cache& cache = caches[thread];
+        cache.alive.store(cache.alive.load(std::memory_order_relaxed) + 1,
+                          std::memory_order_relaxed);
+        if (cache.freeList == NULL && cache.claimed == cache.claimedEnd)
+            refill(cache);
+        if (cache.freeList != NULL) {
+            Slot* slot = cache.freeList;
+            cache.freeList = slot->next;
+            cache.freeCount--;
+            return slot;
+        }
+        return cache.claimed++;
+    }
+
+    /**
+     * Gives an empty cache a batch of destroyed slots, if the pool has
+     * one, or else up to batchSlots of the slots destroyed by threads
+     * with no cache, or else claims it the next batchSlots uncarved slots.
+     * @param cache The cache to refill
+     */
+    void refill(Cache& cache)
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        if (!batches.empty()) {
+            cache.freeList = batches.back();
+            cache.freeCount = batchSlots;
+            batches.pop_back();
+            return;
+        }
+        if (freeList != NULL) {
+            Slot* last = freeList;
+            cache.freeCount = 1;
+            while (last->next != NULL && cache.freeCount < batchSlots) {
+                last = last->next;
+                cache.freeCount++;
+            }
+            cache.freeList = freeList;
+            freeList = last->next;
+            last->next = NULL;
+            return;
+        }
+        cache.claimed = carve(batchSlots);
+        cache.claimedEnd = cache.claimed + batchSlots;
+    }
+
+    /**
+     * Hands the older half of a full cache's destroyed slots back to the
+     * pool, for whichever thread next runs dry.
+     * @param cache The cache holding 2 * batchSlots destroyed slots
+     */
+    void spill(Cache& cache)
+    {
+        Slot* last = cache.freeList;
+        for (size_t i = 1; i < batchSlots; i++)
+            last = last->next;
+        Slot* older = last->next;
+        last->next = NULL;
+        cache.freeCount = batchSlots;
+        std::lock_guard<std::mutex> guard(lock);
+        batches.push_back(older);
+    }
+
+    /**
+     * @param count The number of slots wanted, at most slabSlots
+     * @return The first of the next count uncarved slots, starting a new
+     *  slab if this one has too few left; the caller holds the lock
+     */
+    Slot* carve(size_t count)
+    {
+        if (carved + count > slabSlots) {
+            current++;
+            carved = 0;
+        }
+        if (current == slabs.size())
+            slabs.push_back(new Slot[slabSlots]);
+        Slot* first = &slabs[current][carved];
+        carved += count;
+        return first;
+    }
+
+    /**
+     * take() for threads with no cache.
+     * @return Room for a node: a free slot if there is one, or else the
+     *  next uncarved slot, starting a new slab if need be
+     */
+    void* takeShared()
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        alive++;
+        if (freeList != NULL) {
+            Slot* slot = freeList;
+            freeList = slot->next;
+            return slot;
+        }
+        return carve(1);
+    }
+};
+
+#endif
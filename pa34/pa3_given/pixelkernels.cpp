@@ -0,0 +1,364 @@
+/**
+ * @file pixelkernels.cpp
+ * Scalar, SSE2 and AVX2 implementations of the PixelKernels, and the
+ * runtime choice between them.
+ *
+ * The vector versions widen bytes to 16-bit lanes, so a sum of four
+ * channels (at most 1020) never overflows, and shift right by two to
+ * truncate exactly as the scalar division by four does. Distances are
+ * formed with multiply-add on 16-bit differences, with the alpha lane
+ * masked off. Whatever does not fill a whole vector is left to the scalar
+ * version.
+ */
+
+#include "pixelkernels.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define PIXELKERNELS_X86 1
+#endif
+
+static_assert(sizeof(RGBAPixel) == 4, "kernels need pixels packed as four bytes");
+
+//////////////////////////////////////////////////////////////////////////////
+// scalar
+//////////////////////////////////////////////////////////////////////////////
+
+/**
+ * Averages four pixels component-wise, truncating.
+ */
+static inline RGBAPixel average4(RGBAPixel const& a, RGBAPixel const& b,
+                                 RGBAPixel const& c, RGBAPixel const& d)
+{
+	return RGBAPixel((a.red + b.red + c.red + d.red) / 4,
+		(a.green + b.green + c.green + d.green) / 4,
+		(a.blue + b.blue + c.blue + d.blue) / 4,
+		(a.alpha + b.alpha + c.alpha + d.alpha) / 4);
+}
+
+static void averageQuadsScalar(RGBAPixel const* top, RGBAPixel const* bottom,
+                               RGBAPixel* out, size_t count)
+{
+	for (size_t i = 0; i < count; i++)
+		out[i] = average4(top[2 * i], top[2 * i + 1], bottom[2 * i], bottom[2 * i + 1]);
+}
+
+static void averageGroupsScalar(RGBAPixel const* children, RGBAPixel* out, size_t count)
+{
+	for (size_t i = 0; i < count; i++)
+		out[i] = average4(children[4 * i], children[4 * i + 1],
+			children[4 * i + 2], children[4 * i + 3]);
+}
+
+static void quadDistancesScalar(RGBAPixel const* top, RGBAPixel const* bottom,
+                                RGBAPixel const* centers, int* out, size_t count)
+{
+	for (size_t i = 0; i < count; i++) {
+		int best = PixelKernels::distance(top[2 * i], centers[i]);
+		int next = PixelKernels::distance(top[2 * i + 1], centers[i]);
+		best = next > best ? next : best;
+		next = PixelKernels::distance(bottom[2 * i], centers[i]);
+		best = next > best ? next : best;
+		next = PixelKernels::distance(bottom[2 * i + 1], centers[i]);
+		out[i] = next > best ? next : best;
+	}
+}
+
+#ifdef PIXELKERNELS_X86
+
+//////////////////////////////////////////////////////////////////////////////
+// SSE2: 128-bit vectors, four pixels each
+//////////////////////////////////////////////////////////////////////////////
+
+#define SSE2_KERNEL __attribute__((target("sse2")))
+
+/**
+ * Given two vectors each holding two partial sums of one block in 16-bit
+ * lanes, [a0 a1] and [b0 b1], returns the block sums [a0+a1 b0+b1].
+ */
+SSE2_KERNEL static inline __m128i pairSums(__m128i first, __m128i second)
+{
+	return _mm_add_epi16(_mm_unpacklo_epi64(first, second), _mm_unpackhi_epi64(first, second));
+}
+
+SSE2_KERNEL static void averageQuadsSSE2(RGBAPixel const* top, RGBAPixel const* bottom,
+                                         RGBAPixel* out, size_t count)
+{
+	__m128i const zero = _mm_setzero_si128();
+	size_t i = 0;
+	// four blocks (eight pixels of each row) per pass
+	for (; i + 4 <= count; i += 4) {
+		__m128i t0 = _mm_loadu_si128((__m128i const*) (top + 2 * i));
+		__m128i t1 = _mm_loadu_si128((__m128i const*) (top + 2 * i + 4));
+		__m128i b0 = _mm_loadu_si128((__m128i const*) (bottom + 2 * i));
+		__m128i b1 = _mm_loadu_si128((__m128i const*) (bottom + 2 * i + 4));
+		// column sums, pixels 0-1, 2-3, 4-5, 6-7
+		__m128i s0 = _mm_add_epi16(_mm_unpacklo_epi8(t0, zero), _mm_unpacklo_epi8(b0, zero));
+		__m128i s1 = _mm_add_epi16(_mm_unpackhi_epi8(t0, zero), _mm_unpackhi_epi8(b0, zero));
+		__m128i s2 = _mm_add_epi16(_mm_unpacklo_epi8(t1, zero), _mm_unpacklo_epi8(b1, zero));
+		__m128i s3 = _mm_add_epi16(_mm_unpackhi_epi8(t1, zero), _mm_unpackhi_epi8(b1, zero));
+		// block sums: blocks 0-1, then 2-3
+		__m128i q0 = _mm_srli_epi16(pairSums(s0, s1), 2);
+		__m128i q1 = _mm_srli_epi16(pairSums(s2, s3), 2);
+		_mm_storeu_si128((__m128i*) (out + i), _mm_packus_epi16(q0, q1));
+	}
+	averageQuadsScalar(top + 2 * i, bottom + 2 * i, out + i, count - i);
+}
+
+SSE2_KERNEL static void averageGroupsSSE2(RGBAPixel const* children, RGBAPixel* out,
+                                          size_t count)
+{
+	__m128i const zero = _mm_setzero_si128();
+	size_t i = 0;
+	// four groups per pass
+	for (; i + 4 <= count; i += 4) {
+		__m128i s[4];
+		for (int k = 0; k < 4; k++) {
+			__m128i group = _mm_loadu_si128((__m128i const*) (children + 4 * (i + k)));
+			// [c0 + c2, c1 + c3]
+			s[k] = _mm_add_epi16(_mm_unpacklo_epi8(group, zero), _mm_unpackhi_epi8(group, zero));
+		}
+		__m128i q0 = _mm_srli_epi16(pairSums(s[0], s[1]), 2);
+		__m128i q1 = _mm_srli_epi16(pairSums(s[2], s[3]), 2);
+		_mm_storeu_si128((__m128i*) (out + i), _mm_packus_epi16(q0, q1));
+	}
+	averageGroupsScalar(children + 4 * i, out + i, count - i);
+}
+
+/**
+ * Signed 32-bit maximum, which SSE2 lacks.
+ */
+SSE2_KERNEL static inline __m128i max32(__m128i a, __m128i b)
+{
+	__m128i greater = _mm_cmpgt_epi32(a, b);
+	return _mm_or_si128(_mm_and_si128(greater, a), _mm_andnot_si128(greater, b));
+}
+
+/**
+ * Squared RGB distances of two pixels, in 16-bit lanes, to two centres
+ * laid out the same way: [r2+g2, b2, r2+g2, b2] in 32-bit lanes.
+ */
+SSE2_KERNEL static inline __m128i squares(__m128i pixels, __m128i centers, __m128i rgb)
+{
+	__m128i delta = _mm_and_si128(_mm_sub_epi16(pixels, centers), rgb);
+	return _mm_madd_epi16(delta, delta);
+}
+
+SSE2_KERNEL static void quadDistancesSSE2(RGBAPixel const* top, RGBAPixel const* bottom,
+                                          RGBAPixel const* centers, int* out, size_t count)
+{
+	__m128i const zero = _mm_setzero_si128();
+	__m128i const rgb = _mm_set_epi16(0, -1, -1, -1, 0, -1, -1, -1);
+	size_t i = 0;
+	// two blocks (four pixels of each row) per pass
+	for (; i + 2 <= count; i += 2) {
+		__m128i t = _mm_loadu_si128((__m128i const*) (top + 2 * i));
+		__m128i b = _mm_loadu_si128((__m128i const*) (bottom + 2 * i));
+		__m128i c = _mm_loadl_epi64((__m128i const*) (centers + i));
+		c = _mm_unpacklo_epi32(c, c);
+		__m128i c0 = _mm_unpacklo_epi8(c, zero);
+		__m128i c1 = _mm_unpackhi_epi8(c, zero);
+		__m128i top0 = squares(_mm_unpacklo_epi8(t, zero), c0, rgb);
+		__m128i bottom0 = squares(_mm_unpacklo_epi8(b, zero), c0, rgb);
+		__m128i top1 = squares(_mm_unpackhi_epi8(t, zero), c1, rgb);
+		__m128i bottom1 = squares(_mm_unpackhi_epi8(b, zero), c1, rgb);
+		// the four distances of each block
+		__m128i d0 = _mm_add_epi32(
+			_mm_castps_si128(_mm_shuffle_ps(_mm_castsi128_ps(top0), _mm_castsi128_ps(bottom0), _MM_SHUFFLE(2, 0, 2, 0))),
+			_mm_castps_si128(_mm_shuffle_ps(_mm_castsi128_ps(top0), _mm_castsi128_ps(bottom0), _MM_SHUFFLE(3, 1, 3, 1))));
+		__m128i d1 = _mm_add_epi32(
+			_mm_castps_si128(_mm_shuffle_ps(_mm_castsi128_ps(top1), _mm_castsi128_ps(bottom1), _MM_SHUFFLE(2, 0, 2, 0))),
+			_mm_castps_si128(_mm_shuffle_ps(_mm_castsi128_ps(top1), _mm_castsi128_ps(bottom1), _MM_SHUFFLE(3, 1, 3, 1))));
+		// [a0 b0 a1 b1], then each block's maximum in lanes 0 and 2
+		__m128i m = max32(_mm_unpacklo_epi64(d0, d1), _mm_unpackhi_epi64(d0, d1));
+		m = max32(m, _mm_shuffle_epi32(m, _MM_SHUFFLE(2, 3, 0, 1)));
+		_mm_storel_epi64((__m128i*) (out + i), _mm_shuffle_epi32(m, _MM_SHUFFLE(3, 1, 2, 0)));
+	}
+	quadDistancesScalar(top + 2 * i, bottom + 2 * i, centers + i, out + i, count - i);
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// AVX2: the SSE2 steps on both 128-bit halves of a 256-bit vector at once,
+// then a permutation to put the halves' results back in order
+//////////////////////////////////////////////////////////////////////////////
+
+#define AVX2_KERNEL __attribute__((target("avx2")))
+
+AVX2_KERNEL static inline __m256i pairSums256(__m256i first, __m256i second)
+{
+	return _mm256_add_epi16(_mm256_unpacklo_epi64(first, second), _mm256_unpackhi_epi64(first, second));
+}
+
+AVX2_KERNEL static void averageQuadsAVX2(RGBAPixel const* top, RGBAPixel const* bottom,
+                                         RGBAPixel* out, size_t count)
+{
+	__m256i const zero = _mm256_setzero_si256();
+	size_t i = 0;
+	// eight blocks (sixteen pixels of each row) per pass
+	for (; i + 8 <= count; i += 8) {
+		__m256i t0 = _mm256_loadu_si256((__m256i const*) (top + 2 * i));
+		__m256i t1 = _mm256_loadu_si256((__m256i const*) (top + 2 * i + 8));
+		__m256i b0 = _mm256_loadu_si256((__m256i const*) (bottom + 2 * i));
+		__m256i b1 = _mm256_loadu_si256((__m256i const*) (bottom + 2 * i + 8));
+		__m256i s0 = _mm256_add_epi16(_mm256_unpacklo_epi8(t0, zero), _mm256_unpacklo_epi8(b0, zero));
+		__m256i s1 = _mm256_add_epi16(_mm256_unpackhi_epi8(t0, zero), _mm256_unpackhi_epi8(b0, zero));
+		__m256i s2 = _mm256_add_epi16(_mm256_unpacklo_epi8(t1, zero), _mm256_unpacklo_epi8(b1, zero));
+		__m256i s3 = _mm256_add_epi16(_mm256_unpackhi_epi8(t1, zero), _mm256_unpackhi_epi8(b1, zero));
+		__m256i q0 = _mm256_srli_epi16(pairSums256(s0, s1), 2);
+		__m256i q1 = _mm256_srli_epi16(pairSums256(s2, s3), 2);
+		// halves hold blocks [0-1, 4-5 | 2-3, 6-7]
+		__m256i packed = _mm256_packus_epi16(q0, q1);
+		_mm256_storeu_si256((__m256i*) (out + i), _mm256_permute4x64_epi64(packed, _MM_SHUFFLE(3, 1, 2, 0)));
+	}
+	averageQuadsScalar(top + 2 * i, bottom + 2 * i, out + i, count - i);
+}
+
+AVX2_KERNEL static void averageGroupsAVX2(RGBAPixel const* children, RGBAPixel* out,
+                                          size_t count)
+{
+	__m256i const zero = _mm256_setzero_si256();
+	size_t i = 0;
+	// eight groups per pass, two to a vector
+	for (; i + 8 <= count; i += 8) {
+		__m256i s[4];
+		for (int k = 0; k < 4; k++) {
+			__m256i groups = _mm256_loadu_si256((__m256i const*) (children + 4 * (i + 2 * k)));
+			s[k] = _mm256_add_epi16(_mm256_unpacklo_epi8(groups, zero), _mm256_unpackhi_epi8(groups, zero));
+		}
+		__m256i q0 = _mm256_srli_epi16(pairSums256(s[0], s[1]), 2);
+		__m256i q1 = _mm256_srli_epi16(pairSums256(s[2], s[3]), 2);
+		// halves hold groups [0 2 4 6 | 1 3 5 7]
+		__m256i packed = _mm256_packus_epi16(q0, q1);
+		_mm256_storeu_si256((__m256i*) (out + i),
+			_mm256_permutevar8x32_epi32(packed, _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7)));
+	}
+	averageGroupsScalar(children + 4 * i, out + i, count - i);
+}
+
+AVX2_KERNEL static inline __m256i squares256(__m256i pixels, __m256i centers, __m256i rgb)
+{
+	__m256i delta = _mm256_and_si256(_mm256_sub_epi16(pixels, centers), rgb);
+	return _mm256_madd_epi16(delta, delta);
+}
+
+AVX2_KERNEL static void quadDistancesAVX2(RGBAPixel const* top, RGBAPixel const* bottom,
+                                          RGBAPixel const* centers, int* out, size_t count)
+{
+	__m256i const zero = _mm256_setzero_si256();
+	__m256i const rgb = _mm256_set_epi16(0, -1, -1, -1, 0, -1, -1, -1,
+		0, -1, -1, -1, 0, -1, -1, -1);
+	size_t i = 0;
+	// four blocks (eight pixels of each row) per pass
+	for (; i + 4 <= count; i += 4) {
+		__m256i t = _mm256_loadu_si256((__m256i const*) (top + 2 * i));
+		__m256i b = _mm256_loadu_si256((__m256i const*) (bottom + 2 * i));
+		// [c0 c0 c1 c1 | c2 c2 c3 c3]
+		__m256i c = _mm256_cvtepu32_epi64(_mm_loadu_si128((__m128i const*) (centers + i)));
+		c = _mm256_or_si256(c, _mm256_slli_epi64(c, 32));
+		__m256i c0 = _mm256_unpacklo_epi8(c, zero);
+		__m256i c1 = _mm256_unpackhi_epi8(c, zero);
+		__m256i top0 = squares256(_mm256_unpacklo_epi8(t, zero), c0, rgb);
+		__m256i bottom0 = squares256(_mm256_unpacklo_epi8(b, zero), c0, rgb);
+		__m256i top1 = squares256(_mm256_unpackhi_epi8(t, zero), c1, rgb);
+		__m256i bottom1 = squares256(_mm256_unpackhi_epi8(b, zero), c1, rgb);
+		__m256i d0 = _mm256_add_epi32(
+			_mm256_castps_si256(_mm256_shuffle_ps(_mm256_castsi256_ps(top0), _mm256_castsi256_ps(bottom0), _MM_SHUFFLE(2, 0, 2, 0))),
+			_mm256_castps_si256(_mm256_shuffle_ps(_mm256_castsi256_ps(top0), _mm256_castsi256_ps(bottom0), _MM_SHUFFLE(3, 1, 3, 1))));
+		__m256i d1 = _mm256_add_epi32(
+			_mm256_castps_si256(_mm256_shuffle_ps(_mm256_castsi256_ps(top1), _mm256_castsi256_ps(bottom1), _MM_SHUFFLE(2, 0, 2, 0))),
+			_mm256_castps_si256(_mm256_shuffle_ps(_mm256_castsi256_ps(top1), _mm256_castsi256_ps(bottom1), _MM_SHUFFLE(3, 1, 3, 1))));
+		__m256i m = _mm256_max_epi32(_mm256_unpacklo_epi64(d0, d1), _mm256_unpackhi_epi64(d0, d1));
+		m = _mm256_max_epi32(m, _mm256_shuffle_epi32(m, _MM_SHUFFLE(2, 3, 0, 1)));
+		// blocks [0 _ 1 _ | 2 _ 3 _]
+		m = _mm256_permutevar8x32_epi32(m, _mm256_setr_epi32(0, 2, 4, 6, 0, 2, 4, 6));
+		_mm_storeu_si128((__m128i*) (out + i), _mm256_castsi256_si128(m));
+	}
+	quadDistancesScalar(top + 2 * i, bottom + 2 * i, centers + i, out + i, count - i);
+}
+
+#endif
+
+//////////////////////////////////////////////////////////////////////////////
+// dispatch
+//////////////////////////////////////////////////////////////////////////////
+
+/**
+ * @param level An instruction set
+ * @return Its implementations, or NULL if this build or processor lacks it
+ */
+PixelKernels::Table const* PixelKernels::table(Level level)
+{
+	static Table const scalar = {SCALAR, averageQuadsScalar, averageGroupsScalar,
+		quadDistancesScalar};
+#ifdef PIXELKERNELS_X86
+	static Table const sse2 = {SSE2, averageQuadsSSE2, averageGroupsSSE2, quadDistancesSSE2};
+	static Table const avx2 = {AVX2, averageQuadsAVX2, averageGroupsAVX2, quadDistancesAVX2};
+	__builtin_cpu_init();
+	if (level == AVX2)
+		return __builtin_cpu_supports("avx2") ? &avx2 : NULL;
+	if (level == SSE2)
+		return __builtin_cpu_supports("sse2") ? &sse2 : NULL;
+#else
+	if (level != SCALAR)
+		return NULL;
+#endif
+	return &scalar;
+}
+
+/**
+ * @return The implementations in use; the fastest supported ones until
+ *  select() says otherwise
+ */
+PixelKernels::Table& PixelKernels::active()
+{
+	static Table current = table(AVX2) != NULL ? *table(AVX2)
+		: table(SSE2) != NULL ? *table(SSE2) : *table(SCALAR);
+	return current;
+}
+
+PixelKernels::Level PixelKernels::level()
+{
+	return active().level;
+}
+
+// select
+//   - parameters: Level level - instruction set to run the kernels with
+//   - return value: whether it is available; not meant to be called while
+//        other threads are running kernels
+bool PixelKernels::select(Level level)
+{
+	Table const* chosen = table(level);
+	if (chosen == NULL)
+		return false;
+	active() = *chosen;
+	return true;
+}
+
+char const* PixelKernels::name(Level level)
+{
+	switch (level) {
+		case SSE2:
+			return "sse2";
+		case AVX2:
+			return "avx2";
+		default:
+			return "scalar";
+	}
+}
+
+void PixelKernels::averageQuads(RGBAPixel const* top, RGBAPixel const* bottom,
+                                RGBAPixel* out, size_t count)
+{
+	active().averageQuads(top, bottom, out, count);
+}
+
+void PixelKernels::averageGroups(RGBAPixel const* children, RGBAPixel* out, size_t count)
+{
+	active().averageGroups(children, out, count);
+}
+
+void PixelKernels::quadDistances(RGBAPixel const* top, RGBAPixel const* bottom,
+                                 RGBAPixel const* centers, int* out, size_t count)
+{
+	active().quadDistances(top, bottom, centers, out, count);
+}
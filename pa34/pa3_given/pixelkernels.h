@@ -0,0 +1,126 @@
+/**
+ * @file pixelkernels.h
+ * Batched colour arithmetic on packed RGBA pixels, used by the bottom
+ * levels of tree builds where pixels sit next to each other in memory.
+ *
+ * Every kernel has a scalar version and, on x86, SSE2 and AVX2 versions
+ * that give bit-identical results. The fastest one the processor supports
+ * is picked the first time a kernel runs; select() overrides the choice.
+ */
+
+#ifndef PIXELKERNELS_H
+#define PIXELKERNELS_H
+
+#include "rgbapixel.h"
+#include <cstddef>
+
+/**
+ * Averaging and distance kernels over runs of RGBAPixels. Averages are
+ * component-wise over all four channels and truncate, exactly as
+ * Quadtree and ArrayQuadtree average four children; distances are the
+ * squared RGB differences of Quadtree::prune.
+ */
+class PixelKernels
+{
+  public:
+    /**
+     * The instruction sets a kernel can be run with.
+     */
+    enum Level
+    {
+        SCALAR, /**< plain C++, always available */
+        SSE2,   /**< 128-bit vectors */
+        AVX2    /**< 256-bit vectors */
+    };
+
+    /**
+     * @return The instruction set the kernels currently run with
+     */
+    static Level level();
+
+    /**
+     * Makes the kernels run with the given instruction set, if this
+     * build and processor support it.
+     * @param level The instruction set to use
+     * @return Whether it is supported; if not, nothing changes
+     */
+    static bool select(Level level);
+
+    /**
+     * @param level An instruction set
+     * @return Its name, for reports
+     */
+    static char const* name(Level level);
+
+    /**
+     * Averages 2 by 2 blocks of two rows of pixels:
+     * out[i] = average of top[2i], top[2i+1], bottom[2i], bottom[2i+1].
+     * @param top The upper row, 2 * count pixels
+     * @param bottom The lower row, 2 * count pixels
+     * @param out Where the count averages go
+     * @param count Number of blocks
+     */
+    static void averageQuads(RGBAPixel const* top, RGBAPixel const* bottom,
+                             RGBAPixel* out, size_t count);
+
+    /**
+     * Averages groups of four consecutive pixels:
+     * out[i] = average of children[4i] to children[4i+3].
+     * @param children The groups, 4 * count pixels
+     * @param out Where the count averages go
+     * @param count Number of groups
+     */
+    static void averageGroups(RGBAPixel const* children, RGBAPixel* out, size_t count);
+
+    /**
+     * Finds, for each 2 by 2 block of two rows of pixels (laid out as for
+     * averageQuads), the largest squared RGB distance from a pixel of the
+     * block to the block's centre colour.
+     * @param top The upper row, 2 * count pixels
+     * @param bottom The lower row, 2 * count pixels
+     * @param centers The colour to measure each block from, count pixels
+     * @param out Where the count distances go
+     * @param count Number of blocks
+     */
+    static void quadDistances(RGBAPixel const* top, RGBAPixel const* bottom,
+                              RGBAPixel const* centers, int* out, size_t count);
+
+    /**
+     * @param first The first colour of comparison
+     * @param second The second colour of comparison
+     * @return The squared RGB distance between the two; alpha is ignored
+     */
+    static int distance(RGBAPixel const& first, RGBAPixel const& second)
+    {
+        int red = second.red - first.red;
+        int green = second.green - first.green;
+        int blue = second.blue - first.blue;
+        return red * red + green * green + blue * blue;
+    }
+
+  private:
+    /**
+     * One implementation of every kernel.
+     */
+    struct Table
+    {
+        Level level;
+        void (*averageQuads)(RGBAPixel const*, RGBAPixel const*, RGBAPixel*, size_t);
+        void (*averageGroups)(RGBAPixel const*, RGBAPixel*, size_t);
+        void (*quadDistances)(RGBAPixel const*, RGBAPixel const*, RGBAPixel const*,
+                              int*, size_t);
+    };
+
+    /**
+     * @return The implementations in use, chosen on first call
+     */
+    static Table& active();
+
+    /**
+     * @param level An instruction set
+     * @return Its implementations, or NULL if it cannot be used here
+     */
+    static Table const* table(Level level);
+};
+
+#endif
@@ -8,6 +8,7 @@
  * @date Modified: Summer 2012
  */
 
+#include <cassert>
 #include <cstdint>
 
 #include "png.h"
@@ -190,278 +191,485 @@ RGBAPixel const * PNG::operator()(size_t x, size_t y) const
 	return &(_pixel(x,y));
 }
 
+RGBAPixel * PNG::row(size_t y)
+{
+	assert(y < _height);
+	return _pixels + _width * y;
+}
+
+RGBAPixel const * PNG::row(size_t y) const
+{
+	assert(y < _height);
+	return _pixels + _width * y;
+}
+
+RGBAPixel * PNG::pixels()
+{
+	return _pixels;
+}
+
+RGBAPixel const * PNG::pixels() const
+{
+	return _pixels;
+}
+
 bool PNG::readFromFile(string const & file_name)
 {
 	_clear();
 	return _read_file(file_name);
 }
 
-// TODO: clean up error handling, too much dupe code right now
 bool PNG::_read_file(string const & file_name)
 {
-	// unfortunately, we need to break down to the C-code level here, since
-	// libpng is written in C itself
-
-	// we need to open the file in binary mode
-	FILE * fp = fopen(file_name.c_str(), "rb");
-	if (!fp)
+	PNGReader reader;
+	if (!reader.open(file_name, true))
 	{
-		epng_err("Failed to open " + file_name);
+		_init();
 		return false;
 	}
-
-	// read in the header (max size of 8), use it to validate this as a PNG file
-	png_byte header[8];
-	fread(header, 1, 8, fp);
-	if (png_sig_cmp(header, 0, 8))
+	_width = reader.width();
+	_height = reader.height();
+	_pixels = new RGBAPixel[_height * _width];
+	if (!reader.readRows(_pixels, _height) || !reader.close())
 	{
-		epng_err("File is not a valid PNG file");
-		fclose(fp);
 		_init();
 		return false;
 	}
+	return true;
+}
 
-	// set up libpng structs for reading info
-	png_structp png_ptr = png_create_read_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL); if (!png_ptr)
-	{
-		epng_err("Failed to create read struct");
-		fclose(fp);
-		_init();
+bool PNG::writeToFile(string const & file_name)
+{
+	PNGWriter writer;
+	if (!writer.open(file_name, _width, _height))
 		return false;
+	if (!writer.writeRows(_pixels, _height))
+		return false;
+	return writer.close();
+}
+
+size_t PNG::width() const
+{
+	return _width;
+}
+
+size_t PNG::height() const
+{
+	return _height;
+}
+
+void PNG::resize(size_t width_arg, size_t height_arg)
+{
+	_min_clamp_xy(width_arg, height_arg);
+	if (width_arg == _width && height_arg == _height)
+		return;
+
+	RGBAPixel * arr = _pixels;
+
+	// make a new array if needed
+	// will be all white because of RGBAPixel default constructor
+	bool new_arr = width_arg * height_arg > _width * _height;
+	if (new_arr)
+		arr = new RGBAPixel[width_arg*height_arg];
+
+	// copy over pixels
+	size_t min_width = (width_arg > _width) ? _width : width_arg;
+	size_t min_height = (height_arg > _height) ? _height : height_arg;
+	for (size_t x = 0; x < min_width; x++)
+		for (size_t y = 0; y < min_height; y++)
+			arr[x + y * width_arg] = _pixel(x,y);
+
+	// set new array if needed
+	if (new_arr)
+	{
+		delete [] _pixels;
+		_pixels = arr;
 	}
 
-	png_infop info_ptr = png_create_info_struct(png_ptr);
-	if (!info_ptr)
+	// overwrite width and height
+	_width = width_arg;
+	_height = height_arg;
+}
+
+PNGWriter::PNGWriter()
+{
+	_fp = NULL;
+	_png_ptr = NULL;
+	_info_ptr = NULL;
+	_row = NULL;
+	_width = 0;
+	_height = 0;
+	_rows_written = 0;
+}
+
+PNGWriter::~PNGWriter()
+{
+	if (_fp != NULL)
+		_cleanup();
+}
+
+void PNGWriter::_cleanup()
+{
+	if (_png_ptr != NULL)
+		png_destroy_write_struct(&_png_ptr, &_info_ptr);
+	if (_fp != NULL)
+		fclose(_fp);
+	delete [] _row;
+	_fp = NULL;
+	_png_ptr = NULL;
+	_info_ptr = NULL;
+	_row = NULL;
+}
+
+bool PNGWriter::open(string const & file_name, size_t width_arg, size_t height_arg)
+{
+	if (_fp != NULL)
+		_cleanup();
+
+	_fp = fopen(file_name.c_str(), "wb");
+	if (!_fp)
 	{
-		epng_err("Failed to create info struct");
-		png_destroy_read_struct(&png_ptr, NULL, NULL);
-		fclose(fp);
-		_init();
+		epng_err("Failed to open file " + file_name);
 		return false;
 	}
 
-	// set error handling to not abort the entire program
-	if (setjmp(png_jmpbuf(png_ptr)))
+	_png_ptr = png_create_write_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
+	if (!_png_ptr)
 	{
-		epng_err("Error initializing libpng io");
-		png_destroy_read_struct(&png_ptr, &info_ptr, NULL);
-		fclose(fp);
-		_init();
+		epng_err("Failed to create png struct");
+		_cleanup();
 		return false;
 	}
 
-	// initialize png reading
-	png_init_io(png_ptr, fp);
-	// let it know we've already read the first 8 bytes
-	png_set_sig_bytes(png_ptr, 8);
+	_info_ptr = png_create_info_struct(_png_ptr);
+	if (!_info_ptr)
+	{
+		epng_err("Failed to create png info struct");
+		_cleanup();
+		return false;
+	}
 
-	// read in the basic image info
-	png_read_info(png_ptr, info_ptr);
+	if (setjmp(png_jmpbuf(_png_ptr)))
+	{
+		epng_err("Error initializing libpng io");
+		_cleanup();
+		return false;
+	}
 
-	// convert to 8 bits
-	png_byte bit_depth = png_get_bit_depth(png_ptr, info_ptr);
-	if (bit_depth == 16)
-		png_set_strip_16(png_ptr);
+	png_init_io(_png_ptr, _fp);
 
-	// verify this is in RGBA format, and if not, convert it to RGBA
-	png_byte color_type = png_get_color_type(png_ptr, info_ptr);
-	if (color_type != PNG_COLOR_TYPE_RGBA && color_type != PNG_COLOR_TYPE_RGB)
+	// write header
+	if (setjmp(png_jmpbuf(_png_ptr)))
 	{
-		if (color_type == PNG_COLOR_TYPE_GRAY || color_type == PNG_COLOR_TYPE_GRAY_ALPHA) {
-			if (bit_depth < 8)
-				png_set_expand(png_ptr);
-			png_set_gray_to_rgb(png_ptr);
-		}
-		if (color_type == PNG_COLOR_TYPE_PALETTE)
-			png_set_palette_to_rgb(png_ptr);
+		epng_err("Error writing image header");
+		_cleanup();
+		return false;
 	}
-	// convert tRNS to alpha channel
-	if (png_get_valid(png_ptr, info_ptr, PNG_INFO_tRNS))
-		png_set_tRNS_to_alpha(png_ptr);
+	png_set_IHDR(_png_ptr, _info_ptr, width_arg, height_arg,
+			8,
+			PNG_COLOR_TYPE_RGB_ALPHA,
+			PNG_INTERLACE_NONE,
+			PNG_COMPRESSION_TYPE_BASE,
+			PNG_FILTER_TYPE_BASE);
 
-	_width = png_get_image_width(png_ptr, info_ptr);
-	_height = png_get_image_height(png_ptr, info_ptr);
+	png_write_info(_png_ptr, _info_ptr);
 
-	png_read_update_info(png_ptr, info_ptr);
+	_width = width_arg;
+	_height = height_arg;
+	_rows_written = 0;
+	_row = new png_byte[png_get_rowbytes(_png_ptr, _info_ptr)];
+	return true;
+}
 
-	// begin reading in the image
-	if (setjmp(png_jmpbuf(png_ptr)))
+bool PNGWriter::writeRows(RGBAPixel const * pixels, size_t rows)
+{
+	if (_fp == NULL || _rows_written + rows > _height)
 	{
-		epng_err("Error reading image with libpng");
-		png_destroy_read_struct(&png_ptr, &info_ptr, NULL);
-		fclose(fp);
-		_init();
+		epng_err("Attempted to write rows past the end of the image");
 		return false;
 	}
 
+	if (setjmp(png_jmpbuf(_png_ptr)))
+	{
+		epng_err("Failed to write image");
+		_cleanup();
+		return false;
+	}
 
-	int bpr = png_get_rowbytes(png_ptr, info_ptr); // number of bytes in a row
-	int numchannels = png_get_channels(png_ptr, info_ptr);
-
-	// initialie our image storage
-	_pixels = new RGBAPixel[_height * _width];
-	png_byte * row = new png_byte[bpr];
-	for (size_t y = 0; y < _height; y++)
+	for (size_t y = 0; y < rows; y++)
 	{
-		png_read_row(png_ptr, row, NULL);
-		png_byte * pix = row;
+		RGBAPixel const * line = pixels + y * _width;
 		for (size_t x = 0; x < _width; x++)
 		{
-			RGBAPixel & pixel = _pixel(x,y);
-			if (numchannels == 1 || numchannels == 2)
-			{
-				// monochrome
-				uint8_t color = (uint8_t) *pix++;
-				pixel.red = color;
-				pixel.green = color;
-				pixel.blue = color;
-				if (numchannels == 2)
-					pixel.alpha = (uint8_t) *pix++;
-				else
-					pixel.alpha = 255;
-			} 
-			else if (numchannels == 3 || numchannels == 4) 
-			{
-				pixel.red = (uint8_t) *pix++;
-				pixel.green = (uint8_t) *pix++;
-				pixel.blue = (uint8_t) *pix++;
-				if (numchannels == 4)
-					pixel.alpha = (uint8_t) *pix++;
-				else
-					pixel.alpha = 255;
-			}
+			png_byte * pix = &(_row[x*4]);
+			pix[0] = line[x].red;
+			pix[1] = line[x].green;
+			pix[2] = line[x].blue;
+			pix[3] = line[x].alpha;
 		}
+		png_write_row(_png_ptr, _row);
 	}
-	// cleanup
-	delete [] row;
-	png_read_end(png_ptr, NULL);
-	png_destroy_read_struct(&png_ptr, &info_ptr, NULL);
-	fclose(fp);
+	_rows_written += rows;
 	return true;
 }
 
-bool PNG::writeToFile(string const & file_name)
+bool PNGWriter::close()
 {
-	FILE * fp = fopen(file_name.c_str(), "wb");
-	if (!fp)
+	if (_fp == NULL)
+		return false;
+	if (_rows_written != _height)
 	{
-		epng_err("Failed to open file " + file_name);
+		epng_err("Image closed before all of its rows were written");
+		_cleanup();
 		return false;
 	}
 
-	png_structp png_ptr = png_create_write_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
-	if (!png_ptr)
+	if (setjmp(png_jmpbuf(_png_ptr)))
 	{
-		epng_err("Failed to create png struct");
-		fclose(fp);
+		epng_err("Failed to finish image");
+		_cleanup();
 		return false;
 	}
+	png_write_end(_png_ptr, NULL);
+	_cleanup();
+	return true;
+}
+
+PNGReader::PNGReader()
+{
+	_fp = NULL;
+	_png_ptr = NULL;
+	_info_ptr = NULL;
+	_row = NULL;
+	_width = 0;
+	_height = 0;
+	_rows_read = 0;
+	_row_bytes = 0;
+	_channels = 0;
+	_passes = 0;
+}
 
-	png_infop info_ptr = png_create_info_struct(png_ptr);
-	if (!info_ptr)
+PNGReader::~PNGReader()
+{
+	if (_fp != NULL)
+		_cleanup();
+}
+
+void PNGReader::_cleanup()
+{
+	if (_png_ptr != NULL)
+		png_destroy_read_struct(&_png_ptr, _info_ptr != NULL ? &_info_ptr : NULL, NULL);
+	if (_fp != NULL)
+		fclose(_fp);
+	delete [] _row;
+	_fp = NULL;
+	_png_ptr = NULL;
+	_info_ptr = NULL;
+	_row = NULL;
+	_width = 0;
+	_height = 0;
+	_rows_read = 0;
+	_row_bytes = 0;
+	_channels = 0;
+	_passes = 0;
+}
+
+bool PNGReader::open(string const & file_name, bool whole)
+{
+	if (_fp != NULL)
+		_cleanup();
+
+	// unfortunately, we need to break down to the C-code level here, since
+	// libpng is written in C itself
+	_fp = fopen(file_name.c_str(), "rb");
+	if (!_fp)
 	{
-		epng_err("Failed to create png info struct");
-		png_destroy_write_struct(&png_ptr, NULL);
-		fclose(fp);
+		epng_err("Failed to open " + file_name);
 		return false;
 	}
 
-	if (setjmp(png_jmpbuf(png_ptr)))
+	// read in the header (max size of 8), use it to validate this as a PNG file
+	png_byte header[8];
+	if (fread(header, 1, 8, _fp) != 8 || png_sig_cmp(header, 0, 8))
 	{
-		epng_err("Error initializing libpng io");
-		png_destroy_write_struct(&png_ptr, &info_ptr);
-		fclose(fp);
+		epng_err("File is not a valid PNG file");
+		_cleanup();
 		return false;
 	}
 
-	png_init_io(png_ptr, fp);
+	// set up libpng structs for reading info
+	_png_ptr = png_create_read_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
+	if (!_png_ptr)
+	{
+		epng_err("Failed to create read struct");
+		_cleanup();
+		return false;
+	}
 
-	// write header
-	if (setjmp(png_jmpbuf(png_ptr)))
+	_info_ptr = png_create_info_struct(_png_ptr);
+	if (!_info_ptr)
 	{
-		epng_err("Error writing image header");
-		png_destroy_write_struct(&png_ptr, &info_ptr);
-		fclose(fp);
+		epng_err("Failed to create info struct");
+		_cleanup();
 		return false;
 	}
-	png_set_IHDR(png_ptr, info_ptr, _width, _height, 
-			8,
-			PNG_COLOR_TYPE_RGB_ALPHA, 
-			PNG_INTERLACE_NONE, 
-			PNG_COMPRESSION_TYPE_BASE,
-			PNG_FILTER_TYPE_BASE);
 
-	png_write_info(png_ptr, info_ptr);
+	// set error handling to not abort the entire program
+	if (setjmp(png_jmpbuf(_png_ptr)))
+	{
+		epng_err("Error initializing libpng io");
+		_cleanup();
+		return false;
+	}
+
+	// initialize png reading
+	png_init_io(_png_ptr, _fp);
+	// let it know we've already read the first 8 bytes
+	png_set_sig_bytes(_png_ptr, 8);
 
-	// write image
-	if (setjmp(png_jmpbuf(png_ptr)))
+	// read in the basic image info
+	png_read_info(_png_ptr, _info_ptr);
+
+	// rows of an interlaced image only come together after the last pass
+	if (png_get_interlace_type(_png_ptr, _info_ptr) != PNG_INTERLACE_NONE && !whole)
 	{
-		epng_err("Failed to write image");
-		png_destroy_write_struct(&png_ptr, &info_ptr);
-		fclose(fp);
+		epng_err("Interlaced PNG files cannot be read row by row");
+		_cleanup();
 		return false;
 	}
+	_passes = png_set_interlace_handling(_png_ptr);
 
-	int bpr = png_get_rowbytes(png_ptr, info_ptr);
-	png_byte * row = new png_byte[bpr];
-	for (size_t y = 0; y < _height; y++)
+	// convert to 8 bits
+	png_byte bit_depth = png_get_bit_depth(_png_ptr, _info_ptr);
+	if (bit_depth == 16)
+		png_set_strip_16(_png_ptr);
+
+	// verify this is in RGBA format, and if not, convert it to RGBA
+	png_byte color_type = png_get_color_type(_png_ptr, _info_ptr);
+	if (color_type != PNG_COLOR_TYPE_RGBA && color_type != PNG_COLOR_TYPE_RGB)
 	{
-		for (size_t x = 0; x < _width; x++)
-		{
-			png_byte * pix = &(row[x*4]);
-			pix[0] = _pixel(x,y).red;
-			pix[1] = _pixel(x,y).green;
-			pix[2] = _pixel(x,y).blue;
-			pix[3] = _pixel(x,y).alpha;
+		if (color_type == PNG_COLOR_TYPE_GRAY || color_type == PNG_COLOR_TYPE_GRAY_ALPHA) {
+			if (bit_depth < 8)
+				png_set_expand(_png_ptr);
+			png_set_gray_to_rgb(_png_ptr);
 		}
-		png_write_row(png_ptr, row);
+		if (color_type == PNG_COLOR_TYPE_PALETTE)
+			png_set_palette_to_rgb(_png_ptr);
 	}
-	delete [] row;
-	png_write_end(png_ptr, NULL);
-	png_destroy_write_struct(&png_ptr, &info_ptr);
-	fclose(fp);
+	// convert tRNS to alpha channel
+	if (png_get_valid(_png_ptr, _info_ptr, PNG_INFO_tRNS))
+		png_set_tRNS_to_alpha(_png_ptr);
+
+	png_read_update_info(_png_ptr, _info_ptr);
+
+	_width = png_get_image_width(_png_ptr, _info_ptr);
+	_height = png_get_image_height(_png_ptr, _info_ptr);
+	_channels = png_get_channels(_png_ptr, _info_ptr);
+	_rows_read = 0;
+	_row_bytes = png_get_rowbytes(_png_ptr, _info_ptr);
+	// the passes of an interlaced image each fill in part of every row
+	_row = new png_byte[_passes > 1 ? _row_bytes * _height : _row_bytes];
 	return true;
 }
 
-size_t PNG::width() const
+size_t PNGReader::width() const
 {
 	return _width;
 }
 
-size_t PNG::height() const
+size_t PNGReader::height() const
 {
 	return _height;
 }
 
-void PNG::resize(size_t width_arg, size_t height_arg)
+bool PNGReader::readRows(RGBAPixel * pixels, size_t rows)
 {
-	_min_clamp_xy(width_arg, height_arg);
-	if (width_arg == _width && height_arg == _height)
-		return;
-
-	RGBAPixel * arr = _pixels;
+	if (_fp == NULL || _rows_read + rows > _height)
+	{
+		epng_err("Attempted to read rows past the end of the image");
+		return false;
+	}
+	if (_passes > 1 && rows != _height)
+	{
+		epng_err("Interlaced PNG files can only be read whole");
+		return false;
+	}
 
-	// make a new array if needed
-	// will be all white because of RGBAPixel default constructor
-	bool new_arr = width_arg * height_arg > _width * _height;
-	if (new_arr)
-		arr = new RGBAPixel[width_arg*height_arg];
+	if (setjmp(png_jmpbuf(_png_ptr)))
+	{
+		epng_err("Error reading image with libpng");
+		_cleanup();
+		return false;
+	}
 
-	// copy over pixels
-	size_t min_width = (width_arg > _width) ? _width : width_arg;
-	size_t min_height = (height_arg > _height) ? _height : height_arg;
-	for (size_t x = 0; x < min_width; x++)
-		for (size_t y = 0; y < min_height; y++)
-			arr[x + y * width_arg] = _pixel(x,y);
+	if (_passes > 1)
+	{
+		for (int pass = 0; pass < _passes; pass++)
+			for (size_t y = 0; y < rows; y++)
+				png_read_row(_png_ptr, _row + y * _row_bytes, NULL);
+		for (size_t y = 0; y < rows; y++)
+			_convert_row(_row + y * _row_bytes, pixels + y * _width);
+	}
+	else
+	{
+		for (size_t y = 0; y < rows; y++)
+		{
+			png_read_row(_png_ptr, _row, NULL);
+			_convert_row(_row, pixels + y * _width);
+		}
+	}
+	_rows_read += rows;
+	return true;
+}
 
-	// set new array if needed
-	if (new_arr)
+void PNGReader::_convert_row(png_byte const * row, RGBAPixel * line) const
+{
+	png_byte const * pix = row;
+	for (size_t x = 0; x < _width; x++)
 	{
-		delete [] _pixels;
-		_pixels = arr;
+		RGBAPixel & pixel = line[x];
+		if (_channels == 1 || _channels == 2)
+		{
+			// monochrome
+			uint8_t color = (uint8_t) *pix++;
+			pixel.red = color;
+			pixel.green = color;
+			pixel.blue = color;
+			if (_channels == 2)
+				pixel.alpha = (uint8_t) *pix++;
+			else
+				pixel.alpha = 255;
+		}
+		else if (_channels == 3 || _channels == 4)
+		{
+			pixel.red = (uint8_t) *pix++;
+			pixel.green = (uint8_t) *pix++;
+			pixel.blue = (uint8_t) *pix++;
+			if (_channels == 4)
+				pixel.alpha = (uint8_t) *pix++;
+			else
+				pixel.alpha = 255;
+		}
 	}
+}
 
-	// overwrite width and height
-	_width = width_arg;
-	_height = height_arg;
+bool PNGReader::close()
+{
+	if (_fp == NULL)
+		return false;
+
+	if (setjmp(png_jmpbuf(_png_ptr)))
+	{
+		epng_err("Error reading image with libpng");
+		_cleanup();
+		return false;
+	}
+	// png_read_end needs every row of every pass consumed first
+	if (_rows_read < _height)
+		for (int pass = 0; pass < _passes; pass++)
+			for (size_t y = pass == 0 ? _rows_read : 0; y < _height; y++)
+				png_read_row(_png_ptr, _row, NULL);
+	png_read_end(_png_ptr, NULL);
+	_cleanup();
+	return true;
 }
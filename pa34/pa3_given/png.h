@@ -109,6 +109,39 @@ class PNG
          */
         RGBAPixel const * operator()(size_t x, size_t y) const;
 
+        /**
+         * Unchecked row access. Gets a pointer to the first pixel of row
+         * y; the row's width() pixels follow it in memory, and each row
+         * directly follows the one above, so the image can be walked
+         * with plain pointer arithmetic. Unlike operator(), y is not
+         * clamped and nothing is printed: y must be below height(). In
+         * builds without NDEBUG, a y out of range fails an assertion.
+         * @param y Y-coordinate of the row.
+         * @return A pointer to pixel (0, y).
+         */
+        RGBAPixel * row(size_t y);
+
+        /**
+         * Const version of row(). Does not allow the image to be changed
+         * via the pointer.
+         * @param y Y-coordinate of the row.
+         * @return A pointer to pixel (0, y).
+         */
+        RGBAPixel const * row(size_t y) const;
+
+        /**
+         * Gets the whole pixel buffer: width() * height() pixels, row by
+         * row from the top, as row(0) would.
+         * @return A pointer to pixel (0, 0).
+         */
+        RGBAPixel * pixels();
+
+        /**
+         * Const version of pixels().
+         * @return A pointer to pixel (0, 0).
+         */
+        RGBAPixel const * pixels() const;
+
         /**
          * Reads in a PNG image from a file.
          * Overwrites any current image content in the PNG. In the event of
@@ -166,4 +199,143 @@ class PNG
         RGBAPixel & _pixel(size_t x, size_t y) const;
 };
 
+/**
+ * Writes a png formatted image to disk a band of rows at a time, so that
+ * an image can be produced without ever holding all of its pixels in
+ * memory. The file is identical to what PNG::writeToFile would produce
+ * for the same pixels.
+ */
+class PNGWriter
+{
+    public:
+        /**
+         * Creates a writer that is not yet attached to any file.
+         */
+        PNGWriter();
+
+        /**
+         * Destructor: closes the file if it is still open.
+         */
+        ~PNGWriter();
+
+        /**
+         * Creates the file and writes the png header for an image of the
+         * given size.
+         * @param file_name Name of the file to write to.
+         * @param width Width of the image.
+         * @param height Height of the image.
+         * @return Whether the file was opened and the header written.
+         */
+        bool open(string const & file_name, size_t width, size_t height);
+
+        /**
+         * Appends rows to the image.
+         * @param pixels The rows to append, row after row, each width
+         *	pixels long.
+         * @param rows The number of rows in pixels.
+         * @return Whether the rows were written.
+         */
+        bool writeRows(RGBAPixel const * pixels, size_t rows);
+
+        /**
+         * Finishes the image and closes the file. Every one of the height
+         * rows must have been written.
+         * @return Whether the image was completed successfully.
+         */
+        bool close();
+
+    private:
+        FILE * _fp;
+        png_structp _png_ptr;
+        png_infop _info_ptr;
+        png_byte * _row;
+        size_t _width;
+        size_t _height;
+        size_t _rows_written;
+
+        PNGWriter(PNGWriter const & other);
+        PNGWriter const & operator=(PNGWriter const & other);
+
+        // private helper functions
+        void _cleanup();
+};
+
+/**
+ * Reads a png formatted image from disk a band of rows at a time, so that
+ * an image can be consumed without ever holding all of its pixels in
+ * memory. Any png that PNG::readFromFile accepts is converted to the same
+ * 8 bit RGBA pixels. An interlaced png's rows only come together after
+ * the last of its passes, so it can only be read whole.
+ */
+class PNGReader
+{
+    public:
+        /**
+         * Creates a reader that is not yet attached to any file.
+         */
+        PNGReader();
+
+        /**
+         * Destructor: closes the file if it is still open.
+         */
+        ~PNGReader();
+
+        /**
+         * Opens the file and reads the png header.
+         * @param file_name Name of the file to read from.
+         * @param whole Whether the image will be read in a single call to
+         *	readRows, which lets interlaced images be opened too.
+         * @return Whether the file was opened and holds a png image that
+         *	can be read row by row (or whole, if asked).
+         */
+        bool open(string const & file_name, bool whole = false);
+
+        /**
+         * @return Width of the image, or 0 if no file is open.
+         */
+        size_t width() const;
+
+        /**
+         * @return Height of the image, or 0 if no file is open.
+         */
+        size_t height() const;
+
+        /**
+         * Reads the next rows of the image.
+         * @param pixels Where to put the rows, row after row, each width
+         *	pixels long.
+         * @param rows The number of rows to read; for an interlaced image,
+         *	all of them.
+         * @return Whether the rows were read; on failure the file is
+         *	closed.
+         */
+        bool readRows(RGBAPixel * pixels, size_t rows);
+
+        /**
+         * Finishes reading the image and closes the file. Rows that were
+         * not read are skipped.
+         * @return Whether the rest of the image was valid.
+         */
+        bool close();
+
+    private:
+        FILE * _fp;
+        png_structp _png_ptr;
+        png_infop _info_ptr;
+        png_byte * _row;
+        size_t _width;
+        size_t _height;
+        size_t _rows_read;
+        size_t _row_bytes;
+        int _channels;
+        int _passes;
+
+        PNGReader(PNGReader const & other);
+        PNGReader const & operator=(PNGReader const & other);
+
+        // private helper functions
+        void _cleanup();
+        void _convert_row(png_byte const * row, RGBAPixel * line) const;
+};
+
 #endif // EPNG_H
@@ -3,24 +3,55 @@
  * Quadtree class implementation.
  */
 
+#include <algorithm>
+#include <climits>
+#include <cmath>
 #include <cstddef>
+#include <cstdint>
 #include <cstdlib>
+#include <functional>
 #include <iostream>
+#include <limits>
+#include <queue>
+#include <unordered_map>
 
 using namespace std;
 
 #include "quadtree.h"
 #include "png.h"
+#include "pixelkernels.h"
+#include "quadtreefile.h"
+#include "quadtreestream.h"
+#include "threadpool.h"
+
+bool Quadtree::pooling = true;
+Quadtree::QuadtreeNode Quadtree::padding;
+
+/**
+ * The splitmix64 finalizer, which spreads every bit of value over the
+ * whole result; the content hashes are built from it.
+ */
+static uint64_t mix(uint64_t value)
+{
+	value = (value ^ (value >> 30)) * 0xbf58476d1ce4e5b9ULL;
+	value = (value ^ (value >> 27)) * 0x94d049bb133111ebULL;
+	return value ^ (value >> 31);
+}
 
 // Quadtree
 //   - parameters: none
 //   - constructor for the Quadtree class; makes an empty tree
-Quadtree::Quadtree() 
+Quadtree::Quadtree()
+	: root(this)
 {
-	// set root to NULL
-	root = NULL;
+	// set root to NULL; the pool comes with the first build or load
+	rootNode = NULL;
 	// empty image
 	res = 0;
+	imgWidth = imgHeight = 0;
+	xOffset = yOffset = 0;
+	rotation = 0;
+	flipped = false;
 }
 
 // Quadtree
@@ -32,9 +63,22 @@ Quadtree::Quadtree()
 //        the resolution by resolution block in the upper-left corner of
 //        source
 Quadtree::Quadtree(PNG const& source, int setresolution)
+	: root(this)
+{
+	rootNode = NULL;
+	buildTree(source, setresolution);
+}
+
+// Quadtree
+//   - parameters: PNG const & source - reference to a const PNG
+//                    object, from which the Quadtree will be built
+//   - constructor for the Quadtree class; creates a Quadtree representing
+//        all of source, of any width and height
+Quadtree::Quadtree(PNG const& source)
+	: root(this)
 {
-	res = setresolution;
-	build(source, root, res, 0, 0);
+	rootNode = NULL;
+	buildTree(source);
 }
 
 /**
@@ -48,14 +92,25 @@ Quadtree::Quadtree(PNG const& source, int setresolution)
  */
 void Quadtree::build(PNG const& source, QuadtreeNode* & subRoot, int res, int x, int y) {
 	// base case, condition: single pixel resolution
+	// quadrants made only of padding share the padding leaf
+	if (!inImage(res, x, y)) {
+		subRoot = &padding;
+		return;
+	}
 	if (res == 1) {
 		// make a new node with NULL children and pixel as element
-		subRoot = new QuadtreeNode(*source(x, y));
+		subRoot = nodePool->create(source.row(y)[x]);
+		return;
+	}
+	// small blocks with every pixel in the image go level by level
+	if (res <= kernelBlock && x >= xOffset && y >= yOffset
+		&& x + res <= xOffset + imgWidth && y + res <= yOffset + imgHeight) {
+		buildBlock(source, subRoot, res, x, y);
 		return;
 	}
 	else {
 		// general case
-		subRoot = new QuadtreeNode();
+		subRoot = nodePool->create();
 
 		// recursive calls for subRoot's children
 		// take res / 2 since res * res image
@@ -65,19 +120,548 @@ void Quadtree::build(PNG const& source, QuadtreeNode* & subRoot, int res, int x,
 		build(source, subRoot->swChild, res / 2, x, y + res / 2);
 		build(source, subRoot->seChild, res / 2, x + res / 2, y + res / 2);
 
-		// component wise averages for RGBA
-		int red = (subRoot->nwChild->element.red + subRoot->neChild->element.red +
-			subRoot->swChild->element.red + subRoot->seChild->element.red) / 4;
-		int green = (subRoot->nwChild->element.green + subRoot->neChild->element.green +
-			subRoot->swChild->element.green + subRoot->seChild->element.green) / 4;
-		int blue = (subRoot->nwChild->element.blue + subRoot->neChild->element.blue +
-			subRoot->swChild->element.blue + subRoot->seChild->element.blue) / 4;
-		int alpha = (subRoot->nwChild->element.alpha + subRoot->neChild->element.alpha +
-			subRoot->swChild->element.alpha + subRoot->seChild->element.alpha) / 4;
+		average(subRoot);
+		summarize(subRoot);
+	}
+}
+
+/**
+ * Private helper function for build: builds the subtree of a block of
+ * at most kernelBlock pixels a side lying wholly inside the image. Each
+ * level's colours are averaged a row at a time from the level below,
+ * starting from the image rows, and the bottom internal level's
+ * statistics come from the same rows; the nodes are then linked up.
+ * @param source The source image file in PNG format
+ * @param subRoot Set to the root of the new subtree
+ * @param res The side of the block, a power of two
+ * @param x The x coordinate of the block's upper-left pixel
+ * @param y The y coordinate of the block's upper-left pixel
+ */
+void Quadtree::buildBlock(PNG const& source, QuadtreeNode* & subRoot, int res, int x, int y) {
+	// nodes and colours of the level below and of the level being built,
+	// both row by row
+	QuadtreeNode* nodeBuffers[2][kernelBlock * kernelBlock];
+	RGBAPixel colorBuffers[2][kernelBlock * kernelBlock / 4];
+	QuadtreeNode** below = nodeBuffers[0];
+	QuadtreeNode** level = nodeBuffers[1];
+	RGBAPixel* belowColors = colorBuffers[0];
+	RGBAPixel* colors = colorBuffers[1];
+
+	// leaves, straight from the image
+	for (int j = 0; j < res; j++) {
+		RGBAPixel const* row = source.row(y + j) + x;
+		for (int i = 0; i < res; i++)
+			below[j * res + i] = nodePool->create(row[i]);
+	}
+
+	for (int side = res / 2; side >= 1; side /= 2) {
+		// average pairs of rows of the level below
+		int distances[kernelBlock * kernelBlock / 4];
+		for (int j = 0; j < side; j++) {
+			if (side == res / 2) {
+				RGBAPixel const* top = source.row(y + 2 * j) + x;
+				RGBAPixel const* bottom = source.row(y + 2 * j + 1) + x;
+				PixelKernels::averageQuads(top, bottom, colors + j * side, side);
+				PixelKernels::quadDistances(top, bottom, colors + j * side, distances + j * side, side);
+			}
+			else {
+				RGBAPixel const* top = belowColors + 4 * j * side;
+				PixelKernels::averageQuads(top, top + 2 * side, colors + j * side, side);
+			}
+		}
+
+		for (int j = 0; j < side; j++) {
+			for (int i = 0; i < side; i++) {
+				QuadtreeNode* nw = below[(2 * j) * (2 * side) + 2 * i];
+				QuadtreeNode* ne = below[(2 * j) * (2 * side) + 2 * i + 1];
+				QuadtreeNode* sw = below[(2 * j + 1) * (2 * side) + 2 * i];
+				QuadtreeNode* se = below[(2 * j + 1) * (2 * side) + 2 * i + 1];
+				// the farthest leaf of the bottom level was found with the
+				// averages
+				if (side == res / 2) {
+					level[j * side + i] = joinLeaves(nw, ne, sw, se, colors[j * side + i],
+					                                 distances[j * side + i]);
+					continue;
+				}
+				QuadtreeNode* node = nodePool->create();
+				node->element = colors[j * side + i];
+				node->nwChild = nw;
+				node->neChild = ne;
+				node->swChild = sw;
+				node->seChild = se;
+				summarize(node);
+				level[j * side + i] = node;
+			}
+		}
+		swap(below, level);
+		swap(belowColors, colors);
+	}
+	subRoot = below[0];
+}
+
+/**
+ * Private helper function for buildBlock and joinPixelRows: creates the
+ * parent of four leaves and gives it its leaf statistics.
+ * @param nw The northwest leaf
+ * @param ne The northeast leaf
+ * @param sw The southwest leaf
+ * @param se The southeast leaf
+ * @param color The average of the four
+ * @param distance The largest difference between color and a leaf
+ * @return The new parent
+ */
+Quadtree::QuadtreeNode* Quadtree::joinLeaves(QuadtreeNode* nw, QuadtreeNode* ne,
+                                             QuadtreeNode* sw, QuadtreeNode* se,
+                                             RGBAPixel const& color, int distance) {
+	QuadtreeNode* node = nodePool->create(color);
+	node->nwChild = nw;
+	node->neChild = ne;
+	node->swChild = sw;
+	node->seChild = se;
+
+	// the children are leaves: their bounds are their colours
+	QuadtreeNode* children[4] = {nw, ne, sw, se};
+	node->low = node->high = nw->element;
+	for (int c = 1; c < 4; c++) {
+		RGBAPixel const& leaf = children[c]->element;
+		node->low.red = min(node->low.red, leaf.red);
+		node->low.green = min(node->low.green, leaf.green);
+		node->low.blue = min(node->low.blue, leaf.blue);
+		node->high.red = max(node->high.red, leaf.red);
+		node->high.green = max(node->high.green, leaf.green);
+		node->high.blue = max(node->high.blue, leaf.blue);
+	}
+	node->maxDiff = node->pruneFloor = distance;
+	node->hash = contentHash(node);
+	return node;
+}
+
+/**
+ * Private helper function that sets an internal node's element to
+ * the component-wise average of its children. Border nodes average only
+ * the children they have, so padding never leaks into a colour.
+ * @param subRoot The node to update
+ */
+void Quadtree::average(QuadtreeNode* subRoot) {
+	QuadtreeNode* children[4] = {subRoot->nwChild, subRoot->neChild,
+		subRoot->swChild, subRoot->seChild};
+
+	// component wise sums for RGBA
+	int red = 0, green = 0, blue = 0, alpha = 0, count = 0;
+	for (int i = 0; i < 4; i++) {
+		if (children[i] == &padding)
+			continue;
+		red += children[i]->element.red;
+		green += children[i]->element.green;
+		blue += children[i]->element.blue;
+		alpha += children[i]->element.alpha;
+		count++;
+	}
+
+	// store averages of all children in current node's element
+	subRoot->element = RGBAPixel(red / count, green / count, blue / count, alpha / count);
+}
+
+/**
+ * Private helper function that tells whether a block of the grid overlaps
+ * the image.
+ * @param res The side of the block
+ * @param x The x coordinate of the block's upper-left grid cell
+ * @param y The y coordinate of the block's upper-left grid cell
+ * @return true if at least one pixel of the block is in the image
+ */
+bool Quadtree::inImage(int res, int x, int y) const {
+	return x < xOffset + imgWidth && x + res > xOffset
+		&& y < yOffset + imgHeight && y + res > yOffset;
+}
+
+// Quadtree
+//   - parameters: PNG const & source - reference to a const PNG
+//                    object, from which the Quadtree will be built
+//                 int resolution - resolution of the portion of source
+//                    from which this tree will be built
+//                 int numThreads - number of threads to build with
+//   - constructor for the Quadtree class; same tree as the serial one
+Quadtree::Quadtree(PNG const& source, int setresolution, int numThreads)
+	: root(this)
+{
+	rootNode = NULL;
+	res = 0;
+	buildTree(source, setresolution, numThreads);
+}
+
+// buildTree (public interface)
+//   - parameters: PNG const & source - reference to a const PNG
+//                    object, from which the Quadtree will be built
+//                 int resolution - resolution of the portion of source
+//                    from which this tree will be built
+//                 int numThreads - number of threads to build with
+//   - multi-threaded version of buildTree; falls back to the serial build
+//        for a single thread or a small resolution
+void Quadtree::buildTree(PNG const& source, int setresolution, int numThreads)
+{
+	buildTree(source, setresolution, setresolution, numThreads);
+}
+
+// buildTree (public interface)
+//   - parameters: PNG const & source - reference to a const PNG
+//                    object, from which the Quadtree will be built
+//   - transforms the current Quadtree into a Quadtree representing all of
+//        source
+void Quadtree::buildTree(PNG const& source)
+{
+	buildTree(source, (int) source.width(), (int) source.height(), 1);
+}
+
+// buildTree (public interface)
+//   - parameters: PNG const & source - reference to a const PNG
+//                    object, from which the Quadtree will be built
+//                 int width, int height - size of the portion of source
+//                    from which this tree will be built
+//                 int numThreads - number of threads to build with
+//   - transforms the current Quadtree into a Quadtree representing the
+//        width by height block in the upper-left corner of source, laid
+//        out on the smallest power of two grid that holds it
+void Quadtree::buildTree(PNG const& source, int width, int height, int numThreads)
+{
+	// the builders read source a row at a time, unchecked; a block wider
+	// or taller than source is read from a copy filled in the way
+	// operator() clamps
+	if (width > (int) source.width() || height > (int) source.height()) {
+		PNG padded((size_t) max(width, 1), (size_t) max(height, 1));
+		for (int y = 0; y < height; y++)
+			for (int x = 0; x < width; x++)
+				*padded(x, y) = *source(x, y);
+		buildTree(padded, width, height, numThreads);
+		return;
+	}
+
+	// delete contents of current Quadtree object
+	release();
+	ownPool();
+	curve.reset();
+	xOffset = yOffset = 0;
+	rotation = 0;
+	flipped = false;
+	imgWidth = max(width, 0);
+	imgHeight = max(height, 0);
+	res = 0;
+	if (imgWidth == 0 || imgHeight == 0) {
+		imgWidth = imgHeight = 0;
+		return;
+	}
+
+	res = 1;
+	while (res < max(imgWidth, imgHeight))
+		res *= 2;
+
+	// small builds are not worth starting threads for
+	if (numThreads <= 1 || res <= parallelCutoff) {
+		build(source, rootNode, res, 0, 0);
+		return;
+	}
+	ThreadPool pool(numThreads);
+	parallelBuild(pool, source, rootNode, res, 0, 0);
+}
+
+// buildFromFile (public interface)
+//   - parameters: string const & fileName - png file to build from
+//   - return value: whether the file was read
+//   - transforms the current Quadtree into a Quadtree representing the
+//        image in fileName, read and joined up a row at a time
+bool Quadtree::buildFromFile(string const& fileName)
+{
+	release();
+	ownPool();
+	curve.reset();
+	res = imgWidth = imgHeight = xOffset = yOffset = rotation = 0;
+	flipped = false;
+
+	PNGReader in;
+	if (!in.open(fileName))
+		return false;
+	int width = (int) in.width(), height = (int) in.height();
+	int depth = 0;
+	while ((1 << depth) < max(width, height))
+		depth++;
+
+	// the current pair of pixel rows, and for each level the row of
+	// nodes waiting for the row below it
+	vector<RGBAPixel> pixels(2 * (size_t) width);
+	vector<vector<QuadtreeNode*> > waiting(depth + 1);
+	vector<QuadtreeNode*> row;
+	bool read = true;
+	for (int y = 0; y < height && read; y++) {
+		read = in.readRows(&pixels[(y % 2) * width], 1);
+		if (!read)
+			break;
+		if (depth == 0)
+			rootNode = nodePool->create(pixels[0]);
+		else if (y % 2 == 1 || y == height - 1) {
+			joinPixelRows(&pixels[0], y % 2 == 1 ? &pixels[width] : NULL, width, row);
+			addRow(waiting, 1, row);
+		}
+	}
+	if (!read || !in.close()) {
+		for (size_t level = 0; level < waiting.size(); level++)
+			for (size_t i = 0; i < waiting[level].size(); i++)
+				clear(waiting[level][i]);
+		clear(rootNode);
+		return false;
+	}
+
+	// the last row of a level has nothing below it to wait for
+	for (int level = 1; level < depth; level++) {
+		if (waiting[level].empty())
+			continue;
+		joinRows(waiting[level], NULL, row);
+		waiting[level].clear();
+		addRow(waiting, level + 1, row);
+	}
+	res = 1 << depth;
+	imgWidth = width;
+	imgHeight = height;
+	return true;
+}
+
+/**
+ * Private helper function for buildFromFile that builds the bottom
+ * internal level under a pair of image rows: one node per two columns,
+ * with its leaves. Whole 2 by 2 blocks go through the batched
+ * PixelKernels, as in buildBlock.
+ * @param top The upper row, width pixels
+ * @param bottom The lower row, or NULL if the upper row is the last
+ * @param width The number of pixels in a row
+ * @param out Set to the new nodes, left to right
+ */
+void Quadtree::joinPixelRows(RGBAPixel const* top, RGBAPixel const* bottom, int width,
+                             vector<QuadtreeNode*>& out) {
+	out.resize((width + 1) / 2);
+
+	// whole blocks, a batch at a time
+	int whole = bottom == NULL ? 0 : width / 2;
+	RGBAPixel colors[kernelBlock * kernelBlock / 4];
+	int distances[kernelBlock * kernelBlock / 4];
+	for (int first = 0; first < whole; first += kernelBlock * kernelBlock / 4) {
+		int count = min(kernelBlock * kernelBlock / 4, whole - first);
+		RGBAPixel const* upper = top + 2 * first;
+		RGBAPixel const* lower = bottom + 2 * first;
+		PixelKernels::averageQuads(upper, lower, colors, count);
+		PixelKernels::quadDistances(upper, lower, colors, distances, count);
+		for (int k = 0; k < count; k++) {
+			QuadtreeNode* nw = nodePool->create(upper[2 * k]);
+			QuadtreeNode* ne = nodePool->create(upper[2 * k + 1]);
+			QuadtreeNode* sw = nodePool->create(lower[2 * k]);
+			QuadtreeNode* se = nodePool->create(lower[2 * k + 1]);
+			out[first + k] = joinLeaves(nw, ne, sw, se, colors[k], distances[k]);
+		}
+	}
+
+	// blocks cut by the right or bottom edge of the image
+	for (int i = whole; i < (int) out.size(); i++) {
+		int x = 2 * i;
+		bool east = x + 1 < width;
+		QuadtreeNode* node = nodePool->create();
+		node->nwChild = nodePool->create(top[x]);
+		node->neChild = east ? nodePool->create(top[x + 1]) : &padding;
+		node->swChild = node->seChild = &padding;
+		if (bottom != NULL) {
+			node->swChild = nodePool->create(bottom[x]);
+			node->seChild = east ? nodePool->create(bottom[x + 1]) : &padding;
+		}
+		average(node);
+		summarize(node);
+		out[i] = node;
+	}
+}
+
+/**
+ * Private helper function for buildFromFile that joins two rows of nodes
+ * of one level into the row of their parents.
+ * @param top The upper row
+ * @param bottom The lower row, or NULL if the upper row is the last of
+ *  its level
+ * @param out Set to the parents, left to right
+ */
+void Quadtree::joinRows(vector<QuadtreeNode*> const& top, vector<QuadtreeNode*> const* bottom,
+                        vector<QuadtreeNode*>& out) {
+	out.resize((top.size() + 1) / 2);
+	for (size_t i = 0; i < out.size(); i++) {
+		size_t x = 2 * i;
+		bool east = x + 1 < top.size();
+		QuadtreeNode* node = nodePool->create();
+		node->nwChild = top[x];
+		node->neChild = east ? top[x + 1] : &padding;
+		node->swChild = node->seChild = &padding;
+		if (bottom != NULL) {
+			node->swChild = (*bottom)[x];
+			node->seChild = east ? (*bottom)[x + 1] : &padding;
+		}
+		average(node);
+		summarize(node);
+		out[i] = node;
+	}
+}
+
+/**
+ * Private helper function for buildFromFile that hands a finished row of
+ * nodes to its level. The first row of a pair waits there for the second;
+ * the second is joined with it and the parents' row is handed on up, and
+ * the single node of the top level becomes the root.
+ * @param waiting For each level, its row waiting for a partner, or an
+ *  empty row
+ * @param level The level of row; the leaves are level 0
+ * @param row The finished row; emptied
+ */
+void Quadtree::addRow(vector<vector<QuadtreeNode*> >& waiting, int level,
+                      vector<QuadtreeNode*>& row) {
+	vector<QuadtreeNode*> parents;
+	for (; level + 1 < (int) waiting.size(); level++) {
+		if (waiting[level].empty()) {
+			waiting[level].swap(row);
+			return;
+		}
+		joinRows(waiting[level], &row, parents);
+		waiting[level].clear();
+		row.swap(parents);
+	}
+	rootNode = row[0];
+	row.clear();
+}
+
+// width
+//   - return value: the width of the represented image
+int Quadtree::width() const
+{
+	// a quarter turn swaps the sides
+	return rotation % 2 == 0 ? imgWidth : imgHeight;
+}
+
+// height
+//   - return value: the height of the represented image
+int Quadtree::height() const
+{
+	return rotation % 2 == 0 ? imgHeight : imgWidth;
+}
+
+/**
+ * Private helper function for the multi-threaded buildTree.
+ * @param pool The pool to fork quadrant builds onto
+ * @param source The source image file in PNG format
+ * @param subRoot The current node in the recursion
+ * @param res The resolution of the current Quadtree in the recursion
+ * @param x The x axis value corresponding to a QuadtreeNode
+ * @param y The y axis value corresponding to a QuadtreeNode
+ */
+void Quadtree::parallelBuild(ThreadPool& pool, PNG const& source, QuadtreeNode* & subRoot,
+                             int res, int x, int y) {
+	// small enough, or all padding: no point paying for a task
+	if (res <= parallelCutoff || !inImage(res, x, y)) {
+		build(source, subRoot, res, x, y);
+		return;
+	}
+
+	subRoot = nodePool->create();
+	QuadtreeNode* node = subRoot;
+	int half = res / 2;
+
+	// the quadrants are independent until their parent averages them,
+	// so three of them go to the pool and this thread builds the fourth
+	TaskGroup quadrants;
+	pool.fork(quadrants, [&, node] {
+		parallelBuild(pool, source, node->nwChild, half, x, y);
+	});
+	pool.fork(quadrants, [&, node] {
+		parallelBuild(pool, source, node->neChild, half, x + half, y);
+	});
+	pool.fork(quadrants, [&, node] {
+		parallelBuild(pool, source, node->swChild, half, x, y + half);
+	});
+	parallelBuild(pool, source, node->seChild, half, x + half, y + half);
+	pool.join(quadrants);
 
-		// store averages of all children in current node's element
-		subRoot->element = RGBAPixel(red, green, blue, alpha);
+	average(node);
+	summarize(node);
+}
+
+/**
+ * Private helper function that refreshes the cached leaf statistics of a
+ * node from its children, which must already be up to date.
+ * @param subRoot The node to update
+ */
+void Quadtree::summarize(QuadtreeNode* subRoot) {
+	subRoot->hash = contentHash(subRoot);
+
+	// a leaf is its own only leaf
+	if (subRoot->isLeaf()) {
+		subRoot->low = subRoot->high = subRoot->element;
+		subRoot->maxDiff = 0;
+		subRoot->pruneFloor = INT_MAX;
+		return;
+	}
+
+	// gather the children inside the image; border nodes may have some
+	// quadrants outside it
+	QuadtreeNode* children[4];
+	int count = 0;
+	QuadtreeNode* all[4] = {subRoot->nwChild, subRoot->neChild,
+		subRoot->swChild, subRoot->seChild};
+	for (int i = 0; i < 4; i++)
+		if (all[i] != &padding)
+			children[count++] = all[i];
+
+	// per-channel bounds are just the bounds of the children's bounds
+	subRoot->low = children[0]->low;
+	subRoot->high = children[0]->high;
+	for (int i = 1; i < count; i++) {
+		subRoot->low.red = min(subRoot->low.red, children[i]->low.red);
+		subRoot->low.green = min(subRoot->low.green, children[i]->low.green);
+		subRoot->low.blue = min(subRoot->low.blue, children[i]->low.blue);
+		subRoot->high.red = max(subRoot->high.red, children[i]->high.red);
+		subRoot->high.green = max(subRoot->high.green, children[i]->high.green);
+		subRoot->high.blue = max(subRoot->high.blue, children[i]->high.blue);
 	}
+
+	// the farthest leaf has to be searched for, since it is measured from
+	// this node's own average; the bounds let the search skip most of it
+	int best = 0;
+	for (int i = 0; i < count; i++)
+		best = farthestLeaf(children[i], subRoot->element, best);
+	subRoot->maxDiff = best;
+
+	// the lowest tolerance at which pruning changes anything in here
+	subRoot->pruneFloor = best;
+	for (int i = 0; i < count; i++)
+		subRoot->pruneFloor = min(subRoot->pruneFloor, children[i]->pruneFloor);
+}
+
+/**
+ * Private helper function that finds the largest difference between
+ * point and any leaf below subRoot. Subtrees whose colour bounds cannot
+ * beat the best difference found so far are skipped.
+ * @param subRoot The current node in the recursion
+ * @param point The colour to measure from
+ * @param best The largest difference found so far
+ * @return max(best, largest difference in this subtree)
+ */
+int Quadtree::farthestLeaf(QuadtreeNode const* subRoot, RGBAPixel const& point, int best) const {
+	if (subRoot == &padding)
+		return best;
+	if (subRoot->isLeaf())
+		return max(best, diff(subRoot->element, point));
+
+	// farthest corner of the subtree's colour box, channel by channel
+	int red = max(point.red - subRoot->low.red, subRoot->high.red - point.red);
+	int green = max(point.green - subRoot->low.green, subRoot->high.green - point.green);
+	int blue = max(point.blue - subRoot->low.blue, subRoot->high.blue - point.blue);
+	if (red * red + green * green + blue * blue <= best)
+		return best;
+
+	best = farthestLeaf(subRoot->nwChild, point, best);
+	best = farthestLeaf(subRoot->neChild, point, best);
+	best = farthestLeaf(subRoot->swChild, point, best);
+	best = farthestLeaf(subRoot->seChild, point, best);
+	return best;
 }
 
 
@@ -85,10 +669,19 @@ void Quadtree::build(PNG const& source, QuadtreeNode* & subRoot, int res, int x,
 //   - parameters: Quadtree const & other - reference to a const Quadtree
 //                    object, which the current Quadtree will be a copy of
 //   - copy constructor for the Quadtree class
-Quadtree::Quadtree(Quadtree const& other) 
-{ 
+Quadtree::Quadtree(Quadtree const& other)
+	: root(this)
+{
 	res = other.res;
-	root = copy(other.root);
+	imgWidth = other.imgWidth;
+	imgHeight = other.imgHeight;
+	xOffset = other.xOffset;
+	yOffset = other.yOffset;
+	rotation = other.rotation;
+	flipped = other.flipped;
+	rootNode = copy(other.rootNode);
+	nodePool = other.nodePool;
+	curve = atomic_load(&other.curve);
 }
 
 // ~Quadtree
@@ -96,26 +689,115 @@ Quadtree::Quadtree(Quadtree const& other)
 //   - destructor for the Quadtree class
 Quadtree::~Quadtree()
 {
-	clear(root);
+	release();
 }
 
 /**
- * Private helper function for Quadtree destructor that clears beneath the parameter node
+ * Private helper function for Quadtree destructor that clears beneath the parameter node.
+ * Nodes still shared with another tree are only let go of, not freed.
  * @param subRoot The current node in the recursion
  */
 void Quadtree::clear(QuadtreeNode* & subRoot) {
 	if (subRoot == NULL)
 		return;
-	else {
+	// the last owner to let go frees the node; the padding leaf has none
+	if (subRoot != &padding && subRoot->refs.fetch_sub(1) == 1) {
 		// clear node and it's quad children recursively
 		clear(subRoot->nwChild);
 		clear(subRoot->neChild);
 		clear(subRoot->swChild);
 		clear(subRoot->seChild);
 
-		delete subRoot;
-		subRoot = NULL;
+		nodePool->destroy(subRoot);
+	}
+	subRoot = NULL;
+}
+
+/**
+ * Private helper function that lets go of the whole tree. If no other
+ * tree uses the pool, every node is freed at once by resetting it;
+ * otherwise the tree is cleared node by node.
+ */
+void Quadtree::release() {
+	// no other tree can reach a node of a pool only this tree uses
+	if (rootNode != NULL && nodePool.use_count() == 1 && nodePool->pooled()) {
+		nodePool->reset();
+		rootNode = NULL;
+		return;
+	}
+	clear(rootNode);
+}
+
+/**
+ * Private helper function for building or loading an empty tree: gives
+ * it a pool of its own, with the current pooling choice, unless it is
+ * already the only user of such a pool.
+ */
+void Quadtree::ownPool() {
+	if (nodePool.use_count() != 1 || nodePool->pooled() != pooling)
+		nodePool = make_shared<NodePool<QuadtreeNode> >(pooling);
+}
+
+/**
+ * Private helper function for prune and compress: once nodes have been
+ * freed, moves the tree into a new pool if it is the only user of its
+ * pool and uses less than a quarter of the pool's room, so the slabs of
+ * a heavily pruned tree are given back.
+ */
+void Quadtree::compact() {
+	if (rootNode == NULL || nodePool.use_count() != 1 || !nodePool->pooled()
+		|| nodePool->live() * 4 >= nodePool->capacity())
+		return;
+	shared_ptr<NodePool<QuadtreeNode> > fresh = make_shared<NodePool<QuadtreeNode> >(true);
+	unordered_map<QuadtreeNode const*, QuadtreeNode*> moved;
+	rootNode = relocate(rootNode, *fresh, moved);
+	// the old nodes go with their pool
+	nodePool = fresh;
+}
+
+/**
+ * Private helper function for compact that copies a subtree, colours and
+ * statistics included, into another pool. A node the subtree reaches
+ * more than once is copied once, and the copy shared alike.
+ * @param subRoot The current node in the recursion
+ * @param into The pool to take the copies from
+ * @param moved The copies made so far of nodes with several owners
+ * @return The copy of subRoot
+ */
+Quadtree::QuadtreeNode* Quadtree::relocate(QuadtreeNode const* subRoot,
+                                           NodePool<QuadtreeNode>& into,
+                                           unordered_map<QuadtreeNode const*, QuadtreeNode*>& moved) {
+	if (subRoot == NULL)
+		return NULL;
+	if (subRoot == &padding)
+		return &padding;
+	// only a node with several owners can be reached again
+	bool shared = subRoot->refs.load() > 1;
+	if (shared) {
+		auto found = moved.find(subRoot);
+		if (found != moved.end())
+			return copy(found->second);
 	}
+	QuadtreeNode* node = into.create(subRoot->element);
+	if (shared)
+		moved[subRoot] = node;
+	node->low = subRoot->low;
+	node->high = subRoot->high;
+	node->maxDiff = subRoot->maxDiff;
+	node->pruneFloor = subRoot->pruneFloor;
+	node->hash = subRoot->hash;
+	node->nwChild = relocate(subRoot->nwChild, into, moved);
+	node->neChild = relocate(subRoot->neChild, into, moved);
+	node->swChild = relocate(subRoot->swChild, into, moved);
+	node->seChild = relocate(subRoot->seChild, into, moved);
+	return node;
+}
+
+// setNodePooling (public interface)
+//   - parameters: bool pooled - whether new trees pool their nodes
+void Quadtree::setNodePooling(bool pooled)
+{
+	pooling = pooled;
 }
 
 // operator=
@@ -127,32 +809,49 @@ Quadtree const& Quadtree::operator=(Quadtree const& other)
 {
 	// guard for self assignment
 	if (this != &other) {
-		// clear previous root contents
-		clear(root);
-		// set res
+		// share other's nodes before letting go of ours, which may be
+		// the same ones
+		QuadtreeNode* shared = copy(other.rootNode);
+		release();
+		rootNode = shared;
+		nodePool = other.nodePool;
+		// set res and where the image sits on the grid
 		res = other.res;
-		// deep copy of root contents
-		root = copy(other.root);
+		imgWidth = other.imgWidth;
+		imgHeight = other.imgHeight;
+		xOffset = other.xOffset;
+		yOffset = other.yOffset;
+		rotation = other.rotation;
+		flipped = other.flipped;
+		curve = atomic_load(&other.curve);
 	}
 	return *this;
 }
 
 /**
- * Private helper function for operator= and copy constructor
- * @param subRoot The current node in the recursion
+ * Private helper function for operator= and copy constructor. Nothing is
+ * copied: the whole tree is shared, and cloned piecewise on write.
+ * @param subRoot The root of the tree to copy
+ * @return subRoot, now shared with one more owner
  */
-Quadtree::QuadtreeNode* Quadtree::copy(const QuadtreeNode* subRoot) {
-	if (subRoot == NULL)
-		return NULL;
-
-	// copy node and it's quad children
-	QuadtreeNode* newQuad = new QuadtreeNode(subRoot->element);
-	newQuad->nwChild = copy(subRoot->nwChild);
-	newQuad->neChild = copy(subRoot->neChild);
-	newQuad->swChild = copy(subRoot->swChild);
-	newQuad->seChild = copy(subRoot->seChild);
+Quadtree::QuadtreeNode* Quadtree::copy(QuadtreeNode* subRoot) {
+	if (subRoot != NULL && subRoot != &padding)
+		subRoot->refs++;
+	return subRoot;
+}
 
-	return newQuad;
+/**
+ * Private helper function that makes subRoot safe to change. A shared
+ * node is replaced by a clone that shares the original's children, and
+ * this tree's reference to the original is dropped.
+ * @param subRoot The node about to be changed
+ */
+void Quadtree::unshare(QuadtreeNode* & subRoot) {
+	if (subRoot->refs.load() == 1)
+		return;
+	QuadtreeNode* original = subRoot;
+	subRoot = nodePool->create(*original);
+	clear(original);
 }
 
 // buildTree (public interface)
@@ -165,10 +864,7 @@ Quadtree::QuadtreeNode* Quadtree::copy(const QuadtreeNode* subRoot) {
 //        source
 void Quadtree::buildTree(PNG const& source, int setresolution)
 {
-	// delete contents of current Quadtree object
-	clear(root);
-	res = setresolution;
-	build(source, root, res, 0, 0);
+	buildTree(source, setresolution, setresolution, 1);
 }
 
 // getPixel (public interface)
@@ -180,9 +876,16 @@ void Quadtree::buildTree(PNG const& source, int setresolution)
 RGBAPixel Quadtree::getPixel(int x, int y) const
 {
 	// if x,y out of bounds or empty Quadtree
-	if (x < 0 || y < 0 || x > res || y > res || root == NULL || res == 0)
+	if (x < 0 || y < 0 || x >= width() || y >= height() || rootNode == NULL)
 		return RGBAPixel();
-	return retrieve(root, res, x, y);
+
+	// find the grid cell in the oriented image, then where it is stored
+	int left, top;
+	imageOrigin(left, top);
+	x += left;
+	y += top;
+	unorient(res, x, y);
+	return retrieve(rootNode, res, x, y);
 }
 
 /**
@@ -196,9 +899,9 @@ RGBAPixel Quadtree::getPixel(int x, int y) const
  */
 RGBAPixel Quadtree::retrieve(QuadtreeNode* subRoot, int res, int x, int y) const {
 	// base case, condition: leaf node is non-existent
-	// since all internal nodes have non-null children, checking one will suffice
-	// thus check one child for simplification
-	if (subRoot->nwChild == NULL)
+	// the quadrant holding an image pixel always exists, so only the
+	// leaf test needs to look at every child
+	if (subRoot->isLeaf())
 		return subRoot->element;
 	// general case, check bounds to determine which quadrant
 	else {
@@ -222,64 +925,648 @@ RGBAPixel Quadtree::retrieve(QuadtreeNode* subRoot, int res, int x, int y) const
 }
 
 
+/**
+ * Spreads the bits of value out to the even bits of the result.
+ */
+static uint64_t spreadBits(uint32_t value)
+{
+	uint64_t bits = value;
+	bits = (bits | bits << 16) & 0x0000FFFF0000FFFFull;
+	bits = (bits | bits << 8) & 0x00FF00FF00FF00FFull;
+	bits = (bits | bits << 4) & 0x0F0F0F0F0F0F0F0Full;
+	bits = (bits | bits << 2) & 0x3333333333333333ull;
+	bits = (bits | bits << 1) & 0x5555555555555555ull;
+	return bits;
+}
+
+/**
+ * Interleaves the bits of x (even bits) and y (odd bits), so that the two
+ * bits at each level of the grid name the quadrant (nw, ne, sw, se) a
+ * point falls in at that level.
+ */
+static uint64_t mortonCode(uint32_t x, uint32_t y)
+{
+	return spreadBits(x) | spreadBits(y) << 1;
+}
+
+// getRegion (public interface)
+//   - parameters: int x, int y - upper-left pixel of the rectangle
+//                 int width, int height - size of the rectangle
+//   - return value: a PNG holding the pixels of the rectangle
+//   - walks only the part of the tree overlapping the rectangle, filling
+//        each leaf's share of it in one go
+PNG Quadtree::getRegion(int x, int y, int width, int height) const
+{
+	if (width <= 0 || height <= 0)
+		return PNG();
+	// pixels outside the image keep the default colour
+	PNG ret((size_t) width, (size_t) height);
+	int left = max(x, 0), top = max(y, 0);
+	int right = min(x + width, this->width()), bottom = min(y + height, this->height());
+	if (rootNode == NULL || left >= right || top >= bottom)
+		return ret;
+
+	// as in decompressToFile: clip in the stored layout, orient each block
+	int ox, oy;
+	imageOrigin(ox, oy);
+	left += ox;
+	top += oy;
+	right += ox;
+	bottom += oy;
+	orientRect(res, left, top, right, bottom, true);
+	int cornerX = ox + x, cornerY = oy + y;
+	visitBlocks(rootNode, res, 0, 0, left, top, right, bottom,
+		[&ret, cornerX, cornerY, this](int left, int top, int right, int bottom, RGBAPixel const& color) {
+			orientRect(res, left, top, right, bottom, false);
+			for (int j = top; j < bottom; j++) {
+				RGBAPixel* row = ret.row(j - cornerY) + (left - cornerX);
+				fill(row, row + (right - left), color);
+			}
+		});
+	return ret;
+}
+
+// getPixels (public interface)
+//   - parameters: vector<pair<int, int>> const & points - coordinates of
+//                    the pixels to be retrieved
+//   - return value: the pixels at those coordinates, in the same order
+//   - sorts the points along the tree's z-order so that nearby points
+//        share their descent from the root
+vector<RGBAPixel> Quadtree::getPixels(vector<pair<int, int> > const& points) const
+{
+	vector<RGBAPixel> pixels(points.size());
+	if (rootNode == NULL)
+		return pixels;
+
+	// points outside the image keep the default colour; the rest are
+	// keyed by where they are stored
+	int left, top;
+	imageOrigin(left, top);
+	int width = this->width(), height = this->height();
+	vector<pair<uint64_t, size_t> > order;
+	order.reserve(points.size());
+	for (size_t i = 0; i < points.size(); i++) {
+		int x = points[i].first, y = points[i].second;
+		if (x < 0 || y < 0 || x >= width || y >= height)
+			continue;
+		x += left;
+		y += top;
+		unorient(res, x, y);
+		order.push_back(make_pair(mortonCode((uint32_t) x, (uint32_t) y), i));
+	}
+	sort(order.begin(), order.end());
+	retrieveBatch(rootNode, res, order.data(), order.data() + order.size(), pixels);
+	return pixels;
+}
+
+/**
+ * Private helper function for getPixels: looks up a batch of points
+ * inside subRoot's block, given sorted by their Morton codes relative
+ * to the whole grid, sharing one descent between them.
+ * @param subRoot The current node in the recursion
+ * @param res The resolution of the current image in the recursion
+ * @param first The first point of the batch
+ * @param last One past the last point of the batch
+ * @param pixels Where each point's pixel goes, by its index
+ */
+void Quadtree::retrieveBatch(QuadtreeNode const* subRoot, int res,
+                             pair<uint64_t, size_t> const* first,
+                             pair<uint64_t, size_t> const* last,
+                             vector<RGBAPixel>& pixels) const {
+	if (first == last)
+		return;
+	// a leaf answers every point in its block
+	if (subRoot->isLeaf()) {
+		for (; first != last; ++first)
+			pixels[first->second] = subRoot->element;
+		return;
+	}
+
+	// sorted codes group the points by quadrant, nw, ne, sw then se; the
+	// two code bits for this level tell which one a point is in. As in
+	// retrieve, the quadrant holding an image pixel always exists.
+	int half = res / 2;
+	int shift = 0;
+	while ((1 << shift) < half)
+		shift++;
+	shift *= 2;
+	QuadtreeNode const* children[4] = {subRoot->nwChild, subRoot->neChild,
+		subRoot->swChild, subRoot->seChild};
+	for (uint64_t quadrant = 0; quadrant < 4; quadrant++) {
+		pair<uint64_t, size_t> const* end = partition_point(first, last,
+			[shift, quadrant](pair<uint64_t, size_t> const& point) {
+				return ((point.first >> shift) & 3) <= quadrant;
+			});
+		retrieveBatch(children[quadrant], half, first, end, pixels);
+		first = end;
+	}
+}
+
+
 // decompress (public interface)
 //   - parameters: none
 //   - return value: a PNG object representing this quadtree's underlying
 //        bitmap
 //   - constructs and returns this quadtree's underlying bitmap
 PNG Quadtree::decompress() const
+{
+	return decompress(1);
+}
+
+// decompress (public interface)
+//   - parameters: int numThreads - number of threads to decompress with
+//   - return value: a PNG object representing this quadtree's underlying
+//        bitmap, the same as decompress()
+//   - paints disjoint tiles of the image on a thread pool
+PNG Quadtree::decompress(int numThreads) const
 {
 	PNG ret;
 	// if Quadtree is empty
-	if (root == NULL)
+	if (rootNode == NULL)
 		return ret;
-	// restore PNG with appropriate pixels
+	// restore PNG with appropriate pixels, one block per leaf
 	else {
-		ret = PNG((size_t) res, (size_t) res);
-		for (int i = 0; i < res; i++) {
-			for (int j = 0; j < res; j++) {
-				*ret(i, j) = getPixel(i, j);
-			}
+		ret = PNG((size_t) width(), (size_t) height());
+		// blocks come out in the stored layout and are oriented one by one;
+		// blocks never overlap, so threads can fill them side by side
+		int ox, oy;
+		imageOrigin(ox, oy);
+		BlockVisitor paint =
+			[&ret, ox, oy, this](int left, int top, int right, int bottom, RGBAPixel const& color) {
+				orientRect(res, left, top, right, bottom, false);
+				for (int j = top; j < bottom; j++) {
+					RGBAPixel* row = ret.row(j - oy) + (left - ox);
+					fill(row, row + (right - left), color);
+				}
+			};
+		if (numThreads <= 1 || res <= parallelCutoff) {
+			visitBlocks(rootNode, res, 0, 0, xOffset, yOffset, xOffset + imgWidth,
+				yOffset + imgHeight, paint);
+			return ret;
 		}
+
+		// enough tiles that a thread finishing early can steal another
+		int depth = 0;
+		while ((1 << (2 * depth)) < 4 * numThreads)
+			depth++;
+		ThreadPool pool(numThreads);
+		TaskGroup tiles;
+		parallelDecompress(pool, tiles, rootNode, res, 0, 0, depth, paint);
+		pool.join(tiles);
 	}
 	return ret;
 }
 
-// clockwiseRotate (public interface)
-//   - parameters: none
-//   - transforms this quadtree into a quadtree representing the same
-//        bitmap, rotated 90 degrees clockwise
-void Quadtree::clockwiseRotate()
+// decompressToFile (public interface)
+//   - parameters: string const & fileName - file to write to
+//                 int bandRows - rows of the image produced at a time
+//   - return value: whether the file was written
+//   - writes this quadtree's underlying bitmap to disk one band of rows at
+//        a time, so only a single band is ever in memory
+bool Quadtree::decompressToFile(string const& fileName, int bandRows) const
 {
-	if (root != NULL)
-		rotate(root);
-}
-
-/**
- * Private helper function to rotate the Quadtree by 90 degrees clockwise.
- * @param subRoot The current root in the recursion
- */
-void Quadtree::rotate(QuadtreeNode* & subRoot) {
-	if (subRoot->nwChild == NULL)
-		return;
-	else {
-		// store nwChild in a tmp node
-		QuadtreeNode* tmp = subRoot->nwChild;
+	// same output as decompress() for an empty tree
+	if (rootNode == NULL) {
+		PNG empty;
+		return empty.writeToFile(fileName);
+	}
 
-		// rotation. draw it out to see...
-		subRoot->nwChild = subRoot->swChild;
-		subRoot->swChild = subRoot->seChild;
-		subRoot->seChild = subRoot->neChild;
-		subRoot->neChild = tmp;
+	PNGWriter writer;
+	int width = this->width(), height = this->height();
+	if (!writer.open(fileName, (size_t) width, (size_t) height))
+		return false;
 
-		rotate(subRoot->nwChild);
-		rotate(subRoot->neChild);
-		rotate(subRoot->swChild);
-		rotate(subRoot->seChild);
+	// bands are painted in oriented grid coordinates, shifted to the
+	// image's corner; each band is found in the stored layout by mapping
+	// it back, and its blocks are mapped forward again
+	int ox, oy;
+	imageOrigin(ox, oy);
+	bandRows = max(1, min(bandRows, height));
+	vector<RGBAPixel> band((size_t) width * bandRows);
+	for (int first = 0; first < height; first += bandRows) {
+		int last = min(first + bandRows, height);
+		int clipLeft = ox, clipTop = oy + first, clipRight = ox + width, clipBottom = oy + last;
+		orientRect(res, clipLeft, clipTop, clipRight, clipBottom, true);
+		visitBlocks(rootNode, res, 0, 0, clipLeft, clipTop, clipRight, clipBottom,
+			[&band, first, ox, oy, width, this](int left, int top, int right, int bottom, RGBAPixel const& color) {
+				orientRect(res, left, top, right, bottom, false);
+				for (int j = top; j < bottom; j++) {
+					vector<RGBAPixel>::iterator row = band.begin() + (size_t) (j - oy - first) * width;
+					fill(row + (left - ox), row + (right - ox), color);
+				}
+			});
+		if (!writer.writeRows(band.data(), last - first))
+			return false;
 	}
+	return writer.close();
 }
 
-// prune (public interface)
+// writeToFile (public interface)
+//   - parameters: string const & fileName - file to write to
+//   - return value: whether the file was written
+//   - saves the tree's shape and leaf colours, see quadtreefile.h
+bool Quadtree::writeToFile(string const& fileName) const
+{
+	// the file holds the image as oriented, as if materialized
+	int left, top;
+	imageOrigin(left, top);
+	QuadtreeWriter out(res, width(), height(), left, top);
+	if (rootNode != NULL)
+		save(rootNode, out);
+	return out.writeToFile(fileName);
+}
+
+// encodeProgressive (public interface)
+//   - return value: the tree, breadth first, as a progressive stream
+vector<uint8_t> Quadtree::encodeProgressive() const
+{
+	// like the file, the stream holds the image as oriented
+	int left, top;
+	imageOrigin(left, top);
+	ProgressiveWriter out(rootNode == NULL ? 0 : res, width(), height(), left, top);
+	vector<QuadtreeNode const*> level, next;
+	if (rootNode != NULL)
+		level.push_back(rootNode);
+	while (!level.empty()) {
+		next.clear();
+		for (size_t i = 0; i < level.size(); i++) {
+			QuadtreeNode const* node = level[i];
+			out.addNode(node->isLeaf(), node->element);
+			if (node->isLeaf())
+				continue;
+			QuadtreeNode const* children[4] = {node->nwChild, node->neChild,
+				node->swChild, node->seChild};
+			for (int q = 0; q < 4; q++)
+				if (children[storedQuadrant(q)] != &padding)
+					next.push_back(children[storedQuadrant(q)]);
+		}
+		out.endLevel();
+		level.swap(next);
+	}
+	return out.bytes();
+}
+
+/**
+ * Private helper function for writeToFile that appends the subtree at
+ * subRoot to out in preorder.
+ * @param subRoot The current node in the recursion
+ * @param out The file being assembled
+ */
+void Quadtree::save(QuadtreeNode const* subRoot, QuadtreeWriter& out) const {
+	// padding quadrants follow from the geometry in the header
+	if (subRoot == &padding)
+		return;
+	if (subRoot->isLeaf()) {
+		out.addLeaf(subRoot->element);
+		return;
+	}
+	// children in the order of the oriented image's quadrants
+	QuadtreeNode const* children[4] = {subRoot->nwChild, subRoot->neChild,
+		subRoot->swChild, subRoot->seChild};
+	out.addInternal();
+	for (int q = 0; q < 4; q++)
+		save(children[storedQuadrant(q)], out);
+}
+
+// readFromFile (public interface)
+//   - parameters: string const & fileName - file to read
+//   - return value: whether the file was read
+//   - replaces this tree with the one saved in fileName
+bool Quadtree::readFromFile(string const& fileName)
+{
+	release();
+	ownPool();
+	curve.reset();
+	res = imgWidth = imgHeight = xOffset = yOffset = rotation = 0;
+	flipped = false;
+
+	QuadtreeReader in;
+	if (!in.open(fileName))
+		return false;
+	if (in.resolution() == 0)
+		return true;
+
+	// the geometry says which border quadrants exist
+	res = in.resolution();
+	imgWidth = in.width();
+	imgHeight = in.height();
+	xOffset = in.xOffset();
+	yOffset = in.yOffset();
+	if (!load(in, rootNode, res, 0, 0) || !in.finished()) {
+		cerr << "[Quadtree]: " << fileName << " does not hold a valid tree" << endl;
+		clear(rootNode);
+		res = imgWidth = imgHeight = xOffset = yOffset = 0;
+		return false;
+	}
+	return true;
+}
+
+/**
+ * Private helper function for readFromFile that rebuilds the next subtree
+ * in preorder, computing internal colours and statistics as build does.
+ * @param in The mapped file
+ * @param subRoot The current node in the recursion
+ * @param res The resolution of the current image in the recursion
+ * @param x The x coordinate of subRoot's upper-left grid cell
+ * @param y The y coordinate of subRoot's upper-left grid cell
+ * @return False if the file does not describe a valid subtree
+ */
+bool Quadtree::load(QuadtreeReader& in, QuadtreeNode* & subRoot, int res, int x, int y) {
+	// quadrants made only of padding were not saved
+	if (!inImage(res, x, y)) {
+		subRoot = &padding;
+		return true;
+	}
+
+	bool isLeaf;
+	RGBAPixel color;
+	if (!in.readNode(isLeaf, color))
+		return false;
+	if (isLeaf) {
+		subRoot = nodePool->create(color);
+		return true;
+	}
+	// a single pixel cannot be split any further
+	if (res == 1)
+		return false;
+
+	subRoot = nodePool->create();
+	int half = res / 2;
+	if (!load(in, subRoot->nwChild, half, x, y) || !load(in, subRoot->neChild, half, x + half, y)
+		|| !load(in, subRoot->swChild, half, x, y + half)
+		|| !load(in, subRoot->seChild, half, x + half, y + half))
+		return false;
+	average(subRoot);
+	summarize(subRoot);
+	return true;
+}
+
+/**
+ * Private helper function that reports every leaf block below subRoot that
+ * overlaps the clip rectangle, clipped to it.
+ * @param subRoot The current node in the recursion
+ * @param res The resolution of the current image in the recursion
+ * @param x The x coordinate of subRoot's upper-left pixel
+ * @param y The y coordinate of subRoot's upper-left pixel
+ * @param left The first column of the clip rectangle
+ * @param top The first row of the clip rectangle
+ * @param right One past the last column of the clip rectangle
+ * @param bottom One past the last row of the clip rectangle
+ * @param visit Called once per overlapping leaf
+ */
+void Quadtree::visitBlocks(QuadtreeNode const* subRoot, int res, int x, int y,
+                           int left, int top, int right, int bottom,
+                           BlockVisitor const& visit) const {
+	// padding quadrant, or block entirely outside the clip rectangle
+	if (subRoot == &padding || x >= right || y >= bottom || x + res <= left || y + res <= top)
+		return;
+
+	// a leaf covers its whole block with one colour
+	if (subRoot->isLeaf()) {
+		visit(max(x, left), max(y, top), min(x + res, right), min(y + res, bottom),
+			subRoot->element);
+		return;
+	}
+
+	int half = res / 2;
+	visitBlocks(subRoot->nwChild, half, x, y, left, top, right, bottom, visit);
+	visitBlocks(subRoot->neChild, half, x + half, y, left, top, right, bottom, visit);
+	visitBlocks(subRoot->swChild, half, x, y + half, left, top, right, bottom, visit);
+	visitBlocks(subRoot->seChild, half, x + half, y + half, left, top, right, bottom, visit);
+}
+
+/**
+ * Private helper function for the multi-threaded decompress. Forks one
+ * task per subtree at the given depth (or per leaf or smallest subtree
+ * above it) that passes the subtree's blocks to visit.
+ * @param pool The pool to fork tile tasks onto
+ * @param tiles The group the tasks are accounted against
+ * @param subRoot The current node in the recursion
+ * @param res The resolution of the current image in the recursion
+ * @param x The x coordinate of subRoot's upper-left grid cell
+ * @param y The y coordinate of subRoot's upper-left grid cell
+ * @param depth The levels left to descend before forking
+ * @param visit Called once per leaf block inside the image
+ */
+void Quadtree::parallelDecompress(ThreadPool& pool, TaskGroup& tiles,
+                                  QuadtreeNode const* subRoot, int res, int x, int y,
+                                  int depth, BlockVisitor const& visit) const {
+	if (subRoot == &padding)
+		return;
+	if (depth == 0 || res <= parallelCutoff || subRoot->isLeaf()) {
+		pool.fork(tiles, [=, &visit] {
+			visitBlocks(subRoot, res, x, y, xOffset, yOffset, xOffset + imgWidth,
+				yOffset + imgHeight, visit);
+		});
+		return;
+	}
+
+	int half = res / 2;
+	parallelDecompress(pool, tiles, subRoot->nwChild, half, x, y, depth - 1, visit);
+	parallelDecompress(pool, tiles, subRoot->neChild, half, x + half, y, depth - 1, visit);
+	parallelDecompress(pool, tiles, subRoot->swChild, half, x, y + half, depth - 1, visit);
+	parallelDecompress(pool, tiles, subRoot->seChild, half, x + half, y + half, depth - 1,
+		visit);
+}
+
+// clockwiseRotate (public interface)
+//   - parameters: none
+//   - transforms this quadtree into a quadtree representing the same
+//        bitmap, rotated 90 degrees clockwise
+void Quadtree::clockwiseRotate()
+{
+	rotation = (rotation + 1) % 4;
+}
+
+// flipHorizontal (public interface)
+//   - parameters: none
+//   - mirrors this quadtree's underlying bitmap left to right
+void Quadtree::flipHorizontal()
+{
+	// mirroring after the turns is the same as mirroring before them and
+	// turning the other way
+	rotation = (4 - rotation) % 4;
+	flipped = !flipped;
+}
+
+// flipVertical (public interface)
+//   - parameters: none
+//   - mirrors this quadtree's underlying bitmap top to bottom
+void Quadtree::flipVertical()
+{
+	// a vertical flip is a horizontal one followed by a half turn
+	flipHorizontal();
+	rotation = (rotation + 2) % 4;
+}
+
+// materialize (public interface)
+//   - parameters: none
+//   - rearranges the nodes into the current orientation, which becomes
+//        the identity
+void Quadtree::materialize()
+{
+	if (rotation == 0 && !flipped)
+		return;
+
+	int left, top;
+	imageOrigin(left, top);
+	if (rotation % 2 == 1)
+		swap(imgWidth, imgHeight);
+	xOffset = left;
+	yOffset = top;
+	if (rootNode != NULL)
+		reorient(rootNode);
+	rotation = 0;
+	flipped = false;
+}
+
+// GivenRoot
+//   - parameters: Quadtree const * tree - the tree whose root this is
+Quadtree::GivenRoot::GivenRoot(Quadtree const* tree)
+	: tree(tree)
+{
+}
+
+// ~GivenRoot
+//   - lets go of the upright copy, if there is one
+Quadtree::GivenRoot::~GivenRoot()
+{
+}
+
+// operator QuadtreeNode const *
+//   - return value: the tree's root if it is upright, or else the root
+//     of an upright copy of it, which lasts until the tree's root or
+//     orientation changes
+Quadtree::GivenRoot::operator QuadtreeNode const*() const
+{
+	lock_guard<mutex> guard(lock);
+	if (tree->rotation == 0 && !tree->flipped) {
+		source.reset();
+		upright.reset();
+		return tree->rootNode;
+	}
+	if (source == NULL || source->rootNode != tree->rootNode
+		|| source->rotation != tree->rotation || source->flipped != tree->flipped) {
+		source.reset(new Quadtree(*tree));
+		upright.reset(new Quadtree(*tree));
+		upright->materialize();
+	}
+	return upright->rootNode;
+}
+
+/**
+ * Private helper function for materialize that moves every node's
+ * children to the slots the orientation maps them to.
+ * @param subRoot The current root in the recursion
+ */
+void Quadtree::reorient(QuadtreeNode* & subRoot) {
+	if (subRoot == NULL || subRoot->isLeaf())
+		return;
+	unshare(subRoot);
+
+	QuadtreeNode* stored[4] = {subRoot->nwChild, subRoot->neChild,
+		subRoot->swChild, subRoot->seChild};
+	QuadtreeNode** slots[4] = {&subRoot->nwChild, &subRoot->neChild,
+		&subRoot->swChild, &subRoot->seChild};
+	for (int q = 0; q < 4; q++) {
+		*slots[q] = stored[storedQuadrant(q)];
+		reorient(*slots[q]);
+	}
+	// the hash follows the stored order of the children
+	subRoot->hash = contentHash(subRoot);
+}
+
+/**
+ * Private helper function that maps a cell of a side by side grid from
+ * the stored layout to where the orientation puts it: mirror first, then
+ * turn clockwise, (x, y) -> (side - 1 - y, x) per quarter turn.
+ * @param side The side of the grid
+ * @param x The column, updated in place
+ * @param y The row, updated in place
+ */
+void Quadtree::orient(int side, int& x, int& y) const {
+	if (flipped)
+		x = side - 1 - x;
+	int oldX = x;
+	switch (rotation) {
+		case 1: x = side - 1 - y; y = oldX; break;
+		case 2: x = side - 1 - x; y = side - 1 - y; break;
+		case 3: x = y; y = side - 1 - oldX; break;
+	}
+}
+
+/**
+ * Private helper function that undoes orient: turns back, then mirrors.
+ * @param side The side of the grid
+ * @param x The column, updated in place
+ * @param y The row, updated in place
+ */
+void Quadtree::unorient(int side, int& x, int& y) const {
+	int oldX = x;
+	switch (rotation) {
+		case 1: x = y; y = side - 1 - oldX; break;
+		case 2: x = side - 1 - x; y = side - 1 - y; break;
+		case 3: x = side - 1 - y; y = oldX; break;
+	}
+	if (flipped)
+		x = side - 1 - x;
+}
+
+/**
+ * Private helper function that maps a half-open rectangle of a side by
+ * side grid through orient (or unorient). The map sends rectangles to
+ * rectangles, so mapping two opposite corner cells is enough.
+ * @param side The side of the grid
+ * @param left The first column, updated in place
+ * @param top The first row, updated in place
+ * @param right One past the last column, updated in place
+ * @param bottom One past the last row, updated in place
+ * @param inverse Whether to map back to the stored layout
+ */
+void Quadtree::orientRect(int side, int& left, int& top, int& right, int& bottom,
+                          bool inverse) const {
+	int x1 = left, y1 = top, x2 = right - 1, y2 = bottom - 1;
+	if (inverse) {
+		unorient(side, x1, y1);
+		unorient(side, x2, y2);
+	}
+	else {
+		orient(side, x1, y1);
+		orient(side, x2, y2);
+	}
+	left = min(x1, x2);
+	top = min(y1, y2);
+	right = max(x1, x2) + 1;
+	bottom = max(y1, y2) + 1;
+}
+
+/**
+ * Private helper function that finds where the oriented image sits on the
+ * grid.
+ * @param left Set to the first column of the image
+ * @param top Set to the first row of the image
+ */
+void Quadtree::imageOrigin(int& left, int& top) const {
+	left = xOffset;
+	top = yOffset;
+	int right = xOffset + imgWidth, bottom = yOffset + imgHeight;
+	orientRect(res, left, top, right, bottom, false);
+}
+
+/**
+ * Private helper function that finds which stored child holds a quadrant
+ * of the oriented image. The orientation acts on the four quadrants the
+ * same way it acts on the whole grid.
+ * @param quadrant 0 to 3 for nw, ne, sw, se of the oriented image
+ * @return 0 to 3 for the stored nwChild, neChild, swChild, seChild
+ */
+int Quadtree::storedQuadrant(int quadrant) const {
+	int x = quadrant % 2, y = quadrant / 2;
+	unorient(2, x, y);
+	return x + 2 * y;
+}
+
+// prune (public interface)
 //   - parameters: int tolerance - an integer representing the maximum
 //                    "distance" which we will permit between a node's color
 //                    (i.e. the average of its descendant leaves' colors)
@@ -291,90 +1578,60 @@ void Quadtree::rotate(QuadtreeNode* & subRoot) {
 //        color "stand in for" the colors of all (deleted) leaves beneath it
 void Quadtree::prune(int tolerance)
 {
-	if (root != NULL)
-		pruneTree(root, tolerance);
-}
-
-/**
- * Private helper function to prune the given tree.
- * @param subRoot The current node in the recursion
- * @param tolerance The tolerance range to determine if prune
- */
-void Quadtree::pruneTree(QuadtreeNode* & subRoot, int tolerance) {
-	if (subRoot == NULL)
-		return;
-	else {
-		// general case: non-leaf node
-		// if differences are within tolerance, prune the node
-		if (shouldPrune(subRoot->nwChild, subRoot, tolerance) &&
-			shouldPrune(subRoot->neChild, subRoot, tolerance) &&
-			shouldPrune(subRoot->swChild, subRoot, tolerance) &&
-			shouldPrune(subRoot->seChild, subRoot, tolerance)) {
-
-			clear(subRoot->nwChild);
-			clear(subRoot->neChild);
-			clear(subRoot->swChild);
-			clear(subRoot->seChild);
-		}
-		else {
-			// recurse down one level and determine if node
-			// should be pruned
-			pruneTree(subRoot->nwChild, tolerance);
-			pruneTree(subRoot->neChild, tolerance);
-			pruneTree(subRoot->swChild, tolerance);
-			pruneTree(subRoot->seChild, tolerance);
-		}
+	if (rootNode != NULL && pruneTree(rootNode, tolerance)) {
+		curve.reset();
+		compact();
 	}
-	
 }
 
 /**
- * Private helper function to determine whether or not a node
- * should be pruned.
- * @param child The leaf node to be considered
- * @param parent The parent node (current node) in the recursion
+ * Private helper function to prune the given tree. Whether a node is
+ * prunable is read from its cached maxDiff; nodes whose subtree changed
+ * have their statistics refreshed on the way back up.
+ * @param subRoot The current node in the recursion
  * @param tolerance The tolerance range to determine if prune
- * @return true if the node should be pruned, false otherwise
+ * @return true if anything below subRoot was pruned
  */
-bool Quadtree::shouldPrune(QuadtreeNode* child, QuadtreeNode* parent, int tolerance) const {
-	// case if leaf node passed in
-	if (child == NULL)
+bool Quadtree::pruneTree(QuadtreeNode* & subRoot, int tolerance) {
+	// leaves have nothing to prune, and neither has a subtree in which
+	// no node is within tolerance; those stay shared
+	if (subRoot == NULL || subRoot->isLeaf() || subRoot->pruneFloor > tolerance)
 		return false;
-	// base case: the child is a leaf node
-	else if (child->nwChild == NULL) {
-		int bound = diff(child, parent);
-		return bound <= tolerance;
-	}
-	// general case
-	// recurse until a leaf node is reached
-	else {
-		return shouldPrune(child->nwChild, parent, tolerance) &&
-			shouldPrune(child->neChild, parent, tolerance) &&
-			shouldPrune(child->swChild, parent, tolerance) &&
-			shouldPrune(child->seChild, parent, tolerance);
+
+	// something below changes, so this node will be written to
+	unshare(subRoot);
+
+	// general case: non-leaf node
+	// if every leaf below is within tolerance, prune the node
+	if (subRoot->maxDiff <= tolerance) {
+		clear(subRoot->nwChild);
+		clear(subRoot->neChild);
+		clear(subRoot->swChild);
+		clear(subRoot->seChild);
+		summarize(subRoot);
+		return true;
 	}
+
+	// recurse down one level and determine if nodes should be pruned.
+	// this node's own decision was made above, before its leaves changed
+	bool changed = pruneTree(subRoot->nwChild, tolerance);
+	changed = pruneTree(subRoot->neChild, tolerance) || changed;
+	changed = pruneTree(subRoot->swChild, tolerance) || changed;
+	changed = pruneTree(subRoot->seChild, tolerance) || changed;
+	if (changed)
+		summarize(subRoot);
+	return changed;
 }
 
 /**
- * Private helper function to calculate the difference between two colors
- * between two nodes.
- * @param node1 The first node of comparison
- * @param node2 The second node of comparison
- * @return the difference between two colors between two nodes
+ * Private helper function to calculate the difference between two colors.
+ * @param first The first color of comparison
+ * @param second The second color of comparison
+ * @return the difference between the two colors
  */
-int Quadtree::diff(QuadtreeNode* node1, QuadtreeNode* node2) const {
-	// (n2 - n1)
-	int red = (node2->element.red - node1->element.red);
-	int green = (node2->element.green - node1->element.green);
-	int blue = (node2->element.blue - node1->element.blue);
-
-	// (n2 - n1) ^ 2
-	red = pow(red, 2);
-	green = pow(green, 2);
-	blue = pow(blue, 2);
-
-	// return sum
-	return red + green + blue;
+int Quadtree::diff(RGBAPixel const& first, RGBAPixel const& second) const {
+	// sum of (n2 - n1) ^ 2, in integers rather than through pow
+	return PixelKernels::distance(first, second);
 }
 
 // pruneSize (public interface)
@@ -387,37 +1644,15 @@ int Quadtree::diff(QuadtreeNode* node1, QuadtreeNode* node2) const {
 //        tree
 int Quadtree::pruneSize(int tolerance) const
 {
-	if (root == NULL)
+	if (rootNode == NULL)
 		return 0;
-	return numPrunes(root, tolerance);
-}
 
-/**
- * Private helper function that returns a 
- * count of the total number of leaves the Quadtree would 
- * have if it were pruned as in the prune function.
- * @param subRoot The current node in the recursion
- * @param tolerance The given tolerance range
- * @return a count of the total number of leaves the Quadtree 
- *         after hypothetical pruning
- */
-int Quadtree::numPrunes(QuadtreeNode* subRoot, int tolerance) const {
-	// leaf node is a single node
-	if (subRoot->nwChild == NULL)
-		return 1;
-	// if the node should be pruned then this node should "become" a leaf node
-	else if (shouldPrune(subRoot->nwChild, subRoot, tolerance) &&
-				shouldPrune(subRoot->neChild, subRoot, tolerance) &&
-				shouldPrune(subRoot->swChild, subRoot, tolerance) &&
-				shouldPrune(subRoot->seChild, subRoot, tolerance)) {
-		return 1;
-	}
-	else {
-		return  numPrunes(subRoot->nwChild, tolerance) +
-				numPrunes(subRoot->neChild, tolerance) + 
-				numPrunes(subRoot->swChild, tolerance) + 
-				numPrunes(subRoot->seChild, tolerance);
-	}
+	// last step starting at or before tolerance; every tolerance below
+	// zero behaves like -1, where nothing collapses
+	vector<PruneStep> const& steps = pruneCurve();
+	vector<PruneStep>::const_iterator step = upper_bound(steps.begin(), steps.end(),
+		max(tolerance, -1), [](int t, PruneStep const& s) { return t < s.tolerance; });
+	return (step - 1)->leaves;
 }
 
 // idealPrune (public interface)
@@ -427,40 +1662,676 @@ int Quadtree::numPrunes(QuadtreeNode* subRoot, int tolerance) const {
 //        would yield a tree with at most numLeaves leaves
 int Quadtree::idealPrune(int numLeaves) const
 {
-	if (root == NULL)
+	if (rootNode == NULL)
 		return 0;
+
+	// first step with few enough leaves; leaf counts never increase
+	vector<PruneStep> const& steps = pruneCurve();
+	vector<PruneStep>::const_iterator step = partition_point(steps.begin(), steps.end(),
+		[numLeaves](PruneStep const& s) { return s.leaves > numLeaves; });
 	// distance between white and black = 3(255^2)
-	return minTolerance(numLeaves, 0, 255*255*3);
+	if (step == steps.end())
+		return 255*255*3;
+	return max(step->tolerance, 0);
 }
 
+// pruneCurve (public interface)
+//   - return value: the steps of the tolerance to leaf count function
+//   - builds the curve if the tree changed since it was last built
+vector<Quadtree::PruneStep> const& Quadtree::pruneCurve() const
+{
+	static vector<PruneStep> const none;
+	if (rootNode == NULL)
+		return none;
+	shared_ptr<vector<PruneStep> const> built = atomic_load(&curve);
+	if (built)
+		return *built;
+
+	// +1 where a node starts being a leaf, -1 where an ancestor takes over
+	int maxTolerance = 255*255*3;
+	vector<int> deltas(maxTolerance + 2, 0);
+	collapseIntervals(rootNode, INT_MAX, deltas);
+
+	shared_ptr<vector<PruneStep> > steps = make_shared<vector<PruneStep> >();
+	int leaves = 0;
+	for (int i = 0; i < (int) deltas.size(); i++) {
+		if (deltas[i] == 0)
+			continue;
+		leaves += deltas[i];
+		PruneStep step = {i - 1, leaves};
+		steps->push_back(step);
+	}
+	// several threads may build it at once; the first to finish publishes
+	// its curve, which is never replaced while the tree is unchanged, so
+	// the others return that one
+	shared_ptr<vector<PruneStep> const> published;
+	shared_ptr<vector<PruneStep> const> mine = steps;
+	if (!atomic_compare_exchange_strong(&curve, &published, mine))
+		return *published;
+	return *mine;
+}
+
+/**
+ * Private helper function for pruneCurve that records the interval of
+ * tolerances over which each node below subRoot is a leaf after pruning.
+ * @param subRoot The current node in the recursion
+ * @param ancestorMin The smallest maxDiff among subRoot's ancestors, or
+ *  INT_MAX for the root
+ * @param deltas Change in leaf count at each tolerance, offset by one
+ */
+void Quadtree::collapseIntervals(QuadtreeNode const* subRoot, int ancestorMin,
+                                 vector<int>& deltas) const {
+	// the padding is no leaf of the image
+	if (subRoot == &padding)
+		return;
+
+	// a leaf is already a leaf at any tolerance; an internal node becomes
+	// one once its farthest leaf is within tolerance
+	bool leaf = subRoot->isLeaf();
+	int from = leaf ? -1 : subRoot->maxDiff;
+	if (from < ancestorMin) {
+		deltas[from + 1]++;
+		// the root has no ancestor to take over from it
+		if (ancestorMin != INT_MAX)
+			deltas[ancestorMin + 1]--;
+	}
+	if (leaf)
+		return;
+
+	ancestorMin = min(ancestorMin, from);
+	collapseIntervals(subRoot->nwChild, ancestorMin, deltas);
+	collapseIntervals(subRoot->neChild, ancestorMin, deltas);
+	collapseIntervals(subRoot->swChild, ancestorMin, deltas);
+	collapseIntervals(subRoot->seChild, ancestorMin, deltas);
+}
+
+/**
+ * An internal node as seen by compress. Its sums are over the image
+ * pixels its block covers, taken before anything is collapsed; a node
+ * becomes a candidate once every child it has is a leaf.
+ */
+struct Quadtree::RateNode
+{
+	int parent; /**< index of the parent in the node list, or -1 */
+	size_t end; /**< one past the last internal node of its subtree */
+	int children; /**< children it has */
+	int internalChildren; /**< children that are not (yet) leaves */
+	int64_t sums[5]; /**< red, green and blue sums, sum of squares, pixels */
+	RGBAPixel color; /**< its colour, kept if it is collapsed */
+	int64_t childError; /**< squared error of its collapsed children */
+	bool collapsed; /**< whether compress collapsed it */
+	bool touched; /**< whether anything below it was collapsed */
+
+	/**
+	 * @return The squared error over the node's block if it were one
+	 *  leaf of its colour: the sum over its pixels p of |color - p|^2
+	 */
+	int64_t leafError() const
+	{
+		int64_t square = (int64_t) color.red * color.red + (int64_t) color.green * color.green
+			+ (int64_t) color.blue * color.blue;
+		int64_t cross = color.red * sums[0] + color.green * sums[1] + color.blue * sums[2];
+		return sums[3] - 2 * cross + sums[4] * square;
+	}
+};
 
 /**
- * Private helper function that does a binary search
- * over all possible tolerances to return a tolerance
- * that prunes the tree with at most numLeaves.
- * @param numLeaves The number of leaves you want to remain in the tree
- *  after prune is called.
- * @param min The minimum tolerance range
- * @param max The maximum tolerance range
- * @return The minimum tolerance needed to guarantee that there are no
- *  more than numLeaves remaining in the tree.
+ * PSNR of an image with the given total squared error.
+ * @param error Squared error summed over every channel of every pixel
+ * @param samples Number of channel values (three per pixel)
+ * @return The PSNR in dB, infinite for no error
  */
-int Quadtree::minTolerance(int numLeaves, int min, int max) const {
-	if (min < max) {
-		int mid = (min + max) / 2;
-		if (pruneSize(mid) == numLeaves) {
-			return mid;
+static double psnr(int64_t error, double samples)
+{
+	if (error <= 0)
+		return numeric_limits<double>::infinity();
+	return 10 * log10(255.0 * 255.0 * samples / (double) error);
+}
+
+// compressToSize (public interface)
+//   - parameters: size_t maxBytes - largest file size wanted
+//   - return value: the leaves, file size and PSNR reached
+//   - collapses nodes, least added error per removed leaf first, until
+//        the tree's file fits in maxBytes
+Quadtree::CompressionResult Quadtree::compressToSize(size_t maxBytes)
+{
+	return compress(maxBytes, -numeric_limits<double>::infinity());
+}
+
+// compressToQuality (public interface)
+//   - parameters: double minPsnr - lowest PSNR, in dB, to accept
+//   - return value: the leaves, file size and PSNR reached
+//   - collapses nodes, least added error per removed leaf first, for as
+//        long as the PSNR stays at or above minPsnr
+Quadtree::CompressionResult Quadtree::compressToQuality(double minPsnr)
+{
+	return compress(0, minPsnr);
+}
+
+/**
+ * Private helper function for compressToSize and compressToQuality:
+ * collapses nodes greedily by added error per removed leaf until the
+ * tree fits in maxBytes bytes, or the next collapse would take the
+ * PSNR below minPsnr.
+ * @param maxBytes The largest file size wanted
+ * @param minPsnr The lowest PSNR, in dB, to accept
+ * @return The leaf count, file size and PSNR reached
+ */
+Quadtree::CompressionResult Quadtree::compress(size_t maxBytes, double minPsnr) {
+	CompressionResult result = {0, QuadtreeWriter::fileSize(0, 0),
+		numeric_limits<double>::infinity()};
+	if (rootNode == NULL)
+		return result;
+
+	vector<RateNode> nodes;
+	int64_t sums[5];
+	gatherRates(rootNode, res, 0, 0, -1, nodes, sums);
+	size_t leaves = nodes.empty() ? 1 : 0;
+	for (size_t i = 0; i < nodes.size(); i++)
+		leaves += nodes[i].children - nodes[i].internalChildren;
+	size_t nodeCount = nodes.size() + leaves;
+	double samples = 3.0 * sums[4];
+	int64_t error = 0;
+
+	// cheapest added error per removed leaf first; ties go to the node
+	// that comes first in preorder
+	typedef pair<double, size_t> Candidate;
+	priority_queue<Candidate, vector<Candidate>, greater<Candidate> > candidates;
+	auto consider = [&nodes, &candidates](size_t i) {
+		RateNode const& node = nodes[i];
+		double added = (double) (node.leafError() - node.childError);
+		candidates.push(make_pair(added / max(node.children - 1, 1), i));
+	};
+	for (size_t i = 0; i < nodes.size(); i++)
+		if (nodes[i].internalChildren == 0)
+			consider(i);
+
+	while (!candidates.empty() && QuadtreeWriter::fileSize(nodeCount, leaves) > maxBytes) {
+		RateNode& node = nodes[candidates.top().second];
+		candidates.pop();
+		int64_t nodeError = node.leafError();
+		int64_t collapsedError = error + nodeError - node.childError;
+		if (psnr(collapsedError, samples) < minPsnr)
+			break;
+
+		error = collapsedError;
+		node.collapsed = true;
+		nodeCount -= node.children;
+		leaves -= node.children - 1;
+		if (node.parent >= 0) {
+			RateNode& parent = nodes[node.parent];
+			parent.childError += nodeError;
+			if (--parent.internalChildren == 0)
+				consider(node.parent);
 		}
-		else if (pruneSize(mid) > numLeaves) {
-			return minTolerance(numLeaves, mid + 1, max);
+	}
+
+	// children come after their parents in preorder
+	for (size_t i = nodes.size(); i-- > 1; )
+		if (nodes[i].collapsed || nodes[i].touched)
+			nodes[nodes[i].parent].touched = true;
+	if (!nodes.empty() && (nodes[0].collapsed || nodes[0].touched)) {
+		applyCollapses(rootNode, nodes, 0);
+		curve.reset();
+		compact();
+	}
+
+	result.leaves = (int) leaves;
+	result.bytes = QuadtreeWriter::fileSize(nodeCount, leaves);
+	result.psnr = psnr(error, samples);
+	return result;
+}
+
+/**
+ * Private helper function for compress: appends every internal node of
+ * the subtree to nodes in preorder, with its pixel sums.
+ * @param subRoot The current node in the recursion
+ * @param res The resolution of the current image in the recursion
+ * @param x The x coordinate of subRoot's upper-left grid cell
+ * @param y The y coordinate of subRoot's upper-left grid cell
+ * @param parent The index of subRoot's parent in nodes, or -1
+ * @param nodes The internal nodes gathered so far
+ * @param sums Set to the red, green and blue sums, the sum of squares
+ *  and the pixel count of the subtree
+ */
+void Quadtree::gatherRates(QuadtreeNode const* subRoot, int res, int x, int y, int parent,
+                           vector<RateNode>& nodes, int64_t sums[5]) const {
+	for (int i = 0; i < 5; i++)
+		sums[i] = 0;
+	if (subRoot == NULL)
+		return;
+
+	// a leaf's pixels inside the image all have its colour
+	if (subRoot->isLeaf()) {
+		RGBAPixel const& color = subRoot->element;
+		int64_t pixels = (int64_t) (min(x + res, xOffset + imgWidth) - max(x, xOffset))
+			* (min(y + res, yOffset + imgHeight) - max(y, yOffset));
+		sums[0] = pixels * color.red;
+		sums[1] = pixels * color.green;
+		sums[2] = pixels * color.blue;
+		sums[3] = pixels * PixelKernels::distance(RGBAPixel(0, 0, 0), color);
+		sums[4] = pixels;
+		return;
+	}
+
+	// nodes may grow below, so this node is only referred to by index
+	size_t index = nodes.size();
+	nodes.push_back(RateNode());
+	nodes[index].parent = parent;
+	nodes[index].children = nodes[index].internalChildren = 0;
+	nodes[index].color = subRoot->element;
+	nodes[index].childError = 0;
+	nodes[index].collapsed = nodes[index].touched = false;
+
+	QuadtreeNode const* children[4] = {subRoot->nwChild, subRoot->neChild,
+		subRoot->swChild, subRoot->seChild};
+	int half = res / 2;
+	for (int i = 0; i < 4; i++) {
+		if (children[i] == &padding)
+			continue;
+		nodes[index].children++;
+		if (!children[i]->isLeaf())
+			nodes[index].internalChildren++;
+		int64_t childSums[5];
+		gatherRates(children[i], half, x + (i % 2) * half, y + (i / 2) * half, (int) index,
+			nodes, childSums);
+		for (int k = 0; k < 5; k++)
+			sums[k] += childSums[k];
+	}
+	for (int k = 0; k < 5; k++)
+		nodes[index].sums[k] = sums[k];
+	nodes[index].end = nodes.size();
+}
+
+/**
+ * Private helper function for compress: turns the nodes marked as
+ * collapsed into leaves, unsharing what it changes and refreshing the
+ * statistics above them.
+ * @param subRoot The current node in the recursion, an internal node
+ * @param nodes The internal nodes, in the order gatherRates made them
+ * @param index The index of subRoot in nodes
+ */
+void Quadtree::applyCollapses(QuadtreeNode* & subRoot, vector<RateNode> const& nodes,
+                              size_t index) {
+	unshare(subRoot);
+	if (nodes[index].collapsed) {
+		clear(subRoot->nwChild);
+		clear(subRoot->neChild);
+		clear(subRoot->swChild);
+		clear(subRoot->seChild);
+		summarize(subRoot);
+		return;
+	}
+
+	// internal children follow in preorder, each after the previous
+	// one's subtree; untouched ones stay shared
+	QuadtreeNode** children[4] = {&subRoot->nwChild, &subRoot->neChild,
+		&subRoot->swChild, &subRoot->seChild};
+	size_t next = index + 1;
+	for (int i = 0; i < 4; i++) {
+		// the padding is a leaf too
+		if ((*children[i])->isLeaf())
+			continue;
+		size_t child = next;
+		next = nodes[child].end;
+		if (nodes[child].collapsed || nodes[child].touched)
+			applyCollapses(*children[i], nodes, child);
+	}
+	summarize(subRoot);
+}
+
+// diff (public interface)
+//   - parameters: Quadtree const & other - the tree to compare against
+//   - return value: the changed regions and the patch from this tree to
+//        other
+//   - skips every pair of subtrees whose content hashes match
+Quadtree::Delta Quadtree::diff(Quadtree const& other) const
+{
+	// hashes follow the stored layout, so the layouts must agree first
+	bool sameSize = width() == other.width() && height() == other.height();
+	if (sameSize && (rotation != other.rotation || flipped != other.flipped)) {
+		Quadtree before(*this), after(other);
+		before.materialize();
+		after.materialize();
+		Delta delta = before.diff(after);
+		delta.base = fingerprint();
+		return delta;
+	}
+
+	// the delta's nodes live in a pool of its own, so it neither allocates
+	// into other's pool nor keeps other's slabs alive
+	Delta delta;
+	Quadtree& tree = delta.tree;
+	tree.ownPool();
+	tree.res = other.res;
+	tree.imgWidth = other.imgWidth;
+	tree.imgHeight = other.imgHeight;
+	tree.xOffset = other.xOffset;
+	tree.yOffset = other.yOffset;
+	tree.rotation = other.rotation;
+	tree.flipped = other.flipped;
+	delta.base = fingerprint();
+
+	bool sameGrid = res == other.res && xOffset == other.xOffset
+		&& yOffset == other.yOffset && imgWidth == other.imgWidth
+		&& imgHeight == other.imgHeight && rotation == other.rotation
+		&& flipped == other.flipped;
+	if (sameGrid && rootNode != NULL)
+		tree.rootNode = compare(rootNode, other.rootNode, res, 0, 0, delta);
+	else if (rootNode != NULL || other.rootNode != NULL) {
+		// nothing lines up: the whole of other replaces the whole tree
+		delta.grafts.push_back(true);
+		unordered_map<QuadtreeNode const*, QuadtreeNode*> moved;
+		tree.rootNode = tree.relocate(other.rootNode, *tree.nodePool, moved);
+		if (other.rootNode != NULL)
+			other.addRegion(other.res, 0, 0, delta.changed);
+	}
+	return delta;
+}
+
+/**
+ * Private helper function for diff that compares two subtrees of the
+ * same block and adds what differs to the delta.
+ * @param subRoot The subtree of this tree
+ * @param other The subtree of the other tree at the same block
+ * @param res The side of the block
+ * @param x The x coordinate of the block's upper-left grid cell
+ * @param y The y coordinate of the block's upper-left grid cell
+ * @param delta The delta being assembled
+ * @return NULL if the subtrees are equal; otherwise the delta's node
+ *  for the block: a copy of other in the delta's pool, or a new node on
+ *  the path to the blocks below that differ
+ */
+Quadtree::QuadtreeNode* Quadtree::compare(QuadtreeNode const* subRoot, QuadtreeNode* other,
+                                          int res, int x, int y, Delta& delta) const {
+	if (subRoot->hash == other->hash)
+		return NULL;
+	size_t index = delta.grafts.size();
+	size_t regions = delta.changed.size();
+	delta.grafts.push_back(true);
+	unordered_map<QuadtreeNode const*, QuadtreeNode*> moved;
+	if (subRoot->isLeaf() || other->isLeaf()) {
+		addRegion(res, x, y, delta.changed);
+		return delta.tree.relocate(other, *delta.tree.nodePool, moved);
+	}
+
+	// both grids match, so both trees have the same quadrants
+	QuadtreeNode* node = delta.tree.nodePool->create();
+	QuadtreeNode const* mine[4] = {subRoot->nwChild, subRoot->neChild,
+		subRoot->swChild, subRoot->seChild};
+	QuadtreeNode* theirs[4] = {other->nwChild, other->neChild,
+		other->swChild, other->seChild};
+	QuadtreeNode** slots[4] = {&node->nwChild, &node->neChild,
+		&node->swChild, &node->seChild};
+	int half = res / 2;
+	bool whole = true;
+	for (int i = 0; i < 4; i++) {
+		if (theirs[i] == &padding)
+			continue;
+		size_t child = delta.grafts.size();
+		*slots[i] = compare(mine[i], theirs[i], half, x + (i % 2) * half,
+			y + (i / 2) * half, delta);
+		whole = whole && *slots[i] != NULL && delta.grafts[child];
+	}
+	if (!whole) {
+		delta.grafts[index] = false;
+		return node;
+	}
+
+	// every quadrant changed: take the block whole, as a single region
+	delta.tree.clear(node);
+	delta.grafts.resize(index + 1);
+	delta.changed.resize(regions);
+	addRegion(res, x, y, delta.changed);
+	return delta.tree.relocate(other, *delta.tree.nodePool, moved);
+}
+
+/**
+ * Private helper function for diff that records a changed block as a
+ * region of the image.
+ * @param side The side of the block
+ * @param x The x coordinate of the block's upper-left grid cell
+ * @param y The y coordinate of the block's upper-left grid cell
+ * @param regions Where to add the region
+ */
+void Quadtree::addRegion(int side, int x, int y, vector<Region>& regions) const {
+	// clip the block to the image, then turn it as the image is turned
+	int left = max(x, xOffset), top = max(y, yOffset);
+	int right = min(x + side, xOffset + imgWidth);
+	int bottom = min(y + side, yOffset + imgHeight);
+	orientRect(res, left, top, right, bottom, false);
+	int originX, originY;
+	imageOrigin(originX, originY);
+	Region region = {left - originX, top - originY, right - left, bottom - top};
+	regions.push_back(region);
+}
+
+// patch (public interface)
+//   - parameters: Delta const & delta - a delta made by diff from this tree
+//   - return value: whether the delta applied
+//   - turns this tree into the other tree of the diff, rebuilding only
+//        the paths to the changed subtrees
+bool Quadtree::patch(Delta const& delta)
+{
+	if (fingerprint() != delta.base) {
+		cerr << "[Quadtree]: the delta was made from a different tree" << endl;
+		return false;
+	}
+	if (delta.grafts.empty())
+		return true;
+
+	Quadtree const& target = delta.tree;
+	if (delta.grafts[0]) {
+		// the whole tree changed, geometry and all
+		release();
+		ownPool();
+		unordered_map<QuadtreeNode const*, QuadtreeNode*> moved;
+		rootNode = target.nodePool == nodePool ? copy(target.rootNode)
+			: relocate(target.rootNode, *nodePool, moved);
+		res = target.res;
+		imgWidth = target.imgWidth;
+		imgHeight = target.imgHeight;
+		xOffset = target.xOffset;
+		yOffset = target.yOffset;
+		rotation = target.rotation;
+		flipped = target.flipped;
+	}
+	else {
+		if (rotation != target.rotation || flipped != target.flipped)
+			materialize();
+		size_t index = 0;
+		apply(rootNode, target.rootNode, delta, index);
+	}
+	curve.reset();
+	return true;
+}
+
+/**
+ * Private helper function for patch that applies the delta's node for
+ * a block to the subtree there, refreshing the path back up.
+ * @param subRoot The subtree of this tree
+ * @param change The delta's node for the same block
+ * @param delta The delta being applied
+ * @param index The index of change among the delta's nodes in
+ *  preorder; advanced past change's subtree
+ */
+void Quadtree::apply(QuadtreeNode* & subRoot, QuadtreeNode* change, Delta const& delta,
+                     size_t& index) {
+	if (delta.grafts[index++]) {
+		clear(subRoot);
+		// every node of this tree must live in its pool
+		unordered_map<QuadtreeNode const*, QuadtreeNode*> moved;
+		subRoot = delta.tree.nodePool == nodePool ? copy(change)
+			: relocate(change, *nodePool, moved);
+		return;
+	}
+
+	unshare(subRoot);
+	QuadtreeNode** mine[4] = {&subRoot->nwChild, &subRoot->neChild,
+		&subRoot->swChild, &subRoot->seChild};
+	QuadtreeNode* changes[4] = {change->nwChild, change->neChild,
+		change->swChild, change->seChild};
+	for (int i = 0; i < 4; i++)
+		if (changes[i] != NULL)
+			apply(*mine[i], changes[i], delta, index);
+	average(subRoot);
+	summarize(subRoot);
+}
+
+/**
+ * The interning table of deduplicate: the nodes interned so far, found
+ * by their colour and child pointers. Children are interned before their
+ * parent, so equal pointers mean equal subtrees, and the content hash
+ * every node already carries serves as the table's hash. Each node maps
+ * to the size of its subtree counted as a tree.
+ */
+struct Quadtree::InternTable
+{
+	struct Hash
+	{
+		size_t operator()(QuadtreeNode const* node) const
+		{
+			return (size_t) node->hash;
 		}
-		else {
-			return minTolerance(numLeaves, min, mid);
+	};
+
+	struct Same
+	{
+		bool operator()(QuadtreeNode const* first, QuadtreeNode const* second) const
+		{
+			return first->element == second->element
+				&& first->nwChild == second->nwChild && first->neChild == second->neChild
+				&& first->swChild == second->swChild && first->seChild == second->seChild;
+		}
+	};
+
+	unordered_map<QuadtreeNode*, size_t, Hash, Same> nodes; /**< interned nodes */
+};
+
+// deduplicate (public interface)
+//   - return value: the nodes in the tree and the distinct nodes left
+//   - stores every set of identical subtrees once, shared
+Quadtree::SharingResult Quadtree::deduplicate()
+{
+	SharingResult result = {0, 0};
+	if (rootNode == NULL)
+		return result;
+
+	InternTable table;
+	result.nodes = intern(rootNode, table);
+	result.distinct = table.nodes.size();
+	// the duplicates have been freed; give back the slabs they held
+	compact();
+	return result;
+}
+
+/**
+ * Private helper function for deduplicate that interns a subtree:
+ * replaces it with the table's equal subtree if there is one, and
+ * otherwise interns its children and adds it to the table.
+ * @param subRoot The current node in the recursion
+ * @param table The nodes interned so far
+ * @return The number of nodes in the subtree, counted as a tree
+ */
+size_t Quadtree::intern(QuadtreeNode* & subRoot, InternTable& table) {
+	// a node already interned, or one with the same children as one,
+	// needs no visit below
+	auto found = table.nodes.find(subRoot);
+	if (found == table.nodes.end() && !subRoot->isLeaf()) {
+		unshare(subRoot);
+		QuadtreeNode** children[4] = {&subRoot->nwChild, &subRoot->neChild,
+			&subRoot->swChild, &subRoot->seChild};
+		size_t size = 1;
+		for (int i = 0; i < 4; i++)
+			if (*children[i] != &padding)
+				size += intern(*children[i], table);
+		found = table.nodes.find(subRoot);
+		if (found == table.nodes.end()) {
+			table.nodes.emplace(subRoot, size);
+			return size;
 		}
 	}
-	else {
-		return min;
+	if (found == table.nodes.end()) {
+		table.nodes.emplace(subRoot, 1);
+		return 1;
+	}
+
+	// the stored node shares the children, so they outlive this one
+	if (found->first != subRoot) {
+		QuadtreeNode* stored = copy(found->first);
+		clear(subRoot);
+		subRoot = stored;
+	}
+	return found->second;
+}
+
+/**
+ * Private helper function for diff and patch that hashes the whole tree:
+ * its root's content hash, and the grid and orientation it is laid out in.
+ * @return The tree's fingerprint; 0 for an empty tree
+ */
+uint64_t Quadtree::fingerprint() const {
+	if (rootNode == NULL)
+		return 0;
+	int geometry[7] = {res, imgWidth, imgHeight, xOffset, yOffset, rotation, flipped};
+	uint64_t hash = rootNode->hash;
+	for (int i = 0; i < 7; i++)
+		hash = mix(hash + (uint64_t) geometry[i]);
+	return hash;
+}
+
+/**
+ * Private helper function that hashes a node's content: a leaf's
+ * colour, or an internal node's children's hashes in order.
+ * @param subRoot The node to hash; its children must be hashed
+ * @return The node's content hash
+ */
+uint64_t Quadtree::contentHash(QuadtreeNode const* subRoot) {
+	if (subRoot->isLeaf()) {
+		RGBAPixel const& color = subRoot->element;
+		return mix((uint64_t) color.red | (uint64_t) color.green << 8
+			| (uint64_t) color.blue << 16 | (uint64_t) color.alpha << 24 | 1ULL << 32);
 	}
+	// a padding quadrant hashes differently from any node
+	QuadtreeNode const* children[4] = {subRoot->nwChild, subRoot->neChild,
+		subRoot->swChild, subRoot->seChild};
+	uint64_t hash = 0x9e3779b97f4a7c15ULL;
+	for (int i = 0; i < 4; i++)
+		hash = mix(hash + (children[i] != &padding ? children[i]->hash : 0x2545f4914f6cdd1dULL));
+	return hash;
+}
+
+// Delta
+//   - creates a delta that changes nothing
+Quadtree::Delta::Delta() : base(0)
+{
+}
+
+vector<Quadtree::Region> const& Quadtree::Delta::regions() const
+{
+	return changed;
+}
+
+size_t Quadtree::Delta::nodes() const
+{
+	return countNodes(tree.rootNode);
+}
+
+bool Quadtree::Delta::empty() const
+{
+	return grafts.empty();
+}
+
+/**
+ * @param subRoot A subtree of the delta tree
+ * @return The number of nodes in it
+ */
+size_t Quadtree::Delta::countNodes(QuadtreeNode const* subRoot)
+{
+	if (subRoot == NULL || subRoot == &padding)
+		return 0;
+	return 1 + countNodes(subRoot->nwChild) + countNodes(subRoot->neChild)
+		+ countNodes(subRoot->swChild) + countNodes(subRoot->seChild);
 }
 
 // QuadtreeNode
@@ -470,6 +2341,10 @@ int Quadtree::minTolerance(int numLeaves, int min, int max) const {
 Quadtree::QuadtreeNode::QuadtreeNode()
 {
     neChild = seChild = nwChild = swChild = NULL;
+    maxDiff = 0;
+    pruneFloor = INT_MAX;
+    refs = 1;
+    hash = 0;
 }
 
 // QuadtreeNode
@@ -481,4 +2356,41 @@ Quadtree::QuadtreeNode::QuadtreeNode(RGBAPixel const& elem)
 {
     element = elem;
     neChild = seChild = nwChild = swChild = NULL;
+    low = high = elem;
+    maxDiff = 0;
+    pruneFloor = INT_MAX;
+    refs = 1;
+    hash = contentHash(this);
+}
+
+// QuadtreeNode
+//   - parameters: QuadtreeNode const & other - node to clone
+//   - copy constructor for the QuadtreeNode class; the clone has a single
+//        owner and shares other's children
+Quadtree::QuadtreeNode::QuadtreeNode(QuadtreeNode const& other)
+{
+    nwChild = other.nwChild;
+    neChild = other.neChild;
+    swChild = other.swChild;
+    seChild = other.seChild;
+    QuadtreeNode* children[4] = {nwChild, neChild, swChild, seChild};
+    for (int i = 0; i < 4; i++)
+        if (children[i] != NULL && children[i] != &padding)
+            children[i]->refs++;
+
+    element = other.element;
+    low = other.low;
+    high = other.high;
+    maxDiff = other.maxDiff;
+    pruneFloor = other.pruneFloor;
+    refs = 1;
+    hash = other.hash;
+}
+
+// isLeaf
+//   - return value: true if this node has no children at all; a node
+//        has either four children or none, so checking one would do
+bool Quadtree::QuadtreeNode::isLeaf() const
+{
+    return nwChild == NULL && neChild == NULL && swChild == NULL && seChild == NULL;
 }
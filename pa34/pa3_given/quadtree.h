@@ -6,15 +6,101 @@
 #ifndef QUADTREE_H
 #define QUADTREE_H
 
+#include "nodepool.h"
 #include "png.h"
+#include <atomic>
 #include <cmath>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+class QuadtreeReader;
+class QuadtreeWriter;
+class TaskGroup;
+class ThreadPool;
 
 /**
  * A tree structure that is used to compress PNG images.
+ *
+ * Images of any width and height are supported. The tree's blocks are
+ * laid out on a power of two grid of side res that contains the image;
+ * a quadrant straddling the image border only covers, and only averages,
+ * its pixels inside the image. Quadrants lying wholly outside the image
+ * all point at one shared, static padding leaf, so that every node still
+ * has either four children or none; nothing else is stored for them, and
+ * only the given printTree shows them (see below).
+ *
+ * Rotations and mirrorings are not applied to the nodes. The tree keeps
+ * an orientation (a mirroring followed by some clockwise quarter turns)
+ * that every read - getPixel, decompress, writeToFile - applies to the
+ * stored layout as it goes, so changing it takes constant time;
+ * materialize() bakes it into the nodes when the layout itself matters.
+ * The given printTree and operator== walk the stored nodes, so while an
+ * orientation is pending they walk an upright copy of the tree instead.
+ *
+ * Copies share nodes. Every node counts the trees and parents pointing
+ * at it, so copying a Quadtree is O(1); a shared node is never changed,
+ * and prune or materialize clone just the nodes on the paths they
+ * change before changing them (copy-on-write).
+ *
+ * Nodes come from a NodePool (nodepool.h) that the tree shares with its
+ * copies. Nodes freed by prune are reused by later clones, and a tree
+ * that is the only user of its pool is torn down in bulk, without
+ * visiting its nodes.
  */
 class Quadtree
 {
   public:
+    /**
+     * One step of the function from tolerance to pruned leaf count: for
+     * every tolerance from this step's up to (not including) the next
+     * step's, pruning leaves exactly this many leaves.
+     */
+    struct PruneStep
+    {
+        int tolerance; /**< first tolerance of the step */
+        int leaves; /**< pruneSize for every tolerance in the step */
+    };
+
+    /**
+     * What a rate-controlled compression achieved.
+     */
+    struct CompressionResult
+    {
+        int leaves; /**< leaves left in the tree */
+        size_t bytes; /**< size of the tree as writeToFile saves it */
+        double psnr; /**< PSNR in dB against the image before compressing;
+                          infinite if nothing changed */
+    };
+
+    /**
+     * What deduplicate achieved.
+     */
+    struct SharingResult
+    {
+        size_t nodes; /**< nodes in the tree, a shared node counted once
+                           for every place it appears */
+        size_t distinct; /**< nodes actually stored */
+    };
+
+    /**
+     * A rectangle of the represented image, in pixels.
+     */
+    struct Region
+    {
+        int x; /**< column of the upper-left pixel */
+        int y; /**< row of the upper-left pixel */
+        int width; /**< number of columns */
+        int height; /**< number of rows */
+    };
+
+    class Delta;
+
     /**
      * The no parameters constructor takes no arguments, and produces
      * an empty Quadtree object, i.e. one which has no associated
@@ -28,8 +114,8 @@ class Quadtree
      * effectively crops the source image into a resolution by resolution 
      * square.
      *
-     * You may assume that resolution is a power of two, and that the width and
-     * height of source are each at least resolution.
+     * You may assume that the width and height of source are each at least
+     * resolution. resolution need not be a power of two.
      *
      * Perhaps, to implement this, you could leverage the functionality
      * of another function you have written.
@@ -40,6 +126,25 @@ class Quadtree
      */
     Quadtree(PNG const& source, int resolution);
 
+    /**
+     * Builds a Quadtree representing the whole of source, whatever its
+     * width and height.
+     *
+     * @param source The source image to base this Quadtree on
+     */
+    explicit Quadtree(PNG const& source);
+
+    /**
+     * Builds the same Quadtree as Quadtree(source, resolution), using up
+     * to numThreads threads. See buildTree(source, resolution, numThreads).
+     *
+     * @param source The source image to base this Quadtree on
+     * @param resolution The width and height of the sides of the image to
+     *  be represented
+     * @param numThreads The number of threads to build with
+     */
+    Quadtree(PNG const& source, int resolution, int numThreads);
+
     /**
      * Copy constructor. Simply sets this Quadtree to be a copy of the
      * parameter.
@@ -64,9 +169,9 @@ class Quadtree
     /**
      * Deletes the current contents of this Quadtree object, then turns
      * it into a Quadtree object representing the upper-left resolution 
-     * by resolution block of source. You may assume that resolution 
-     * is a power of two, and that the width and height of source 
-     * are each at least resolution.
+     * by resolution block of source. You may assume that the width
+     * and height of source are each at least resolution, which need
+     * not be a power of two.
      *
      * @param source The source image to base this Quadtree on
      * @param resolution The width and height of the sides of the image to
@@ -74,6 +179,73 @@ class Quadtree
      */
     void buildTree(PNG const& source, int resolution);
 
+    /**
+     * Multi-threaded buildTree. The four quadrants of every large enough
+     * node are built as independent tasks on a work-stealing pool of
+     * numThreads threads; subtrees of at most parallelCutoff pixels a side
+     * are built serially by whichever thread picks them up. The resulting
+     * tree is identical, node for node, to the one the serial buildTree
+     * produces. With numThreads <= 1, or a resolution at or below the
+     * cutoff, this is just buildTree(source, resolution).
+     *
+     * @param source The source image to base this Quadtree on
+     * @param resolution The width and height of the sides of the image to
+     *  be represented
+     * @param numThreads The number of threads to build with
+     */
+    void buildTree(PNG const& source, int resolution, int numThreads);
+
+    /**
+     * Deletes the current contents of this Quadtree object, then turns
+     * it into a Quadtree object representing the whole of source.
+     *
+     * @param source The source image to base this Quadtree on
+     */
+    void buildTree(PNG const& source);
+
+    /**
+     * Deletes the current contents of this Quadtree object, then turns
+     * it into a Quadtree object representing the upper-left width by
+     * height block of source, which need be neither square nor a power of
+     * two on either side. Border quadrants are partial: children that
+     * would cover only pixels outside the block are not created, and a
+     * parent averages only the children it has. Built with numThreads
+     * threads as in buildTree(source, resolution, numThreads).
+     *
+     * @param source The source image to base this Quadtree on
+     * @param width The width of the block to be represented
+     * @param height The height of the block to be represented
+     * @param numThreads The number of threads to build with
+     */
+    void buildTree(PNG const& source, int width, int height, int numThreads);
+
+    /**
+     * Deletes the current contents of this Quadtree object, then turns
+     * it into a Quadtree object representing the whole of the png image
+     * in a file, without ever decoding the whole image. Rows are read
+     * from libpng one at a time, and every two rows of a level of the
+     * tree are joined into a row of the level above as soon as both are
+     * there, so besides the tree only two rows of pixels and one row of
+     * nodes per level are held at once. The tree is identical, node for
+     * node, to buildTree(PNG(fileName)).
+     *
+     * @param fileName Name of the png file to read; interlaced files are
+     *  not supported
+     * @return Whether the file was read; if not, the Quadtree is left
+     *  empty
+     */
+    bool buildFromFile(std::string const& fileName);
+
+    /**
+     * @return The width of the image this Quadtree represents
+     */
+    int width() const;
+
+    /**
+     * @return The height of the image this Quadtree represents
+     */
+    int height() const;
+
     /**
      * Gets the RGBAPixel corresponding to the pixel at coordinates (x,
      * y) in the bitmap image which the Quadtree represents.
@@ -95,6 +267,34 @@ class Quadtree
      */
     RGBAPixel getPixel(int x, int y) const;
 
+    /**
+     * Gets every pixel of a rectangle of the represented image in one
+     * walk of the tree. Only quadrants overlapping the rectangle are
+     * visited, and each leaf fills the part of its block inside the
+     * rectangle at once, rather than each pixel descending from the root.
+     * Pixels of the rectangle outside the image, or of an empty Quadtree,
+     * are default RGBAPixels, as getPixel would return.
+     *
+     * @param x The x coordinate of the rectangle's upper-left pixel
+     * @param y The y coordinate of the rectangle's upper-left pixel
+     * @param width The width of the rectangle
+     * @param height The height of the rectangle
+     * @return A width by height PNG whose pixel (i, j) is getPixel(x + i,
+     *  y + j), or a default PNG if the rectangle is empty
+     */
+    PNG getRegion(int x, int y, int width, int height) const;
+
+    /**
+     * Gets the pixels at many coordinates at once; the result is the same
+     * as calling getPixel on each. The points are sorted in Morton (z-)
+     * order of their place in the tree, so points in the same quadrant
+     * are looked up by a single descent that splits as they part ways.
+     *
+     * @param points The (x, y) coordinates of the pixels to be retrieved
+     * @return The pixels, in the order of points
+     */
+    std::vector<RGBAPixel> getPixels(std::vector<std::pair<int, int> > const& points) const;
+
     /**
      * Returns the underlying PNG object represented by the Quadtree.
      *
@@ -109,17 +309,99 @@ class Quadtree
      * directly.
      *
      * @return The decompressed PNG image this Quadtree represents
+     * @note The tree is walked once and every leaf fills its whole square
+     *  block, rather than looking each pixel up from the root.
      */
     PNG decompress() const;
 
+    /**
+     * Produces the same image as decompress(), with numThreads threads.
+     * The tree is cut at the shallowest depth that gives every thread
+     * several subtrees to paint, or where subtrees reach parallelCutoff
+     * pixels a side; each subtree is a task that fills its own disjoint
+     * tile of the image, written straight into the shared PNG. With
+     * numThreads <= 1 this is decompress().
+     *
+     * @param numThreads The number of threads to decompress with
+     * @return The decompressed PNG image this Quadtree represents
+     */
+    PNG decompress(int numThreads) const;
+
+    /**
+     * Decompresses the Quadtree straight into a PNG file on disk, without
+     * ever holding the whole image in memory. The image is produced a
+     * band of bandRows rows at a time: each band is painted by one walk
+     * over the part of the tree that overlaps it, handed to the PNG
+     * writer and then reused for the next band. The file is identical to
+     * decompress().writeToFile(fileName).
+     *
+     * @param fileName Name of the file to write to
+     * @param bandRows Number of rows to produce per band
+     * @return Whether the file was written successfully
+     */
+    bool decompressToFile(std::string const& fileName, int bandRows = 64) const;
+
+    /**
+     * Saves the Quadtree, pruned structure and all, in the compact binary
+     * format described in quadtreefile.h: its shape as one bit per node
+     * plus the colour of every leaf.
+     *
+     * @param fileName Name of the file to write to
+     * @return Whether the file was written successfully
+     */
+    bool writeToFile(std::string const& fileName) const;
+
+    /**
+     * Lays the Quadtree out as a progressive stream (quadtreestream.h):
+     * level by level from the root down, with the colour of every node,
+     * so that a ProgressiveDecoder can show a coarse preview of the image
+     * as soon as the first levels arrive and sharpen it as the rest do.
+     *
+     * @return The stream
+     */
+    std::vector<uint8_t> encodeProgressive() const;
+
+    /**
+     * Deletes the current contents of this Quadtree object, then loads
+     * the tree saved in a file by writeToFile (of either Quadtree or
+     * ArrayQuadtree). The file is mapped into memory and the nodes are
+     * decoded straight from the mapping; no buildTree is needed, and the
+     * loaded tree is identical to the one that was saved.
+     *
+     * @param fileName Name of the file to read
+     * @return Whether the file was read successfully; if not, the
+     *  Quadtree is left empty
+     */
+    bool readFromFile(std::string const& fileName);
+
     /**
      * Rotates the Quadtree object's underlying image clockwise by 90
-     * degrees. (Note that this should be done using pointer
-     * manipulation, not by attempting to swap the element fields of
-     * QuadtreeNodes.  Trust us; it's easier this way.)
+     * degrees. Only the orientation changes, so this takes constant
+     * time; the nodes are rearranged by materialize().
      */
     void clockwiseRotate();
 
+    /**
+     * Mirrors the Quadtree object's underlying image left to right, in
+     * constant time.
+     */
+    void flipHorizontal();
+
+    /**
+     * Mirrors the Quadtree object's underlying image top to bottom, in
+     * constant time.
+     */
+    void flipVertical();
+
+    /**
+     * Rearranges the nodes (using pointer manipulation, not by swapping
+     * the element fields of QuadtreeNodes) so that the stored layout is
+     * the image as currently rotated and mirrored, and resets the
+     * orientation. One pass over the tree, whatever the orientation.
+     * Nothing a caller can observe through the public interface changes.
+     */
+    void materialize();
+
 // PA 4 FUNCTIONS
 
     /**
@@ -188,6 +470,7 @@ class Quadtree
      *  determines whether the subtree can be pruned.
      * @return How many leaves this Quadtree would have if it were pruned
      *  with the given tolerance.
+     * @note Answered in O(log n) from pruneCurve().
      */
     int pruneSize(int tolerance) const;
 
@@ -216,9 +499,119 @@ class Quadtree
      *  more than numLeaves remaining in the tree.
      * @note The "obvious" implementation involves a sort of linear search over
      *  all possible tolerances. What if you tried a binary search instead?
+     * @note Answered in O(log n) from pruneCurve(), and always returns the
+     *  smallest such tolerance.
      */
     int idealPrune(int numLeaves) const;
 
+    /**
+     * Returns the whole step function from tolerance to the number of
+     * leaves pruning would leave, ordered by increasing tolerance (and so
+     * by non-increasing leaf count). The first step starts at tolerance
+     * -1, where nothing is pruned; the last one ends with a single leaf.
+     *
+     * A node collapses under tolerance t exactly when its maxDiff is at
+     * most t and no ancestor collapses first, i.e. for t in
+     * [maxDiff, smallest maxDiff of its ancestors). The curve is built
+     * from those intervals in one pass over the tree plus a counting sort
+     * over the possible tolerances, the first time it is needed after the
+     * tree changes, and then answers pruneSize and idealPrune by binary
+     * search. Like the other const member functions, it may be called
+     * from several threads at once.
+     *
+     * @return The steps of the curve; empty for an empty tree
+     */
+    std::vector<PruneStep> const& pruneCurve() const;
+
+    /**
+     * Compresses the image until writeToFile would save it in at most
+     * maxBytes bytes, losing as little quality as it can on the way.
+     *
+     * Unlike prune, which collapses every node within one tolerance,
+     * this collapses one node at a time: of the nodes whose children are
+     * all leaves, always the one that adds the least squared error per
+     * leaf it removes, found with a priority queue. A collapse can make
+     * its parent a candidate in turn. Error is measured exactly, against
+     * the image the tree represented when the call began, from per-node
+     * colour sums. A collapsed node keeps its colour, the average of its
+     * children, as in prune.
+     *
+     * @param maxBytes The largest file size wanted
+     * @return The leaf count, file size and PSNR reached; the size is
+     *  more than maxBytes only if even a single leaf does not fit
+     */
+    CompressionResult compressToSize(size_t maxBytes);
+
+    /**
+     * Compresses the image as far as it can while keeping its PSNR,
+     * against the image the tree represented when the call began, at
+     * least minPsnr dB. Collapses are chosen as in compressToSize, and
+     * compression stops at the first one that would go below the floor.
+     *
+     * @param minPsnr The lowest PSNR, in dB, to accept
+     * @return The leaf count, file size and PSNR reached
+     */
+    CompressionResult compressToQuality(double minPsnr);
+
+    /**
+     * Finds how other differs from this Quadtree. Both trees are walked
+     * together from the root, and a subtree whose content hash (its shape
+     * and leaf colours, kept in every node since it was built) matches
+     * the one across is skipped whole, so the cost follows the size of the
+     * change rather than of the image. Where the trees differ, other's
+     * subtree is copied into the delta's own pool; a node all of whose
+     * quadrants differ is taken whole instead.
+     *
+     * Trees of different sizes, or of different grids (see
+     * buildTree(source, width, height, numThreads)), differ everywhere.
+     * Trees of the same size in different orientations are compared as
+     * materialized copies, which costs a walk of both.
+     *
+     * @param other The tree to compare against, usually the next frame
+     * @return The changed regions, and the patch that turns this tree
+     *  into other
+     */
+    Delta diff(Quadtree const& other) const;
+
+    /**
+     * Applies a delta made by diff from this tree (or an equal one), so
+     * that this tree becomes the other tree of the diff. Only the paths
+     * to the changed subtrees are rebuilt, from copies of the delta's
+     * subtrees. A tree whose orientation differs from the delta's is
+     * materialized first.
+     *
+     * @param delta A delta made by diff
+     * @return Whether the delta applied; it does not if it was made from
+     *  a different tree, which is then left as it was
+     */
+    bool patch(Delta const& delta);
+
+    /**
+     * Turns the tree into a DAG in which identical subtrees are stored
+     * once: every node is interned, bottom up, in a table keyed by its
+     * colour and its (already interned) children, and a node found there
+     * is replaced by the one stored. Screenshots and other synthetic
+     * images, whose flat areas and repeated blocks line up with the grid,
+     * shrink the most; photographs mostly share single leaves.
+     *
+     * Shared nodes are shared the way copies of a tree share theirs, so
+     * every function works on the result as before. Whatever changes the
+     * tree afterwards (prune, compress, patch, materialize) clones the
+     * shared nodes it changes, once for every place they appear.
+     *
+     * @return The nodes in the tree and the distinct nodes left
+     */
+    SharingResult deduplicate();
+
+    /**
+     * Chooses whether trees built or loaded from now on take their nodes
+     * from a NodePool (the default) or allocate each one with new, for
+     * comparing the two. Trees that already exist are not affected.
+     *
+     * @param pooled Whether to pool nodes
+     */
+    static void setNodePooling(bool pooled);
+
 // END PA 4 FUNCTIONS
 
   private:
@@ -237,14 +630,102 @@ class Quadtree
 
         RGBAPixel element; /**< the pixel stored as this node's "data" */
 
+        // statistics over the leaves below this node, kept up to date by
+        // build and prune (a rotation does not change them)
+        RGBAPixel low; /**< per-channel minimum over the leaves */
+        RGBAPixel high; /**< per-channel maximum over the leaves */
+        int maxDiff; /**< largest difference between element and a leaf */
+        int pruneFloor; /**< smallest maxDiff of a non-leaf in the subtree */
+
+        std::atomic<int> refs; /**< trees and parents sharing this node */
+
+        // hash of the subtree's content - its shape and leaf colours, in
+        // the stored layout - kept up to date along with the statistics
+        uint64_t hash;
+
       	// default constructor
       	QuadtreeNode();
         // default param constructor
         QuadtreeNode(RGBAPixel const& elem);
+        // copies everything but the reference count, which starts at one;
+        // the children become shared with other
+        QuadtreeNode(QuadtreeNode const& other);
+
+        // whether this node has no children (a non-leaf has all four;
+        // those outside the image are the padding leaf)
+        bool isLeaf() const;
     };
 
-    QuadtreeNode* root; /**< pointer to root of quadtree */
-    int res; // resolution of the underlying bitmap (number of pixels in an image)
+    // the child of every quadrant lying wholly outside the image. It
+    // belongs to no pool and no tree, is never counted, freed or shared
+    // by reference count, and is skipped wherever the image's leaves are
+    static QuadtreeNode padding;
+
+    QuadtreeNode* rootNode; /**< pointer to root of quadtree */
+
+    /**
+     * The root as quadtree_given.cpp sees it. The given code walks the
+     * nodes in their stored layout, so while the tree has an orientation
+     * pending this gives the root of an upright copy of the tree, made
+     * with materialize() and kept until the tree's root or orientation
+     * changes; the tree's own nodes are never rearranged, and several
+     * threads may read it at once. Every other member function uses
+     * rootNode, and keeps the orientation lazy.
+     */
+    class GivenRoot
+    {
+      public:
+        explicit GivenRoot(Quadtree const* tree);
+        ~GivenRoot();
+        GivenRoot(GivenRoot const&) = delete;
+        GivenRoot& operator=(GivenRoot const&) = delete;
+
+        // gives the tree's root, or an upright copy's if it is oriented
+        operator QuadtreeNode const*() const;
+
+      private:
+        Quadtree const* tree; /**< the tree whose root this is */
+        mutable std::mutex lock; /**< guards the copies below */
+        // the tree as it was when last copied upright; holding on to its
+        // root means the tree must clone that root before changing it
+        mutable std::unique_ptr<Quadtree> source;
+        mutable std::unique_ptr<Quadtree> upright; /**< source, materialized */
+    };
+    GivenRoot root; /**< the root, upright, for the given code */
+    // where this tree's nodes come from; shared with every tree sharing
+    // any of them, so a node is always freed into the pool it came from.
+    // NULL until the tree first builds or loads, and only while it is empty
+    std::shared_ptr<NodePool<QuadtreeNode> > nodePool;
+    static bool pooling; /**< whether new pools carve nodes from slabs */
+    int res; // side of the power of two grid the tree's blocks are laid out on
+    int imgWidth; /**< width of the represented image */
+    int imgHeight; /**< height of the represented image */
+    int xOffset; /**< column of the grid where the image starts */
+    int yOffset; /**< row of the grid where the image starts */
+
+    // orientation of the image relative to the stored nodes: the stored
+    // image is mirrored left to right if flipped, then turned clockwise
+    // rotation quarter turns. Offsets and sizes above are the stored ones
+    int rotation; /**< clockwise quarter turns, 0 to 3 */
+    bool flipped; /**< whether the stored image is mirrored first */
+
+    // tolerance to leaf count curve, built lazily and shared by copies;
+    // NULL means stale. Const member functions read and publish it with
+    // atomic_load and atomic_compare_exchange_strong
+    mutable std::shared_ptr<std::vector<PruneStep> const> curve;
+
+    /**
+     * Subtrees this many pixels a side or smaller are not worth handing to
+     * another thread; parallel builds do them serially.
+     */
+    static const int parallelCutoff = 64;
+
+    /**
+     * Blocks this many pixels a side or smaller that lie wholly inside the
+     * image are built level by level from whole rows of pixels, with the
+     * batched PixelKernels, instead of node by node.
+     */
+    static const int kernelBlock = 16;
 
     ///////////////////////////////////////////
     // HELPER FUNCTIONS ADDED BELOW (by me!) //
@@ -261,19 +742,278 @@ class Quadtree
      */
     void build(PNG const& source, QuadtreeNode* & subRoot, int res, int x, int y);
 
+    /**
+     * Private helper function for build: builds the subtree of a block of
+     * at most kernelBlock pixels a side lying wholly inside the image. Each
+     * level's colours are averaged a row at a time from the level below,
+     * starting from the image rows, and the bottom internal level's
+     * statistics come from the same rows; the nodes are then linked up.
+     * The subtree is identical to the one build makes node by node.
+     * @param source The source image file in PNG format
+     * @param subRoot Set to the root of the new subtree
+     * @param res The side of the block, a power of two
+     * @param x The x coordinate of the block's upper-left pixel
+     * @param y The y coordinate of the block's upper-left pixel
+     */
+    void buildBlock(PNG const& source, QuadtreeNode* & subRoot, int res, int x, int y);
+
+    /**
+     * Private helper function for the multi-threaded buildTree. Forks the
+     * nw, ne and sw quadrants onto the pool, builds se itself, waits for
+     * the others and then averages them, exactly like build.
+     * @param pool The pool to fork quadrant builds onto
+     * @param source The source image file in PNG format
+     * @param subRoot The current node in the recursion
+     * @param res The resolution of the current Quadtree in the recursion
+     * @param x The x axis value corresponding to a QuadtreeNode
+     * @param y The y axis value corresponding to a QuadtreeNode
+     */
+    void parallelBuild(ThreadPool& pool, PNG const& source, QuadtreeNode* & subRoot,
+                       int res, int x, int y);
+
+    /**
+     * Private helper function for buildFromFile that builds the bottom
+     * internal level under a pair of image rows: one node per two
+     * columns, with its leaves. Whole 2 by 2 blocks go through the
+     * batched PixelKernels, as in buildBlock.
+     * @param top The upper row, width pixels
+     * @param bottom The lower row, or NULL if the upper row is the last
+     * @param width The number of pixels in a row
+     * @param out Set to the new nodes, left to right
+     */
+    void joinPixelRows(RGBAPixel const* top, RGBAPixel const* bottom, int width,
+                       std::vector<QuadtreeNode*>& out);
+
+    /**
+     * Private helper function for buildFromFile that joins two rows of
+     * nodes of one level into the row of their parents.
+     * @param top The upper row
+     * @param bottom The lower row, or NULL if the upper row is the last
+     *  of its level
+     * @param out Set to the parents, left to right
+     */
+    void joinRows(std::vector<QuadtreeNode*> const& top,
+                  std::vector<QuadtreeNode*> const* bottom,
+                  std::vector<QuadtreeNode*>& out);
+
+    /**
+     * Private helper function for buildFromFile that hands a finished row
+     * of nodes to its level. The first row of a pair waits there for the
+     * second; the second is joined with it and the parents' row is handed
+     * on up, and the single node of the top level becomes the root.
+     * @param waiting For each level, its row waiting for a partner, or an
+     *  empty row
+     * @param level The level of row; the leaves are level 0
+     * @param row The finished row; emptied
+     */
+    void addRow(std::vector<std::vector<QuadtreeNode*> >& waiting, int level,
+                std::vector<QuadtreeNode*>& row);
+
+    /**
+     * Private helper function for buildBlock and joinPixelRows:
+     * creates the parent of four leaves and gives it its leaf statistics.
+     * @param nw The northwest leaf
+     * @param ne The northeast leaf
+     * @param sw The southwest leaf
+     * @param se The southeast leaf
+     * @param color The average of the four
+     * @param distance The largest difference between color and a leaf
+     * @return The new parent
+     */
+    QuadtreeNode* joinLeaves(QuadtreeNode* nw, QuadtreeNode* ne, QuadtreeNode* sw,
+                             QuadtreeNode* se, RGBAPixel const& color, int distance);
+
+    /**
+     * Private helper function that sets an internal node's element to
+     * the component-wise average of its children (all four, except at the
+     * image border).
+     * @param subRoot The node to update
+     */
+    void average(QuadtreeNode* subRoot);
+
+    /**
+     * Private helper function that tells whether a block of the grid
+     * overlaps the image, i.e. whether a node for it exists.
+     * @param res The side of the block
+     * @param x The x coordinate of the block's upper-left grid cell
+     * @param y The y coordinate of the block's upper-left grid cell
+     * @return true if at least one pixel of the block is in the image
+     */
+    bool inImage(int res, int x, int y) const;
+
+    /**
+     * Private helper function that maps a cell of a side by side grid
+     * from the stored layout to where the orientation puts it.
+     * @param side The side of the grid
+     * @param x The column, updated in place
+     * @param y The row, updated in place
+     */
+    void orient(int side, int& x, int& y) const;
+
+    /**
+     * Private helper function that undoes orient: maps a cell of the
+     * oriented grid back to the stored layout.
+     * @param side The side of the grid
+     * @param x The column, updated in place
+     * @param y The row, updated in place
+     */
+    void unorient(int side, int& x, int& y) const;
+
+    /**
+     * Private helper function that maps the half-open rectangle
+     * [left, right) x [top, bottom) of a side by side grid through orient,
+     * or through unorient if inverse is set.
+     * @param side The side of the grid
+     * @param left The first column, updated in place
+     * @param top The first row, updated in place
+     * @param right One past the last column, updated in place
+     * @param bottom One past the last row, updated in place
+     * @param inverse Whether to map back to the stored layout
+     */
+    void orientRect(int side, int& left, int& top, int& right, int& bottom,
+                    bool inverse) const;
+
+    /**
+     * Private helper function that finds where the oriented image sits on
+     * the grid.
+     * @param left Set to the first column of the image
+     * @param top Set to the first row of the image
+     */
+    void imageOrigin(int& left, int& top) const;
+
+    /**
+     * Private helper function that finds which stored child holds a
+     * quadrant of the oriented image.
+     * @param quadrant 0 to 3 for nw, ne, sw, se of the oriented image
+     * @return 0 to 3 for the stored nwChild, neChild, swChild, seChild
+     */
+    int storedQuadrant(int quadrant) const;
+
 	/**
 	 * Private helper function for operator= and copy constructor
-	 * @param subRoot The current node in the recursion
-     * @return a deep copy of the given subRoot
+	 * @param subRoot The root of the tree to copy
+     * @return subRoot, now shared with one more owner
 	 */
-    QuadtreeNode* copy(const QuadtreeNode* subRoot);
+    QuadtreeNode* copy(QuadtreeNode* subRoot);
+
+    /**
+     * Private helper function that makes subRoot safe to change: if it
+     * is shared, it is replaced by a private clone whose children are in
+     * turn shared with the original.
+     * @param subRoot The node about to be changed
+     */
+    void unshare(QuadtreeNode* & subRoot);
 
     /**
      * Private helper function for Quadtree destructor that clears beneath the parameter node.
-     * @param subRoot The current node in the recursion
+     * Drops one reference to subRoot; only the last owner frees it.
+     * @param subRoot The current node in the recursion; set to NULL
      */
     void clear(QuadtreeNode* & subRoot);
 
+    /**
+     * Private helper function that lets go of the whole tree. If no
+     * other tree uses the pool, every node is freed at once by resetting
+     * it; otherwise the tree is cleared node by node.
+     */
+    void release();
+
+    /**
+     * Private helper function for building or loading an empty tree:
+     * gives it a pool of its own, with the current pooling choice, unless
+     * it is already the only user of such a pool.
+     */
+    void ownPool();
+
+    /**
+     * Private helper function for prune and compress: once nodes have
+     * been freed, moves the tree into a new pool if it is the only user
+     * of its pool and uses less than a quarter of the pool's room, so
+     * the slabs of a heavily pruned tree are given back.
+     */
+    void compact();
+
+    /**
+     * Private helper function for compact that copies a subtree, colours
+     * and statistics included, into another pool. A node the subtree
+     * reaches more than once is copied once, and the copy shared alike.
+     * @param subRoot The current node in the recursion
+     * @param into The pool to take the copies from
+     * @param moved The copies made so far of nodes with several owners
+     * @return The copy of subRoot
+     */
+    QuadtreeNode* relocate(QuadtreeNode const* subRoot, NodePool<QuadtreeNode>& into,
+                           std::unordered_map<QuadtreeNode const*, QuadtreeNode*>& moved);
+
+    /**
+     * The interning table of deduplicate (see quadtree.cpp).
+     */
+    struct InternTable;
+
+    /**
+     * Private helper function for deduplicate that interns a subtree:
+     * replaces it with the table's equal subtree if there is one, and
+     * otherwise interns its children and adds it to the table.
+     * @param subRoot The current node in the recursion
+     * @param table The nodes interned so far
+     * @return The number of nodes in the subtree, counted as a tree
+     */
+    size_t intern(QuadtreeNode* & subRoot, InternTable& table);
+
+    /**
+     * Private helper function for diff and patch that hashes the whole
+     * tree: its root's content hash, and the grid and orientation it is
+     * laid out in.
+     * @return The tree's fingerprint; 0 for an empty tree
+     */
+    uint64_t fingerprint() const;
+
+    /**
+     * Private helper function that hashes a node's content: a leaf's
+     * colour, or an internal node's children's hashes in order.
+     * @param subRoot The node to hash; its children must be hashed
+     * @return The node's content hash
+     */
+    static uint64_t contentHash(QuadtreeNode const* subRoot);
+
+    /**
+     * Private helper function for diff that compares two subtrees of the
+     * same block and adds what differs to the delta.
+     * @param subRoot The subtree of this tree
+     * @param other The subtree of the other tree at the same block
+     * @param res The side of the block
+     * @param x The x coordinate of the block's upper-left grid cell
+     * @param y The y coordinate of the block's upper-left grid cell
+     * @param delta The delta being assembled
+     * @return NULL if the subtrees are equal; otherwise the delta's node
+     *  for the block: other, shared, or a new node on the path to the
+     *  blocks below that differ
+     */
+    QuadtreeNode* compare(QuadtreeNode const* subRoot, QuadtreeNode* other, int res,
+                          int x, int y, Delta& delta) const;
+
+    /**
+     * Private helper function for patch that applies the delta's node for
+     * a block to the subtree there, refreshing the path back up.
+     * @param subRoot The subtree of this tree
+     * @param change The delta's node for the same block
+     * @param delta The delta being applied
+     * @param index The index of change among the delta's nodes in
+     *  preorder; advanced past change's subtree
+     */
+    void apply(QuadtreeNode* & subRoot, QuadtreeNode* change, Delta const& delta,
+               size_t& index);
+
+    /**
+     * Private helper function for diff that records a changed block as a
+     * region of the image.
+     * @param side The side of the block
+     * @param x The x coordinate of the block's upper-left grid cell
+     * @param y The y coordinate of the block's upper-left grid cell
+     * @param regions Where to add the region
+     */
+    void addRegion(int side, int x, int y, std::vector<Region>& regions) const;
+
     /**
      * Private helper function for retrieving a pixel at coordinates (x,y). 
      * Returns deepest surviving ancestor if leaf node of interest is non-existent
@@ -286,64 +1026,244 @@ class Quadtree
     RGBAPixel retrieve(QuadtreeNode* subRoot, int res, int x, int y) const;
 
     /**
-     * Private helper function to rotate the Quadtree by 90 degrees clockwise.
+     * Private helper function for getPixels: looks up a batch of points
+     * inside subRoot's block, given sorted by their Morton codes relative
+     * to the whole grid, sharing one descent between them.
+     * @param subRoot The current node in the recursion
+     * @param res The resolution of the current image in the recursion
+     * @param first The first point of the batch
+     * @param last One past the last point of the batch
+     * @param pixels Where each point's pixel goes, by its index
+     */
+    void retrieveBatch(QuadtreeNode const* subRoot, int res,
+                       std::pair<uint64_t, size_t> const* first,
+                       std::pair<uint64_t, size_t> const* last,
+                       std::vector<RGBAPixel>& pixels) const;
+
+    /**
+     * Receives one uniformly coloured block of the image, as the
+     * half-open rectangle [left, right) x [top, bottom), and its colour.
+     */
+    typedef std::function<void(int left, int top, int right, int bottom,
+                               RGBAPixel const& color)> BlockVisitor;
+
+    /**
+     * Private helper function that reports, through visit, every leaf
+     * block below subRoot that overlaps the clip rectangle, clipped to it.
+     * Subtrees entirely outside the rectangle are not walked.
+     * @param subRoot The current node in the recursion
+     * @param res The resolution of the current image in the recursion
+     * @param x The x coordinate of subRoot's upper-left pixel
+     * @param y The y coordinate of subRoot's upper-left pixel
+     * @param left The first column of the clip rectangle
+     * @param top The first row of the clip rectangle
+     * @param right One past the last column of the clip rectangle
+     * @param bottom One past the last row of the clip rectangle
+     * @param visit Called once per overlapping leaf
+     */
+    void visitBlocks(QuadtreeNode const* subRoot, int res, int x, int y,
+                     int left, int top, int right, int bottom,
+                     BlockVisitor const& visit) const;
+
+    /**
+     * Private helper function for the multi-threaded decompress. Forks
+     * one task per subtree at the given depth (or per leaf or smallest
+     * subtree above it) that passes the subtree's blocks to visit.
+     * @param pool The pool to fork tile tasks onto
+     * @param tiles The group the tasks are accounted against
+     * @param subRoot The current node in the recursion
+     * @param res The resolution of the current image in the recursion
+     * @param x The x coordinate of subRoot's upper-left grid cell
+     * @param y The y coordinate of subRoot's upper-left grid cell
+     * @param depth The levels left to descend before forking
+     * @param visit Called once per leaf block inside the image
+     */
+    void parallelDecompress(ThreadPool& pool, TaskGroup& tiles, QuadtreeNode const* subRoot,
+                            int res, int x, int y, int depth,
+                            BlockVisitor const& visit) const;
+
+    /**
+     * Private helper function for writeToFile that appends the subtree at
+     * subRoot to out in preorder. Absent border children are skipped; the
+     * reader knows from the image geometry where they are.
+     * @param subRoot The current node in the recursion
+     * @param out The file being assembled
+     */
+    void save(QuadtreeNode const* subRoot, QuadtreeWriter& out) const;
+
+    /**
+     * Private helper function for readFromFile that rebuilds the next
+     * subtree in preorder from in, averaging and summarizing each internal
+     * node after its children exactly as build does.
+     * @param in The mapped file
+     * @param subRoot The current node in the recursion
+     * @param res The resolution of the current image in the recursion
+     * @param x The x coordinate of subRoot's upper-left grid cell
+     * @param y The y coordinate of subRoot's upper-left grid cell
+     * @return False if the file does not describe a valid subtree
+     */
+    bool load(QuadtreeReader& in, QuadtreeNode* & subRoot, int res, int x, int y);
+
+    /**
+     * Private helper function for materialize that moves every node's
+     * children to the slots the orientation maps them to, unsharing the
+     * internal nodes first.
      * @param subRoot The current root in the recursion
      */
-    void rotate(QuadtreeNode* & subRoot);
+    void reorient(QuadtreeNode* & subRoot);
 
     /**
-     * Private helper function to prune the given tree.
+     * Private helper function to prune the given tree. Subtrees whose
+     * pruneFloor shows nothing in them would collapse are left alone (and
+     * left shared); the others are unshared on the way down.
      * @param subRoot The current node in the recursion
      * @param tolerance The tolerance range to determine if prune
+     * @return true if anything below subRoot was pruned
      */
-    void pruneTree(QuadtreeNode* & subRoot, int tolerance);
+    bool pruneTree(QuadtreeNode* & subRoot, int tolerance);
 
     /**
-     * Private helper function to determien whether or not a node
-     * should be pruned.
-     * @param child The leaf node to be considered
-     * @param parent The parent node (current node) in the recursion
-     * @param tolerance The tolerance range to determine if prune
-     * @return true if the node should be pruned, false otherwise
+     * Private helper function that refreshes the cached leaf statistics
+     * (low, high, maxDiff) of a node from its children.
+     * @param subRoot The node to update
      */
-    bool shouldPrune(QuadtreeNode* child, QuadtreeNode* parent, int tolerance) const;
+    void summarize(QuadtreeNode* subRoot);
 
     /**
-     * Private helper function to calculate the difference between two colors
-     * between two nodes.
-     * @param node1 The first node of comparison
-     * @param node2 The second node of comparison
-     * @return the difference between two colors between two nodes
+     * Private helper function that finds the largest difference between
+     * point and any leaf below subRoot, skipping subtrees whose colour
+     * bounds show they cannot beat best.
+     * @param subRoot The current node in the recursion
+     * @param point The colour to measure from
+     * @param best The largest difference found so far
+     * @return max(best, largest difference in this subtree)
      */
-    int diff(QuadtreeNode* node1, QuadtreeNode* node2) const;
+    int farthestLeaf(QuadtreeNode const* subRoot, RGBAPixel const& point, int best) const;
 
     /**
-     * Private helper function that returns a 
-     * count of the total number of leaves the Quadtree would 
-     * have if it were pruned as in the prune function.
+     * Private helper function to calculate the difference between two colors.
+     * @param first The first color of comparison
+     * @param second The second color of comparison
+     * @return the difference between the two colors
+     */
+    int diff(RGBAPixel const& first, RGBAPixel const& second) const;
+
+    /**
+     * Private helper function for pruneCurve that records, for every node
+     * below subRoot, the interval of tolerances over which it would be a
+     * leaf after pruning.
      * @param subRoot The current node in the recursion
-     * @param tolerance The given tolerance range
-     * @return a count of the total number of leaves the Quadtree 
-     *         after hypothetical pruning
+     * @param ancestorMin The smallest maxDiff among subRoot's ancestors,
+     *  or INT_MAX for the root
+     * @param deltas Change in leaf count at each tolerance, offset by one
+     *  so that tolerance -1 is at index 0
      */
-    int numPrunes(QuadtreeNode* subRoot, int tolerance) const;
+    void collapseIntervals(QuadtreeNode const* subRoot, int ancestorMin,
+                           std::vector<int>& deltas) const;
 
     /**
-     * Private helper function that does a binary search
-     * over all possible tolerances to return a tolerance
-     * that prunes the tree with at most numLeaves.
-     * @param numLeaves The number of leaves you want to remain in the tree
-     *  after prune is called.
-     * @param min The minimum tolerance range
-     * @param max The maximum tolerance range
-     * @return The minimum tolerance needed to guarantee that there are no
-     *  more than numLeaves remaining in the tree.
+     * An internal node as seen by rate-controlled compression: its pixel
+     * sums and where it stands in the greedy collapse (see quadtree.cpp).
+     */
+    struct RateNode;
+
+    /**
+     * Private helper function for compressToSize and compressToQuality:
+     * collapses nodes greedily by added error per removed leaf until the
+     * tree fits in maxBytes bytes, or the next collapse would take the
+     * PSNR below minPsnr.
+     * @param maxBytes The largest file size wanted
+     * @param minPsnr The lowest PSNR, in dB, to accept
+     * @return The leaf count, file size and PSNR reached
      */
-    int minTolerance(int minLeaves, int min, int max) const;
+    CompressionResult compress(size_t maxBytes, double minPsnr);
+
+    /**
+     * Private helper function for compress: appends every internal node
+     * of the subtree to nodes in preorder, with its pixel sums, and adds
+     * the subtree's sums and node and leaf counts to the totals.
+     * @param subRoot The current node in the recursion
+     * @param res The resolution of the current image in the recursion
+     * @param x The x coordinate of subRoot's upper-left grid cell
+     * @param y The y coordinate of subRoot's upper-left grid cell
+     * @param parent The index of subRoot's parent in nodes, or -1
+     * @param nodes The internal nodes gathered so far
+     * @param sums Set to the red, green and blue sums, the sum of squares
+     *  and the pixel count of the subtree
+     */
+    void gatherRates(QuadtreeNode const* subRoot, int res, int x, int y, int parent,
+                     std::vector<RateNode>& nodes, int64_t sums[5]) const;
+
+    /**
+     * Private helper function for compress: turns the nodes marked as
+     * collapsed into leaves, unsharing what it changes and refreshing the
+     * statistics above them.
+     * @param subRoot The current node in the recursion, an internal node
+     * @param nodes The internal nodes, in the order gatherRates made them
+     * @param index The index of subRoot in nodes
+     */
+    void applyCollapses(QuadtreeNode* & subRoot, std::vector<RateNode> const& nodes,
+                        size_t index);
 	
+    // printTree's output for an image that is not square with a power of
+    // two side: the given printTree prints every leaf of the grid, so the
+    // quadrants lying wholly outside the image show up as leaves of the
+    // padding's colour, "(255,255,255) at depth d", in their place in the
+    // preorder. Such lines are not pixels of the image; for a square
+    // power of two image there are none, and the output is as it was.
+
 /**** Functions for testing/grading                      ****/
 /**** Do not remove this line or copy its contents here! ****/
 #include "quadtree_given.h"
 };
 
+/**
+ * The change from one Quadtree to another, as Quadtree::diff finds it.
+ * It holds the delta tree: a tree over the same grid as the new image
+ * whose quadrants that did not change are NULL, and whose other nodes
+ * are either new nodes on the path to a change or a copy of the new
+ * tree's subtree for a changed block. Its nodes come from a pool of its
+ * own, so a small delta keeps nothing of either tree alive.
+ */
+class Quadtree::Delta
+{
+  public:
+    /**
+     * Creates a delta that changes nothing, made from an empty tree.
+     */
+    Delta();
+
+    /**
+     * @return The changed blocks of the image, clipped to it, in no
+     *  particular order; they do not overlap
+     */
+    std::vector<Region> const& regions() const;
+
+    /**
+     * @return The number of nodes in the delta tree, changed subtrees
+     *  included; what sending the patch would cost
+     */
+    size_t nodes() const;
+
+    /**
+     * @return Whether the delta changes nothing
+     */
+    bool empty() const;
+
+  private:
+    Quadtree tree; /**< the delta tree, with the new tree's geometry */
+    std::vector<bool> grafts; /**< for each node on the paths in preorder,
+                                   whether it is a changed subtree */
+    std::vector<Region> changed; /**< the changed blocks of the image */
+    uint64_t base; /**< fingerprint of the tree the delta applies to */
+
+    /**
+     * @param subRoot A subtree of the delta tree
+     * @return The number of nodes in it
+     */
+    static size_t countNodes(QuadtreeNode const* subRoot);
+
+    friend class Quadtree;
+};
+
 #endif
@@ -0,0 +1,278 @@
+/**
+ * @file quadtreefile.cpp
+ * Implementation of QuadtreeWriter and QuadtreeReader.
+ */
+
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "quadtreefile.h"
+
+using namespace std;
+
+static const char magic[4] = {'Q', 'T', 'R', 'E'};
+static const size_t headerSize = 36;
+static const size_t version1HeaderSize = 20;
+
+inline void qtfile_err(string const& err)
+{
+	cerr << "[QuadtreeFile]: " << err << endl;
+}
+
+/**
+ * Appends value to out as four little-endian bytes.
+ */
+static void putWord(vector<uint8_t>& out, uint32_t value)
+{
+	for (int i = 0; i < 4; i++)
+		out.push_back((uint8_t) (value >> (8 * i)));
+}
+
+/**
+ * Reads four little-endian bytes as an integer.
+ */
+static uint32_t getWord(uint8_t const* in)
+{
+	return (uint32_t) in[0] | (uint32_t) in[1] << 8
+		| (uint32_t) in[2] << 16 | (uint32_t) in[3] << 24;
+}
+
+// QuadtreeWriter
+//   - parameters: int resolution - side length of the tree's grid
+//                 int width, int height - size of the represented image
+//                 int xOffset, int yOffset - where the image sits on the grid
+QuadtreeWriter::QuadtreeWriter(int resolution, int width, int height,
+                               int xOffset, int yOffset) : nodes(0)
+{
+	geometry[0] = resolution;
+	geometry[1] = width;
+	geometry[2] = height;
+	geometry[3] = xOffset;
+	geometry[4] = yOffset;
+}
+
+// addInternal
+//   - appends a 1 bit to the shape
+void QuadtreeWriter::addInternal()
+{
+	if (nodes % 8 == 0)
+		shape.push_back(0);
+	shape.back() |= (uint8_t) (0x80 >> (nodes % 8));
+	nodes++;
+}
+
+// addLeaf
+//   - parameters: RGBAPixel const & color - colour of the leaf
+//   - appends a 0 bit to the shape and the colour to the colour block
+void QuadtreeWriter::addLeaf(RGBAPixel const& color)
+{
+	if (nodes % 8 == 0)
+		shape.push_back(0);
+	nodes++;
+	colors.push_back(color.red);
+	colors.push_back(color.green);
+	colors.push_back(color.blue);
+	colors.push_back(color.alpha);
+}
+
+// writeToFile
+//   - parameters: string const & fileName - file to write to
+//   - return value: whether the file was written
+bool QuadtreeWriter::writeToFile(string const& fileName) const
+{
+	vector<uint8_t> header(magic, magic + 4);
+	putWord(header, QuadtreeReader::version);
+	for (int i = 0; i < 5; i++)
+		putWord(header, (uint32_t) geometry[i]);
+	putWord(header, (uint32_t) nodes);
+	putWord(header, (uint32_t) (colors.size() / 4));
+
+	FILE* fp = fopen(fileName.c_str(), "wb");
+	if (fp == NULL) {
+		qtfile_err("Failed to open " + fileName);
+		return false;
+	}
+	// an empty tree has no shape or colours, whose data() may be NULL
+	bool written = fwrite(header.data(), 1, header.size(), fp) == header.size()
+		&& (shape.empty() || fwrite(shape.data(), 1, shape.size(), fp) == shape.size())
+		&& (colors.empty() || fwrite(colors.data(), 1, colors.size(), fp) == colors.size());
+	if (fclose(fp) != 0 || !written) {
+		qtfile_err("Failed to write " + fileName);
+		return false;
+	}
+	return true;
+}
+
+// fileSize
+//   - parameters: size_t nodes - nodes in the tree
+//                 size_t leaves - leaves among them
+//   - return value: bytes in the tree's file: header, shape bits, colours
+size_t QuadtreeWriter::fileSize(size_t nodes, size_t leaves)
+{
+	return headerSize + (nodes + 7) / 8 + 4 * leaves;
+}
+
+// QuadtreeReader
+//   - creates a reader with nothing mapped
+QuadtreeReader::QuadtreeReader()
+	: data(NULL), length(0), nodes(0), leaves(0), nodesRead(0),
+	  leavesRead(0), shape(NULL), colors(NULL)
+{
+	for (int i = 0; i < 5; i++)
+		geometry[i] = 0;
+}
+
+QuadtreeReader::~QuadtreeReader()
+{
+	close();
+}
+
+// open
+//   - parameters: string const & fileName - file to map
+//   - return value: whether the file is a valid version 1 or 2 quadtree
+//        file; the tree shape itself is checked as it is read
+bool QuadtreeReader::open(string const& fileName)
+{
+	close();
+
+	int fd = ::open(fileName.c_str(), O_RDONLY);
+	if (fd < 0) {
+		qtfile_err("Failed to open " + fileName);
+		return false;
+	}
+	struct stat info;
+	if (fstat(fd, &info) != 0 || (size_t) info.st_size < version1HeaderSize) {
+		::close(fd);
+		qtfile_err(fileName + " is not a quadtree file");
+		return false;
+	}
+	length = (size_t) info.st_size;
+	void* mapping = mmap(NULL, length, PROT_READ, MAP_PRIVATE, fd, 0);
+	// the mapping stays valid after the descriptor is closed
+	::close(fd);
+	if (mapping == MAP_FAILED) {
+		length = 0;
+		qtfile_err("Failed to map " + fileName);
+		return false;
+	}
+	data = (uint8_t const*) mapping;
+
+	if (memcmp(data, magic, 4) != 0) {
+		close();
+		qtfile_err(fileName + " is not a quadtree file");
+		return false;
+	}
+	uint32_t fileVersion = getWord(data + 4);
+	if ((fileVersion != 1 && fileVersion != version)
+		|| (fileVersion == version && length < headerSize)) {
+		close();
+		qtfile_err(fileName + " has an unsupported format version");
+		return false;
+	}
+
+	// version 1 held only whole resolution by resolution images
+	uint32_t words[5];
+	words[0] = getWord(data + 8);
+	size_t offset = 12;
+	if (fileVersion == 1) {
+		words[1] = words[2] = words[0];
+		words[3] = words[4] = 0;
+	}
+	else {
+		for (int i = 1; i < 5; i++, offset += 4)
+			words[i] = getWord(data + offset);
+	}
+	nodes = getWord(data + offset);
+	leaves = getWord(data + offset + 4);
+	shape = data + offset + 8;
+	colors = shape + (nodes + 7) / 8;
+
+	// an empty tree is saved with resolution 0 and no nodes
+	uint32_t resolution = words[0];
+	bool empty = resolution == 0 && nodes == 0;
+	bool valid = resolution != 0 && (resolution & (resolution - 1)) == 0
+		&& resolution <= (1u << 30) && nodes != 0
+		&& words[1] != 0 && words[2] != 0
+		&& (uint64_t) words[3] + words[1] <= resolution
+		&& (uint64_t) words[4] + words[2] <= resolution;
+	if (!(empty || valid)
+		|| length != (size_t) (shape - data) + (nodes + 7) / 8 + 4 * leaves) {
+		close();
+		qtfile_err(fileName + " is corrupt");
+		return false;
+	}
+	for (int i = 0; i < 5; i++)
+		geometry[i] = empty ? 0 : (int) words[i];
+	return true;
+}
+
+int QuadtreeReader::resolution() const
+{
+	return geometry[0];
+}
+
+int QuadtreeReader::width() const
+{
+	return geometry[1];
+}
+
+int QuadtreeReader::height() const
+{
+	return geometry[2];
+}
+
+int QuadtreeReader::xOffset() const
+{
+	return geometry[3];
+}
+
+int QuadtreeReader::yOffset() const
+{
+	return geometry[4];
+}
+
+// readNode
+//   - parameters: bool & isLeaf - set to whether the next node is a leaf
+//                 RGBAPixel & color - set to the leaf's colour
+//   - return value: false if there is no next node (or colour)
+bool QuadtreeReader::readNode(bool& isLeaf, RGBAPixel& color)
+{
+	if (nodesRead == nodes)
+		return false;
+	isLeaf = (shape[nodesRead / 8] & (0x80 >> (nodesRead % 8))) == 0;
+	nodesRead++;
+	if (!isLeaf)
+		return true;
+
+	if (leavesRead == leaves)
+		return false;
+	uint8_t const* rgba = colors + 4 * leavesRead;
+	color = RGBAPixel(rgba[0], rgba[1], rgba[2], rgba[3]);
+	leavesRead++;
+	return true;
+}
+
+bool QuadtreeReader::finished() const
+{
+	return nodesRead == nodes && leavesRead == leaves;
+}
+
+// close
+//   - unmaps the file, if one is mapped
+void QuadtreeReader::close()
+{
+	if (data != NULL)
+		munmap((void*) data, length);
+	data = NULL;
+	length = 0;
+	for (int i = 0; i < 5; i++)
+		geometry[i] = 0;
+	nodes = leaves = nodesRead = leavesRead = 0;
+	shape = colors = NULL;
+}
@@ -0,0 +1,178 @@
+/**
+ * @file quadtreefile.h
+ * Definition of the on-disk format shared by Quadtree and ArrayQuadtree,
+ * and of the classes that write and read it.
+ *
+ * A quadtree file (version 2) is, with every integer little-endian:
+ *
+ *      offset  size        contents
+ *      0       4           magic "QTRE"
+ *      4       4           format version
+ *      8       4           resolution (side of the grid, a power of two)
+ *      12      4           image width
+ *      16      4           image height
+ *      20      4           column of the grid where the image starts
+ *      24      4           row of the grid where the image starts
+ *      28      4           number of nodes
+ *      32      4           number of leaves
+ *      36      nodes/8     tree shape: one bit per node in preorder
+ *                          (nw, ne, sw, se), most significant bit first,
+ *                          1 for an internal node and 0 for a leaf;
+ *                          padded with zeros to a whole byte
+ *      ...     4*leaves    leaf colours as RGBA bytes, in preorder
+ *
+ * Quadrants lying wholly outside the image have no node and are not in
+ * the shape; where they are follows from the geometry in the header.
+ * Version 1 files, which only held full resolution by resolution images,
+ * lack the four geometry words and are still read.
+ *
+ * An empty tree is saved with resolution 0 and no nodes. Internal colours
+ * are not stored: they are the component-wise averages of their children,
+ * and are recomputed on load exactly as a build would.
+ */
+
+#ifndef QUADTREEFILE_H
+#define QUADTREEFILE_H
+
+#include "rgbapixel.h"
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/**
+ * Collects a tree in preorder and writes it out as a quadtree file.
+ */
+class QuadtreeWriter
+{
+  public:
+    /**
+     * Starts an empty file for a tree with the given geometry.
+     * @param resolution The side length of the tree's grid
+     * @param width The width of the represented image
+     * @param height The height of the represented image
+     * @param xOffset The column of the grid where the image starts
+     * @param yOffset The row of the grid where the image starts
+     */
+    QuadtreeWriter(int resolution, int width, int height, int xOffset, int yOffset);
+
+    /**
+     * Appends an internal node; its four children must follow.
+     */
+    void addInternal();
+
+    /**
+     * Appends a leaf.
+     * @param color The colour of the leaf
+     */
+    void addLeaf(RGBAPixel const& color);
+
+    /**
+     * Writes the nodes added so far to a file.
+     * @param fileName Name of the file to write to
+     * @return Whether the file was written successfully
+     */
+    bool writeToFile(std::string const& fileName) const;
+
+    /**
+     * @param nodes The number of nodes in a tree
+     * @param leaves The number of those that are leaves
+     * @return The size in bytes of the file writeToFile makes for it
+     */
+    static size_t fileSize(size_t nodes, size_t leaves);
+
+  private:
+    int geometry[5]; /**< resolution, width, height, xOffset, yOffset */
+    size_t nodes; /**< nodes added so far */
+    std::vector<uint8_t> shape; /**< packed shape bits */
+    std::vector<uint8_t> colors; /**< packed leaf colours */
+};
+
+/**
+ * Maps a quadtree file into memory and hands its nodes out in preorder,
+ * straight from the mapping; the file is never copied into a buffer.
+ */
+class QuadtreeReader
+{
+  public:
+    /**
+     * Creates a reader with no file open.
+     */
+    QuadtreeReader();
+
+    /**
+     * Unmaps the file, if one is open.
+     */
+    ~QuadtreeReader();
+
+    /**
+     * Maps a file and checks its header and size.
+     * @param fileName Name of the file to read
+     * @return Whether the file is a quadtree file this reader understands
+     */
+    bool open(std::string const& fileName);
+
+    /**
+     * @return The side length of the grid of the tree in the open file
+     */
+    int resolution() const;
+
+    /**
+     * @return The width of the image in the open file
+     */
+    int width() const;
+
+    /**
+     * @return The height of the image in the open file
+     */
+    int height() const;
+
+    /**
+     * @return The column of the grid where the image starts
+     */
+    int xOffset() const;
+
+    /**
+     * @return The row of the grid where the image starts
+     */
+    int yOffset() const;
+
+    /**
+     * Reads the next node in preorder.
+     * @param isLeaf Set to whether the node is a leaf
+     * @param color Set to the node's colour if it is a leaf
+     * @return False if every node has already been read
+     */
+    bool readNode(bool& isLeaf, RGBAPixel& color);
+
+    /**
+     * @return Whether every node and colour in the file has been read
+     */
+    bool finished() const;
+
+    /**
+     * Unmaps the file.
+     */
+    void close();
+
+    /**
+     * The version of the format written, and the only one read.
+     */
+    static const uint32_t version = 2;
+
+  private:
+    uint8_t const* data; /**< start of the mapping, or NULL */
+    size_t length; /**< size of the mapping */
+    int geometry[5]; /**< resolution, width, height, xOffset, yOffset */
+    size_t nodes; /**< nodes in the file */
+    size_t leaves; /**< leaves in the file */
+    size_t nodesRead; /**< nodes handed out so far */
+    size_t leavesRead; /**< colours handed out so far */
+    uint8_t const* shape; /**< start of the shape bits */
+    uint8_t const* colors; /**< start of the leaf colours */
+
+    QuadtreeReader(QuadtreeReader const& other) = delete;
+    QuadtreeReader& operator=(QuadtreeReader const& other) = delete;
+};
+
+#endif
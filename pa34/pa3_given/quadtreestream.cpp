@@ -0,0 +1,301 @@
+/**
+ * @file quadtreestream.cpp
+ * Implementation of ProgressiveWriter and ProgressiveDecoder.
+ */
+
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+
+#include "quadtreestream.h"
+
+using namespace std;
+
+static const char magic[4] = {'Q', 'T', 'P', 'S'};
+static const uint32_t version = 1;
+static const size_t headerSize = 28;
+
+inline void qtstream_err(string const& err)
+{
+	cerr << "[ProgressiveDecoder]: " << err << endl;
+}
+
+/**
+ * Appends value to out as four little-endian bytes.
+ */
+static void putWord(vector<uint8_t>& out, uint32_t value)
+{
+	for (int i = 0; i < 4; i++)
+		out.push_back((uint8_t) (value >> (8 * i)));
+}
+
+/**
+ * Reads four little-endian bytes as an integer.
+ */
+static uint32_t getWord(uint8_t const* in)
+{
+	return (uint32_t) in[0] | (uint32_t) in[1] << 8
+		| (uint32_t) in[2] << 16 | (uint32_t) in[3] << 24;
+}
+
+// ProgressiveWriter
+//   - parameters: int resolution - side length of the tree's grid
+//                 int width, int height - size of the represented image
+//                 int xOffset, int yOffset - where the image sits on the grid
+ProgressiveWriter::ProgressiveWriter(int resolution, int width, int height,
+                                     int xOffset, int yOffset)
+	: stream(magic, magic + 4), nodes(0)
+{
+	putWord(stream, version);
+	putWord(stream, (uint32_t) resolution);
+	putWord(stream, (uint32_t) width);
+	putWord(stream, (uint32_t) height);
+	putWord(stream, (uint32_t) xOffset);
+	putWord(stream, (uint32_t) yOffset);
+}
+
+// addNode
+//   - parameters: bool isLeaf - whether the node is a leaf
+//                 RGBAPixel const & color - colour of the node
+//   - appends a shape bit and a colour to the current level
+void ProgressiveWriter::addNode(bool isLeaf, RGBAPixel const& color)
+{
+	if (nodes % 8 == 0)
+		shape.push_back(0);
+	if (!isLeaf)
+		shape.back() |= (uint8_t) (0x80 >> (nodes % 8));
+	nodes++;
+	colors.push_back(color.red);
+	colors.push_back(color.green);
+	colors.push_back(color.blue);
+	colors.push_back(color.alpha);
+}
+
+// endLevel
+//   - appends the current level's record to the stream
+void ProgressiveWriter::endLevel()
+{
+	putWord(stream, (uint32_t) nodes);
+	stream.insert(stream.end(), shape.begin(), shape.end());
+	stream.insert(stream.end(), colors.begin(), colors.end());
+	nodes = 0;
+	shape.clear();
+	colors.clear();
+}
+
+vector<uint8_t> const& ProgressiveWriter::bytes() const
+{
+	return stream;
+}
+
+// ProgressiveDecoder
+//   - creates a decoder waiting for the header
+ProgressiveDecoder::ProgressiveDecoder()
+	: headerRead(false), failed(false), done(false)
+{
+	for (int i = 0; i < 5; i++)
+		geometry[i] = 0;
+}
+
+// feed
+//   - parameters: uint8_t const * data, size_t length - next bytes
+//   - return value: false once the stream is found to be invalid
+//   - decodes the header and every level that is now complete
+bool ProgressiveDecoder::feed(uint8_t const* data, size_t length)
+{
+	if (failed)
+		return false;
+	if (done)
+		return length == 0 || fail("data after the last level");
+	pending.insert(pending.end(), data, data + length);
+
+	size_t offset = 0;
+	if (!headerRead && !readHeader(offset))
+		return false;
+	bool complete = headerRead;
+	while (complete && !done)
+		if (!readLevel(offset, complete))
+			return false;
+	if (done && offset != pending.size())
+		return fail("data after the last level");
+	pending.erase(pending.begin(), pending.begin() + offset);
+	return true;
+}
+
+/**
+ * Decodes the header from pending, if it has all arrived, and sets up
+ * the root as the first level to come.
+ * @param offset Advanced past the header if it was decoded
+ * @return False if the header is invalid
+ */
+bool ProgressiveDecoder::readHeader(size_t& offset)
+{
+	if (pending.size() < headerSize)
+		return true;
+	if (memcmp(pending.data(), magic, 4) != 0)
+		return fail("not a progressive quadtree stream");
+	if (getWord(pending.data() + 4) != version)
+		return fail("unsupported stream version");
+
+	uint32_t words[5];
+	for (int i = 0; i < 5; i++)
+		words[i] = getWord(pending.data() + 8 + 4 * i);
+	uint32_t resolution = words[0];
+	bool empty = resolution == 0;
+	bool valid = (resolution & (resolution - 1)) == 0 && resolution <= (1u << 30)
+		&& words[1] != 0 && words[2] != 0
+		&& (uint64_t) words[3] + words[1] <= resolution
+		&& (uint64_t) words[4] + words[2] <= resolution;
+	if (!empty && !valid)
+		return fail("corrupt stream header");
+
+	for (int i = 0; i < 5; i++)
+		geometry[i] = empty ? 0 : (int) words[i];
+	headerRead = true;
+	done = empty;
+	offset = headerSize;
+	if (!empty) {
+		upcoming.x.assign(1, 0);
+		upcoming.y.assign(1, 0);
+		upcoming.side = geometry[0];
+	}
+	return true;
+}
+
+/**
+ * Decodes the next level record from pending, if it has all arrived.
+ * @param offset Where the record starts in pending; advanced past it if
+ *  it was decoded
+ * @param complete Set to whether the record had all arrived
+ * @return False if the record is invalid
+ */
+bool ProgressiveDecoder::readLevel(size_t& offset, bool& complete)
+{
+	complete = false;
+	if (pending.size() - offset < 4)
+		return true;
+	size_t count = getWord(pending.data() + offset);
+	if (count != upcoming.x.size())
+		return fail("level does not match the one above it");
+	size_t shapeBytes = (count + 7) / 8;
+	if (pending.size() - offset - 4 < shapeBytes + 4 * count)
+		return true;
+
+	uint8_t const* shape = pending.data() + offset + 4;
+	uint8_t const* rgba = shape + shapeBytes;
+	Level level;
+	level.x.swap(upcoming.x);
+	level.y.swap(upcoming.y);
+	level.side = upcoming.side;
+	level.colors.resize(count);
+	level.leaves.resize(count);
+	bool internal = false;
+	for (size_t i = 0; i < count; i++, rgba += 4) {
+		level.leaves[i] = (shape[i / 8] & (0x80 >> (i % 8))) == 0;
+		level.colors[i] = RGBAPixel(rgba[0], rgba[1], rgba[2], rgba[3]);
+		internal = internal || !level.leaves[i];
+	}
+	if (internal && level.side == 1)
+		return fail("single pixel node with children");
+
+	decoded.push_back(level);
+	offset += 4 + shapeBytes + 4 * count;
+	complete = true;
+	done = !internal;
+	if (!done)
+		nextBlocks();
+	return true;
+}
+
+/**
+ * Lists in upcoming, in stream order, the blocks of the children of the
+ * internal nodes of the last decoded level that overlap the image.
+ */
+void ProgressiveDecoder::nextBlocks()
+{
+	Level const& last = decoded.back();
+	int half = last.side / 2;
+	int left = geometry[3], top = geometry[4];
+	int right = left + geometry[1], bottom = top + geometry[2];
+	upcoming.x.clear();
+	upcoming.y.clear();
+	upcoming.side = half;
+	for (size_t i = 0; i < last.x.size(); i++) {
+		if (last.leaves[i])
+			continue;
+		for (int q = 0; q < 4; q++) {
+			int x = last.x[i] + (q % 2) * half, y = last.y[i] + (q / 2) * half;
+			if (x < right && x + half > left && y < bottom && y + half > top) {
+				upcoming.x.push_back(x);
+				upcoming.y.push_back(y);
+			}
+		}
+	}
+}
+
+/**
+ * Reports an invalid stream and stops decoding.
+ * @param reason What is wrong with the stream
+ * @return False, for the caller to return
+ */
+bool ProgressiveDecoder::fail(char const* reason)
+{
+	qtstream_err(reason);
+	failed = true;
+	pending.clear();
+	return false;
+}
+
+int ProgressiveDecoder::levels() const
+{
+	return (int) decoded.size();
+}
+
+bool ProgressiveDecoder::finished() const
+{
+	return done;
+}
+
+int ProgressiveDecoder::width() const
+{
+	return geometry[1];
+}
+
+int ProgressiveDecoder::height() const
+{
+	return geometry[2];
+}
+
+// render
+//   - parameters: int depth - deepest level to draw
+//   - return value: the image with every block known at that level
+//        filled; leaves above it and all nodes of it tile the image
+PNG ProgressiveDecoder::render(int depth) const
+{
+	if (decoded.empty())
+		return PNG();
+	depth = max(0, min(depth, levels() - 1));
+
+	PNG ret((size_t) geometry[1], (size_t) geometry[2]);
+	int left = geometry[3], top = geometry[4];
+	int right = left + geometry[1], bottom = top + geometry[2];
+	for (int d = 0; d <= depth; d++) {
+		Level const& level = decoded[d];
+		for (size_t i = 0; i < level.x.size(); i++) {
+			if (!level.leaves[i] && d < depth)
+				continue;
+			int x0 = max(level.x[i], left), x1 = min(level.x[i] + level.side, right);
+			int y0 = max(level.y[i], top), y1 = min(level.y[i] + level.side, bottom);
+			for (int y = y0; y < y1; y++) {
+				RGBAPixel* row = ret.row(y - top) + (x0 - left);
+				fill(row, row + (x1 - x0), level.colors[i]);
+			}
+		}
+	}
+	return ret;
+}
+
+PNG ProgressiveDecoder::render() const
+{
+	return render(levels() - 1);
+}
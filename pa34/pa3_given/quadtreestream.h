@@ -0,0 +1,201 @@
+/**
+ * @file quadtreestream.h
+ * Definition of the progressive (level by level) stream of a Quadtree,
+ * and of the classes that write and decode it.
+ *
+ * Where a quadtree file (quadtreefile.h) lists the nodes in preorder and
+ * only stores leaf colours, a progressive stream lists them breadth first
+ * and stores the colour of every node, internal ones included: an
+ * internal node's colour is the average of the block it covers. Every
+ * level received therefore completes a coarser picture of the image, and
+ * a client can show a preview long before the last level arrives.
+ *
+ * A stream (version 1) is, with every integer little-endian:
+ *
+ *      offset  size        contents
+ *      0       4           magic "QTPS"
+ *      4       4           format version
+ *      8       4           resolution (side of the grid, a power of two)
+ *      12      4           image width
+ *      16      4           image height
+ *      20      4           column of the grid where the image starts
+ *      24      4           row of the grid where the image starts
+ *      28      ...         one record per level, the root's first
+ *
+ * and each level record is:
+ *
+ *      0       4           number of nodes in the level
+ *      4       nodes/8     one bit per node, most significant bit first,
+ *                          1 for an internal node and 0 for a leaf;
+ *                          padded with zeros to a whole byte
+ *      ...     4*nodes     node colours as RGBA bytes
+ *
+ * The nodes of a level are the children (nw, ne, sw, se) of the internal
+ * nodes of the level above, in that level's order. As in a quadtree file,
+ * quadrants lying wholly outside the image have no node. The stream ends
+ * with the first level that has no internal nodes; an empty tree is a
+ * header with resolution 0 and no levels.
+ */
+
+#ifndef QUADTREESTREAM_H
+#define QUADTREESTREAM_H
+
+#include "png.h"
+#include "rgbapixel.h"
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/**
+ * Collects a tree level by level and lays it out as a progressive stream.
+ */
+class ProgressiveWriter
+{
+  public:
+    /**
+     * Starts a stream, header only, for a tree with the given geometry.
+     * @param resolution The side length of the tree's grid
+     * @param width The width of the represented image
+     * @param height The height of the represented image
+     * @param xOffset The column of the grid where the image starts
+     * @param yOffset The row of the grid where the image starts
+     */
+    ProgressiveWriter(int resolution, int width, int height, int xOffset, int yOffset);
+
+    /**
+     * Appends a node to the level being collected.
+     * @param isLeaf Whether the node is a leaf
+     * @param color The colour of the node
+     */
+    void addNode(bool isLeaf, RGBAPixel const& color);
+
+    /**
+     * Appends the level collected so far to the stream and starts the
+     * next one.
+     */
+    void endLevel();
+
+    /**
+     * @return The stream: the header and every ended level
+     */
+    std::vector<uint8_t> const& bytes() const;
+
+  private:
+    std::vector<uint8_t> stream; /**< header and finished levels */
+    size_t nodes; /**< nodes in the level being collected */
+    std::vector<uint8_t> shape; /**< its packed shape bits */
+    std::vector<uint8_t> colors; /**< its packed colours */
+};
+
+/**
+ * Decodes a progressive stream as it arrives, a piece at a time, and
+ * renders the image as far as it has been received.
+ */
+class ProgressiveDecoder
+{
+  public:
+    /**
+     * Creates a decoder that has received nothing.
+     */
+    ProgressiveDecoder();
+
+    /**
+     * Hands the decoder the next piece of the stream. Every level that is
+     * complete once this piece is added is decoded at once; the rest is
+     * kept until more arrives.
+     * @param data The next bytes of the stream
+     * @param length How many bytes there are
+     * @return False if the stream is not a valid progressive stream, in
+     *  which case the decoder ignores anything fed to it after
+     */
+    bool feed(uint8_t const* data, size_t length);
+
+    /**
+     * @return The number of levels decoded so far; level 0 is the root
+     */
+    int levels() const;
+
+    /**
+     * @return Whether the whole stream has been decoded
+     */
+    bool finished() const;
+
+    /**
+     * @return The width of the image, once the header has arrived
+     */
+    int width() const;
+
+    /**
+     * @return The height of the image, once the header has arrived
+     */
+    int height() const;
+
+    /**
+     * Renders the image as it stands at a level: every block that is a
+     * leaf above that level, or a node of that level, is filled with its
+     * colour. With depth levels() - 1 this is the best picture received
+     * so far, and once the stream is finished it is the decompressed
+     * image, exactly.
+     * @param depth The deepest level to render, below levels()
+     * @return The rendered image, or a default PNG if no level has been
+     *  decoded
+     */
+    PNG render(int depth) const;
+
+    /**
+     * @return The best picture received so far: render(levels() - 1)
+     */
+    PNG render() const;
+
+  private:
+    /**
+     * The nodes of one level, in stream order.
+     */
+    struct Level
+    {
+        std::vector<int> x; /**< column of each node's block on the grid */
+        std::vector<int> y; /**< row of each node's block on the grid */
+        std::vector<RGBAPixel> colors; /**< colour of each node */
+        std::vector<bool> leaves; /**< whether each node is a leaf */
+        int side; /**< side of the blocks of this level */
+    };
+
+    std::vector<uint8_t> pending; /**< bytes received but not decoded */
+    bool headerRead; /**< whether the header has been decoded */
+    bool failed; /**< whether the stream was found to be invalid */
+    bool done; /**< whether the last level has been decoded */
+    int geometry[5]; /**< resolution, width, height, xOffset, yOffset */
+    std::vector<Level> decoded; /**< levels decoded so far */
+    Level upcoming; /**< blocks of the next level, colours not yet known */
+
+    /**
+     * Decodes the header from pending, if it has all arrived.
+     * @param offset Advanced past the header if it was decoded
+     * @return False if the header is invalid
+     */
+    bool readHeader(size_t& offset);
+
+    /**
+     * Decodes the next level record from pending, if it has all arrived.
+     * @param offset Where the record starts in pending; advanced past it
+     *  if it was decoded
+     * @param complete Set to whether the record had all arrived
+     * @return False if the record is invalid
+     */
+    bool readLevel(size_t& offset, bool& complete);
+
+    /**
+     * Lists in upcoming, in stream order, the blocks of the children of
+     * the internal nodes of the last decoded level that overlap the image.
+     */
+    void nextBlocks();
+
+    /**
+     * Reports an invalid stream and stops decoding.
+     * @param reason What is wrong with the stream
+     * @return False, for the caller to return
+     */
+    bool fail(char const* reason);
+};
+
+#endif
@@ -0,0 +1,141 @@
+/**
+ * @file threadpool.cpp
+ * Implementation of the work-stealing ThreadPool.
+ */
+
+#include "threadpool.h"
+
+using namespace std;
+
+// the pool and queue owned by the current thread, if it is a worker
+static thread_local ThreadPool const* workerPool = NULL;
+static thread_local int workerIndex = 0;
+
+TaskGroup::TaskGroup() : pending(0)
+{
+	/* nothing */
+}
+
+// ThreadPool
+//   - parameters: int numThreads - threads working on tasks, counting the
+//                    thread that joins
+//   - starts numThreads - 1 background workers
+ThreadPool::ThreadPool(int numThreads) : queued(0), stopping(false)
+{
+	if (numThreads < 1)
+		numThreads = 1;
+	for (int i = 0; i < numThreads; i++)
+		queues.push_back(new WorkQueue());
+	for (int i = 1; i < numThreads; i++)
+		workers.push_back(thread(&ThreadPool::work, this, i));
+}
+
+// ~ThreadPool
+//   - wakes every worker, waits for them to exit and frees the queues
+ThreadPool::~ThreadPool()
+{
+	{
+		lock_guard<mutex> guard(sleepLock);
+		stopping = true;
+	}
+	wake.notify_all();
+	for (size_t i = 0; i < workers.size(); i++)
+		workers[i].join();
+	for (size_t i = 0; i < queues.size(); i++)
+		delete queues[i];
+}
+
+int ThreadPool::size() const
+{
+	return (int) queues.size();
+}
+
+int ThreadPool::ownQueue() const
+{
+	return workerPool == this ? workerIndex : 0;
+}
+
+// fork
+//   - parameters: TaskGroup & group - group to account the task against
+//                 function task - the work to run
+//   - pushes the task on the back of the calling thread's queue
+void ThreadPool::fork(TaskGroup& group, function<void()> task)
+{
+	group.pending++;
+	WorkQueue* queue = queues[ownQueue()];
+	{
+		lock_guard<mutex> guard(queue->lock);
+		queue->tasks.push_back(Task{task, &group});
+	}
+	{
+		lock_guard<mutex> guard(sleepLock);
+		queued++;
+	}
+	wake.notify_one();
+}
+
+// join
+//   - parameters: TaskGroup & group - group to wait for
+//   - helps run tasks (possibly from other groups) until group is done
+void ThreadPool::join(TaskGroup& group)
+{
+	while (group.pending > 0)
+		if (!runOne())
+			this_thread::yield();
+}
+
+/**
+ * Takes the newest task from the calling thread's queue, or else the
+ * oldest task of the first other queue that has one, and runs it.
+ * @return True if a task was run
+ */
+bool ThreadPool::runOne()
+{
+	int own = ownQueue();
+	int count = (int) queues.size();
+	Task task;
+	bool found = false;
+
+	for (int i = 0; i < count && !found; i++) {
+		int index = (own + i) % count;
+		WorkQueue* queue = queues[index];
+		lock_guard<mutex> guard(queue->lock);
+		if (queue->tasks.empty())
+			continue;
+		if (i == 0) {
+			task = queue->tasks.back();
+			queue->tasks.pop_back();
+		}
+		else {
+			task = queue->tasks.front();
+			queue->tasks.pop_front();
+		}
+		found = true;
+	}
+	if (!found)
+		return false;
+
+	queued--;
+	task.run();
+	task.group->pending--;
+	return true;
+}
+
+/**
+ * Main loop of a background worker: run tasks while there are any, sleep
+ * until more are forked, exit once the pool is stopping.
+ * @param index The queue this worker owns
+ */
+void ThreadPool::work(int index)
+{
+	workerPool = this;
+	workerIndex = index;
+	while (true) {
+		if (runOne())
+			continue;
+		unique_lock<mutex> guard(sleepLock);
+		wake.wait(guard, [this] { return stopping || queued > 0; });
+		if (stopping)
+			return;
+	}
+}
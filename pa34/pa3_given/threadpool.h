@@ -0,0 +1,125 @@
+/**
+ * @file threadpool.h
+ * Definition of a small fork-join thread pool with work stealing.
+ */
+
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+ * Counts the outstanding tasks forked into a ThreadPool so that the
+ * forking thread can wait for them with ThreadPool::join.
+ */
+class TaskGroup
+{
+  public:
+    TaskGroup();
+
+  private:
+    std::atomic<int> pending; /**< tasks forked but not yet finished */
+
+    friend class ThreadPool;
+};
+
+/**
+ * A fork-join pool. Every worker owns a deque: it pushes and pops its own
+ * tasks at the back (so it keeps working on the most recently split, i.e.
+ * smallest and cache-warm, piece) while idle workers steal from the front
+ * of other deques (taking the oldest, i.e. biggest, piece).
+ *
+ * A thread that calls join() does not sleep; it runs queued tasks until
+ * its group is done, so nested fork/join never deadlocks and the calling
+ * thread counts as one of the pool's threads.
+ */
+class ThreadPool
+{
+  public:
+    /**
+     * Starts the pool.
+     * @param numThreads The total number of threads that should work on
+     *  tasks, including the thread that will call join(); numThreads - 1
+     *  background workers are created
+     */
+    explicit ThreadPool(int numThreads);
+
+    /**
+     * Stops and joins every worker. All groups must have been joined.
+     */
+    ~ThreadPool();
+
+    /**
+     * Queues task to be run by any thread of the pool.
+     * @param group The group the task is accounted against
+     * @param task The work to run
+     */
+    void fork(TaskGroup& group, std::function<void()> task);
+
+    /**
+     * Runs queued tasks until every task forked into group has finished.
+     * @param group The group to wait for
+     */
+    void join(TaskGroup& group);
+
+    /**
+     * @return The number of threads working on tasks, including the
+     *  joining thread
+     */
+    int size() const;
+
+  private:
+    /**
+     * A queued unit of work and the group it belongs to.
+     */
+    struct Task
+    {
+        std::function<void()> run;
+        TaskGroup* group;
+    };
+
+    /**
+     * One deque of tasks with its own lock.
+     */
+    struct WorkQueue
+    {
+        std::mutex lock;
+        std::deque<Task> tasks;
+    };
+
+    std::vector<std::thread> workers; /**< background threads */
+    std::vector<WorkQueue*> queues; /**< queue 0 takes external forks */
+    std::mutex sleepLock; /**< guards queued and stopping for sleepers */
+    std::condition_variable wake; /**< signalled when work is queued */
+    std::atomic<int> queued; /**< tasks sitting in any queue */
+    bool stopping; /**< set once by the destructor */
+
+    ThreadPool(ThreadPool const& other) = delete;
+    ThreadPool& operator=(ThreadPool const& other) = delete;
+
+    /**
+     * Main loop of background worker number index.
+     */
+    void work(int index);
+
+    /**
+     * Pops a task from the calling thread's own queue, or steals one from
+     * another queue, and runs it.
+     * @return True if a task was run
+     */
+    bool runOne();
+
+    /**
+     * @return The queue owned by the calling thread, or 0 for threads
+     *  that are not workers of this pool
+     */
+    int ownQueue() const;
+};
+
+#endif